@@ -0,0 +1,480 @@
+// onekm-bench: in-process benchmark of the translation pipeline.
+// Synthetic evdev streams are fed through process_event() (and, for keyboard
+// streams, keyboard_state's 6KRO and bitmap paths on their own) into a null sink and into
+// a memory sink that encodes like the UART writer. Reports events/s, ns/event
+// and output bytes/event per stream and wire protocol, so changes to encoding
+// and coalescing can be compared with numbers.
+
+#include "server/state_machine.h"
+#include "server/keyboard_state.h"
+#include "common/protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+
+#define DEFAULT_REPEATS 5
+
+// The bench runs without input devices or X11; the state machine only needs these two
+void set_device_grab(int grab) {
+    (void)grab;
+}
+
+int key_sync_on_mode_switch(void) {
+    return 0;
+}
+
+/************* Synthetic streams ***************/
+
+typedef struct {
+    InputEvent *events;
+    int count;
+    int capacity;
+    uint64_t time_ns;   // simulated kernel clock
+} Stream;
+
+static void push(Stream *s, uint16_t type, uint16_t code, int32_t value) {
+    if (s->count == s->capacity) {
+        s->capacity = s->capacity ? s->capacity * 2 : 4096;
+        s->events = realloc(s->events, (size_t)s->capacity * sizeof(InputEvent));
+        if (!s->events) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    InputEvent *e = &s->events[s->count++];
+    e->type = type;
+    e->code = code;
+    e->value = value;
+    e->time_ns = s->time_ns;
+}
+
+static void syn(Stream *s, uint64_t advance_ns) {
+    push(s, EV_SYN, SYN_REPORT, 0);
+    s->time_ns += advance_ns;
+}
+
+static void key_tap(Stream *s, uint16_t code, uint64_t hold_ns, uint64_t gap_ns) {
+    push(s, EV_KEY, code, 1);
+    syn(s, hold_ns);
+    push(s, EV_KEY, code, 0);
+    syn(s, gap_ns);
+}
+
+// 8 kHz gaming mouse sweeping back and forth for 2 s: X and Y every frame
+static void gen_mouse_sweep(Stream *s) {
+    for (int frame = 0; frame < 16000; frame++) {
+        int phase = frame % 2000;
+        push(s, EV_REL, REL_X, phase < 1000 ? 3 : -3);
+        push(s, EV_REL, REL_Y, (frame % 7) - 3);
+        syn(s, 125000);
+    }
+}
+
+// 200 WPM (1000 characters per minute) of prose for one minute, shift for capitals
+static void gen_typing(Stream *s) {
+    static const char text[] =
+        "The quick brown fox jumps over the lazy dog. Pack my box with five dozen liquor jugs. ";
+    static const uint16_t letters[26] = {
+        KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F, KEY_G, KEY_H, KEY_I, KEY_J, KEY_K, KEY_L, KEY_M,
+        KEY_N, KEY_O, KEY_P, KEY_Q, KEY_R, KEY_S, KEY_T, KEY_U, KEY_V, KEY_W, KEY_X, KEY_Y, KEY_Z
+    };
+
+    for (int i = 0; i < 1000; i++) {
+        char c = text[i % (sizeof(text) - 1)];
+        uint16_t code;
+        int shift = 0;
+
+        if (c >= 'a' && c <= 'z') {
+            code = letters[c - 'a'];
+        } else if (c >= 'A' && c <= 'Z') {
+            code = letters[c - 'A'];
+            shift = 1;
+        } else if (c == '.') {
+            code = KEY_DOT;
+        } else {
+            code = KEY_SPACE;
+        }
+
+        if (shift) {
+            push(s, EV_KEY, KEY_LEFTSHIFT, 1);
+            syn(s, 15000000);
+        }
+        key_tap(s, code, 40000000, 20000000);
+        if (shift) {
+            push(s, EV_KEY, KEY_LEFTSHIFT, 0);
+            syn(s, 0);
+        }
+    }
+}
+
+// Editor and window manager shortcuts: modifiers held while other keys are tapped,
+// with overlapping presses as real hands produce
+static void gen_chords(Stream *s) {
+    static const uint16_t chords[][4] = {
+        {KEY_LEFTCTRL, KEY_C, 0, 0},
+        {KEY_LEFTCTRL, KEY_V, 0, 0},
+        {KEY_LEFTCTRL, KEY_LEFTSHIFT, KEY_T, 0},
+        {KEY_LEFTALT, KEY_TAB, 0, 0},
+        {KEY_LEFTCTRL, KEY_LEFTALT, KEY_DELETE, 0},
+        {KEY_LEFTMETA, KEY_LEFTSHIFT, KEY_S, 0},
+        {KEY_LEFTCTRL, KEY_LEFTSHIFT, KEY_LEFTALT, KEY_K},
+    };
+    int n = (int)(sizeof(chords) / sizeof(chords[0]));
+
+    for (int i = 0; i < 2000; i++) {
+        const uint16_t *chord = chords[i % n];
+        int keys = 0;
+        while (keys < 4 && chord[keys]) {
+            keys++;
+        }
+        for (int k = 0; k < keys; k++) {
+            push(s, EV_KEY, chord[k], 1);
+            syn(s, 30000000);
+        }
+        for (int k = keys - 1; k >= 0; k--) {
+            push(s, EV_KEY, chord[k], 0);
+            syn(s, 10000000);
+        }
+        s->time_ns += 200000000;
+    }
+}
+
+// Stenography: chords of up to ten keys pressed together and released together.
+// Past six keys a 6KRO report has no room, only the bitmap keeps every key
+static void gen_steno(Stream *s) {
+    static const uint16_t keys[] = {
+        KEY_Q, KEY_W, KEY_E, KEY_R, KEY_T, KEY_Y, KEY_U, KEY_I, KEY_O, KEY_P,
+        KEY_A, KEY_S, KEY_D, KEY_F, KEY_G, KEY_H, KEY_J, KEY_K, KEY_L, KEY_SEMICOLON,
+        KEY_C, KEY_V, KEY_N, KEY_M,
+    };
+    int n = (int)(sizeof(keys) / sizeof(keys[0]));
+
+    for (int i = 0; i < 3000; i++) {
+        int count = 3 + (i * 7) % 8;
+        for (int k = 0; k < count; k++) {
+            push(s, EV_KEY, keys[(i * 5 + k * 3) % n], 1);
+            syn(s, 2000000);
+        }
+        for (int k = 0; k < count; k++) {
+            push(s, EV_KEY, keys[(i * 5 + k * 3) % n], 0);
+            syn(s, 2000000);
+        }
+        s->time_ns += 150000000;
+    }
+}
+
+// 1 kHz mouse: press, drag while scrolling, release; both wheels every few frames
+static void gen_scroll_drag(Stream *s) {
+    for (int drag = 0; drag < 200; drag++) {
+        push(s, EV_KEY, BTN_LEFT, 1);
+        syn(s, 1000000);
+        for (int frame = 0; frame < 50; frame++) {
+            push(s, EV_REL, REL_X, 4);
+            push(s, EV_REL, REL_Y, -2);
+            if (frame % 4 == 0) {
+                push(s, EV_REL, REL_WHEEL, drag % 2 ? 1 : -1);
+            }
+            if (frame % 10 == 0) {
+                push(s, EV_REL, REL_HWHEEL, 1);
+            }
+            syn(s, 1000000);
+        }
+        push(s, EV_KEY, BTN_LEFT, 0);
+        syn(s, 5000000);
+    }
+}
+
+// Free-spinning hi-res wheel at 1 kHz: 1/8 detent per frame, REL_WHEEL once per
+// whole detent in the same frame, as the kernel reports it; spins alternate direction
+static void gen_smooth_scroll(Stream *s) {
+    for (int spin = 0; spin < 100; spin++) {
+        int direction = spin % 2 ? 1 : -1;
+        for (int frame = 1; frame <= 400; frame++) {
+            push(s, EV_REL, REL_WHEEL_HI_RES, direction * 15);
+            if (frame % 8 == 0) {
+                push(s, EV_REL, REL_WHEEL, direction);
+            }
+            syn(s, 1000000);
+        }
+        s->time_ns += 50000000;
+    }
+}
+
+typedef struct {
+    const char *name;
+    void (*generate)(Stream *s);
+    int keyboard;   // also run the NKRO pipeline and time keyboard_state on its own
+} Scenario;
+
+static const Scenario scenarios[] = {
+    {"mouse-8khz", gen_mouse_sweep, 0},
+    {"typing-200wpm", gen_typing, 1},
+    {"chords", gen_chords, 1},
+    {"steno", gen_steno, 1},
+    {"scroll-drag", gen_scroll_drag, 0},
+    {"smooth-scroll", gen_smooth_scroll, 0},
+};
+
+/************* Sinks ***************/
+
+// Encodes each batch the way the UART writer does: v1 bare messages, v2 packed
+// into frames. Only the byte count is kept; the buffer is rewritten every time
+typedef struct {
+    int version;
+    uint8_t out[4096];
+    uint64_t bytes;
+    uint64_t frames;
+    uint64_t messages;
+    uint8_t seq;
+} MemorySink;
+
+static void sink_write(MemorySink *sink, const MessageBatch *batch) {
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    size_t payload_len = 0;
+    size_t out_len = 0;
+
+    for (int i = 0; i < batch->count; i++) {
+        uint8_t encoded[MSG_MAX_ENCODED_SIZE];
+        size_t len = msg_encode(&batch->messages[i], sink->version, encoded, sizeof(encoded));
+
+        if (sink->version == PROTOCOL_V1) {
+            if (out_len + len > sizeof(sink->out)) {
+                out_len = 0;
+            }
+            memcpy(sink->out + out_len, encoded, len);
+            out_len += len;
+            sink->bytes += len;
+            continue;
+        }
+
+        if (payload_len + len > sizeof(payload)) {
+            size_t n = frame_encode(sink->seq++, payload, payload_len, sink->out, sizeof(sink->out));
+            sink->bytes += n;
+            sink->frames++;
+            payload_len = 0;
+        }
+        memcpy(payload + payload_len, encoded, len);
+        payload_len += len;
+    }
+
+    if (payload_len > 0) {
+        sink->bytes += frame_encode(sink->seq++, payload, payload_len, sink->out, sizeof(sink->out));
+        sink->frames++;
+    }
+    sink->messages += (uint64_t)batch->count;
+}
+
+/************* Runner ***************/
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Feed the stream one evdev frame per "read", as the event loop sees it at normal
+// load. sink == NULL is the null sink. Returns elapsed ns
+static uint64_t run_pipeline(const Stream *s, MemorySink *sink, uint64_t *messages) {
+    static MessageBatch batch;
+    uint64_t total = 0;
+
+    msg_batch_reset(&batch);
+    uint64_t start = now_ns();
+    for (int i = 0; i < s->count; i++) {
+        const InputEvent *event = &s->events[i];
+        if (msg_batch_space(&batch) < MAX_MESSAGES_PER_EVENT) {
+            total += (uint64_t)batch.count;
+            if (sink) {
+                sink_write(sink, &batch);
+            }
+            msg_batch_reset(&batch);
+        }
+        process_event(event, &batch);
+        if (event->type == EV_SYN) {
+            total += (uint64_t)batch.count;
+            if (sink) {
+                sink_write(sink, &batch);
+            }
+            msg_batch_reset(&batch);
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    *messages = total;
+    return elapsed;
+}
+
+static uint64_t run_keyboard_state(const Stream *s, int bitmap, uint64_t *keys) {
+    HIDKeyboardReport report;
+    uint8_t usage;
+    uint64_t count = 0;
+
+    keyboard_state_reset(NULL);
+    uint64_t start = now_ns();
+    for (int i = 0; i < s->count; i++) {
+        const InputEvent *event = &s->events[i];
+        if (event->type == EV_KEY) {
+            if (bitmap) {
+                keyboard_state_process_key_bitmap(event->code, (uint8_t)event->value, &usage);
+            } else {
+                keyboard_state_process_key(event->code, (uint8_t)event->value, &report);
+            }
+            count++;
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    *keys = count;
+    return elapsed;
+}
+
+static void enter_remote_mode(void) {
+    static MessageBatch batch;
+    InputEvent pause = {EV_KEY, KEY_PAUSE, 1, 0};
+
+    msg_batch_reset(&batch);
+    process_event(&pause, &batch);
+    pause.value = 0;
+    process_event(&pause, &batch);
+}
+
+static void print_row(const char *scenario, const char *pipeline, uint64_t events,
+                      uint64_t messages, uint64_t best_ns, uint64_t bytes) {
+    double ns_per_event = (double)best_ns / (double)events;
+    printf("%-14s %-16s %9llu %8.3f %10.1f %12.0f",
+           scenario, pipeline, (unsigned long long)events,
+           (double)messages / (double)events, ns_per_event,
+           ns_per_event > 0 ? 1e9 / ns_per_event : 0.0);
+    if (bytes) {
+        printf(" %9.3f\n", (double)bytes / (double)events);
+    } else {
+        printf(" %9s\n", "-");
+    }
+}
+
+static void bench_scenario(const Scenario *scenario, int repeats) {
+    Stream stream = {0};
+    scenario->generate(&stream);
+
+    static const struct {
+        const char *name;
+        int version;     // 0 = null sink
+        int combined;    // one MOUSE_REPORT per frame
+        int nkro;        // KEYBOARD_KEYS instead of KEYBOARD_REPORT
+    } pipelines[] = {
+        {"translate v1", 0, 0, 0},
+        {"translate v2", 0, 1, 0},
+        {"v1 9-byte", PROTOCOL_V1, 0, 0},
+        {"v2 framed", PROTOCOL_V2, 1, 0},
+        {"v2 nkro", PROTOCOL_V2, 1, 1},
+    };
+
+    for (size_t p = 0; p < sizeof(pipelines) / sizeof(pipelines[0]); p++) {
+        uint64_t best = UINT64_MAX;
+        uint64_t messages = 0;
+        uint64_t bytes = 0;
+
+        if (pipelines[p].nkro && !scenario->keyboard) {
+            continue;
+        }
+        set_combined_mouse_reports(pipelines[p].combined);
+        set_nkro_keyboard(pipelines[p].nkro);
+        for (int r = 0; r < repeats; r++) {
+            MemorySink sink = {.version = pipelines[p].version};
+            uint64_t elapsed = run_pipeline(&stream, pipelines[p].version ? &sink : NULL, &messages);
+            if (elapsed < best) {
+                best = elapsed;
+                bytes = sink.bytes;
+            }
+        }
+        print_row(scenario->name, pipelines[p].name, (uint64_t)stream.count, messages, best, bytes);
+    }
+    set_nkro_keyboard(0);
+
+    for (int bitmap = 0; scenario->keyboard && bitmap <= 1; bitmap++) {
+        uint64_t best = UINT64_MAX;
+        uint64_t keys = 0;
+        for (int r = 0; r < repeats; r++) {
+            uint64_t elapsed = run_keyboard_state(&stream, bitmap, &keys);
+            if (elapsed < best) {
+                best = elapsed;
+            }
+        }
+        print_row(scenario->name, bitmap ? "keyboard bitmap" : "keyboard_state", keys, keys, best, 0);
+    }
+
+    free(stream.events);
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options] [scenario...]\n", prog);
+    printf("  -r, --repeat N   Runs per measurement, best one is reported (default %d)\n",
+           DEFAULT_REPEATS);
+    printf("  -h, --help       Show this help\n");
+    printf("Scenarios:");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        printf(" %s", scenarios[i].name);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    int repeats = DEFAULT_REPEATS;
+
+    static const struct option long_options[] = {
+        {"repeat", required_argument, NULL, 'r'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "r:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'r':
+                repeats = atoi(optarg);
+                if (repeats <= 0) {
+                    fprintf(stderr, "Invalid repeat count %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    init_state_machine();
+    keyboard_state_init();
+    enter_remote_mode();
+
+    // keyboard_state logs every key press to stderr; keep the table readable
+    // (the write() calls are still part of the measurement)
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDERR_FILENO);
+        close(null_fd);
+    }
+
+    printf("\n%-14s %-16s %9s %8s %10s %12s %9s\n",
+           "scenario", "pipeline", "events", "msg/ev", "ns/event", "events/s", "bytes/ev");
+
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        int selected = optind >= argc;
+        for (int a = optind; a < argc; a++) {
+            selected |= strcmp(argv[a], scenarios[i].name) == 0;
+        }
+        if (selected) {
+            bench_scenario(&scenarios[i], repeats);
+        }
+    }
+
+    return 0;
+}
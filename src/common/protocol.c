@@ -37,4 +37,534 @@ void msg_mouse_wheel(Message *msg, int16_t vertical, int16_t horizontal) {
         msg->data.mouse_wheel.vertical = vertical;
         msg->data.mouse_wheel.horizontal = horizontal;
     }
-}
\ No newline at end of file
+}
+
+void msg_link_config(Message *msg, uint32_t baud_rate) {
+    if (msg) {
+        msg->type = MSG_LINK_CONFIG;
+        msg->data.link_config.baud_rate = baud_rate;
+    }
+}
+
+void msg_link_test(Message *msg, uint32_t sequence) {
+    if (msg) {
+        msg->type = MSG_LINK_TEST;
+        msg->data.link_test.sequence = sequence;
+    }
+}
+
+void msg_mouse_report(Message *msg, uint8_t buttons, int16_t dx, int16_t dy,
+                      int8_t vertical, int8_t horizontal) {
+    if (msg) {
+        msg->type = MSG_MOUSE_REPORT;
+        msg->data.mouse_report.buttons = buttons;
+        msg->data.mouse_report.dx = dx;
+        msg->data.mouse_report.dy = dy;
+        msg->data.mouse_report.vertical = vertical;
+        msg->data.mouse_report.horizontal = horizontal;
+        msg->data.mouse_report.padding = 0;
+    }
+}
+
+void msg_ack(Message *msg, uint8_t sequence, uint8_t flags) {
+    if (msg) {
+        msg->type = MSG_ACK;
+        msg->data.ack.sequence = sequence;
+        msg->data.ack.flags = flags;
+    }
+}
+
+void msg_mouse_scroll(Message *msg, int16_t vertical, int16_t horizontal) {
+    if (msg) {
+        msg->type = MSG_MOUSE_SCROLL;
+        msg->data.mouse_scroll.vertical = vertical;
+        msg->data.mouse_scroll.horizontal = horizontal;
+    }
+}
+
+void msg_keyboard_keys(Message *msg, uint8_t usage, uint8_t pressed) {
+    if (msg) {
+        memset(&msg->data, 0, sizeof(msg->data));
+        msg->type = MSG_KEYBOARD_KEYS;
+        msg->data.keyboard_keys.count = 1;
+        msg->data.keyboard_keys.pressed = pressed ? 1 : 0;
+        msg->data.keyboard_keys.usages[0] = usage;
+    }
+}
+
+void msg_batch_reset(MessageBatch *batch) {
+    if (batch) {
+        batch->count = 0;
+    }
+}
+
+Message *msg_batch_append(MessageBatch *batch) {
+    if (!batch) {
+        return NULL;
+    }
+    if (batch->count >= MESSAGE_BATCH_CAPACITY) {
+        batch->overflow++;
+        return NULL;
+    }
+    Message *msg = &batch->messages[batch->count++];
+    memset(msg, 0, sizeof(*msg));
+    return msg;
+}
+
+int msg_batch_space(const MessageBatch *batch) {
+    return batch ? MESSAGE_BATCH_CAPACITY - batch->count : 0;
+}
+
+/************* Wire encoding ***************/
+
+static uint16_t zigzag_encode(int16_t value) {
+    return (uint16_t)(((uint16_t)value << 1) ^ (uint16_t)(value >> 15));
+}
+
+static int16_t zigzag_decode(uint16_t value) {
+    return (int16_t)((value >> 1) ^ (uint16_t)-(int16_t)(value & 1));
+}
+
+static size_t put_varint(uint8_t *buf, int16_t value) {
+    uint16_t v = zigzag_encode(value);
+    size_t len = 0;
+    while (v >= 0x80) {
+        buf[len++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    buf[len++] = (uint8_t)v;
+    return len;
+}
+
+// Returns bytes consumed, 0 if incomplete, -1 if malformed
+static int get_varint(const uint8_t *buf, size_t len, int16_t *value) {
+    uint32_t v = 0;
+    for (size_t i = 0; i < 3; i++) {
+        if (i >= len) {
+            return 0;
+        }
+        v |= (uint32_t)(buf[i] & 0x7F) << (7 * i);
+        if (!(buf[i] & 0x80)) {
+            if (v > 0xFFFF) {
+                return -1;
+            }
+            *value = zigzag_decode((uint16_t)v);
+            return (int)i + 1;
+        }
+    }
+    return -1;
+}
+
+static size_t put_u32(uint8_t *buf, uint32_t value) {
+    buf[0] = (uint8_t)value;
+    buf[1] = (uint8_t)(value >> 8);
+    buf[2] = (uint8_t)(value >> 16);
+    buf[3] = (uint8_t)(value >> 24);
+    return 4;
+}
+
+static uint32_t get_u32(const uint8_t *buf) {
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static size_t encode_v2(const Message *msg, uint8_t *buf) {
+    size_t len = 0;
+    buf[len++] = MSG_V2_FLAG | msg->type;
+
+    switch (msg->type) {
+        case MSG_MOUSE_MOVE:
+            len += put_varint(buf + len, msg->data.mouse_move.dx);
+            len += put_varint(buf + len, msg->data.mouse_move.dy);
+            break;
+        case MSG_MOUSE_BUTTON:
+            buf[len++] = (uint8_t)((msg->data.mouse_button.button & 0x7F) |
+                                   (msg->data.mouse_button.state ? 0x80 : 0));
+            break;
+        case MSG_KEYBOARD_REPORT: {
+            size_t count_pos;
+            buf[len++] = msg->data.keyboard.modifiers;
+            count_pos = len++;
+            buf[count_pos] = 0;
+            for (int i = 0; i < 6; i++) {
+                if (msg->data.keyboard.keys[i] != 0) {
+                    buf[len++] = msg->data.keyboard.keys[i];
+                    buf[count_pos]++;
+                }
+            }
+            break;
+        }
+        case MSG_KEYBOARD_KEYS: {
+            uint8_t count = msg->data.keyboard_keys.count;
+            if (count == 0 || count > KEYBOARD_KEYS_MAX) {
+                return 0;
+            }
+            buf[len++] = count;
+            buf[len++] = msg->data.keyboard_keys.pressed;
+            memcpy(buf + len, msg->data.keyboard_keys.usages, count);
+            len += count;
+            break;
+        }
+        case MSG_SWITCH:
+            buf[len++] = msg->data.control.state;
+            break;
+        case MSG_MOUSE_WHEEL:
+            len += put_varint(buf + len, msg->data.mouse_wheel.vertical);
+            len += put_varint(buf + len, msg->data.mouse_wheel.horizontal);
+            break;
+        case MSG_MOUSE_SCROLL:
+            len += put_varint(buf + len, msg->data.mouse_scroll.vertical);
+            len += put_varint(buf + len, msg->data.mouse_scroll.horizontal);
+            break;
+        case MSG_LINK_CONFIG:
+            len += put_u32(buf + len, msg->data.link_config.baud_rate);
+            break;
+        case MSG_LINK_TEST:
+            len += put_u32(buf + len, msg->data.link_test.sequence);
+            break;
+        case MSG_MOUSE_REPORT:
+            buf[len++] = msg->data.mouse_report.buttons;
+            len += put_varint(buf + len, msg->data.mouse_report.dx);
+            len += put_varint(buf + len, msg->data.mouse_report.dy);
+            buf[len++] = (uint8_t)msg->data.mouse_report.vertical;
+            buf[len++] = (uint8_t)msg->data.mouse_report.horizontal;
+            break;
+        case MSG_ACK:
+            buf[len++] = msg->data.ack.sequence;
+            buf[len++] = msg->data.ack.flags;
+            break;
+        default:
+            return 0;
+    }
+    return len;
+}
+
+size_t msg_encode(const Message *msg, int version, uint8_t *buf, size_t cap) {
+    if (!msg || !buf || cap < MSG_MAX_ENCODED_SIZE) {
+        return 0;
+    }
+
+    if (version == PROTOCOL_V1) {
+        memcpy(buf, msg, sizeof(Message));
+        return sizeof(Message);
+    }
+    return encode_v2(msg, buf);
+}
+
+static int is_known_type(uint8_t type) {
+    return type >= MSG_MOUSE_MOVE && type <= MSG_KEYBOARD_KEYS;
+}
+
+static int decode_v2(const uint8_t *buf, size_t len, Message *msg) {
+    uint8_t type = buf[0] & (uint8_t)~MSG_V2_FLAG;
+    size_t pos = 1;
+    int n;
+
+    memset(msg, 0, sizeof(*msg));
+    msg->type = type;
+
+    switch (type) {
+        case MSG_MOUSE_MOVE:
+        case MSG_MOUSE_WHEEL:
+        case MSG_MOUSE_SCROLL: {
+            int16_t a, b;
+            if ((n = get_varint(buf + pos, len - pos, &a)) <= 0) {
+                return n;
+            }
+            pos += (size_t)n;
+            if ((n = get_varint(buf + pos, len - pos, &b)) <= 0) {
+                return n;
+            }
+            pos += (size_t)n;
+            if (type == MSG_MOUSE_MOVE) {
+                msg->data.mouse_move.dx = a;
+                msg->data.mouse_move.dy = b;
+            } else if (type == MSG_MOUSE_SCROLL) {
+                msg->data.mouse_scroll.vertical = a;
+                msg->data.mouse_scroll.horizontal = b;
+            } else {
+                msg->data.mouse_wheel.vertical = a;
+                msg->data.mouse_wheel.horizontal = b;
+            }
+            return (int)pos;
+        }
+        case MSG_MOUSE_BUTTON:
+            if (len < 2) {
+                return 0;
+            }
+            msg->data.mouse_button.button = buf[1] & 0x7F;
+            msg->data.mouse_button.state = (buf[1] & 0x80) ? BUTTON_PRESSED : BUTTON_RELEASED;
+            return 2;
+        case MSG_KEYBOARD_REPORT: {
+            if (len < 3) {
+                return 0;
+            }
+            uint8_t count = buf[2];
+            if (count > 6) {
+                return -1;
+            }
+            if (len < 3u + count) {
+                return 0;
+            }
+            msg->data.keyboard.modifiers = buf[1];
+            memcpy(msg->data.keyboard.keys, buf + 3, count);
+            return 3 + count;
+        }
+        case MSG_KEYBOARD_KEYS: {
+            if (len < 2) {
+                return 0;
+            }
+            uint8_t count = buf[1];
+            if (count == 0 || count > KEYBOARD_KEYS_MAX) {
+                return -1;
+            }
+            if (len < 3u + count) {
+                return 0;
+            }
+            msg->data.keyboard_keys.count = count;
+            msg->data.keyboard_keys.pressed = buf[2];
+            memcpy(msg->data.keyboard_keys.usages, buf + 3, count);
+            return 3 + count;
+        }
+        case MSG_SWITCH:
+            if (len < 2) {
+                return 0;
+            }
+            msg->data.control.state = buf[1];
+            return 2;
+        case MSG_LINK_CONFIG:
+        case MSG_LINK_TEST:
+            if (len < 5) {
+                return 0;
+            }
+            if (type == MSG_LINK_CONFIG) {
+                msg->data.link_config.baud_rate = get_u32(buf + 1);
+            } else {
+                msg->data.link_test.sequence = get_u32(buf + 1);
+            }
+            return 5;
+        case MSG_MOUSE_REPORT: {
+            int16_t dx, dy;
+            if (len < 2) {
+                return 0;
+            }
+            pos = 2;
+            if ((n = get_varint(buf + pos, len - pos, &dx)) <= 0) {
+                return n;
+            }
+            pos += (size_t)n;
+            if ((n = get_varint(buf + pos, len - pos, &dy)) <= 0) {
+                return n;
+            }
+            pos += (size_t)n;
+            if (len < pos + 2) {
+                return 0;
+            }
+            msg->data.mouse_report.buttons = buf[1];
+            msg->data.mouse_report.dx = dx;
+            msg->data.mouse_report.dy = dy;
+            msg->data.mouse_report.vertical = (int8_t)buf[pos];
+            msg->data.mouse_report.horizontal = (int8_t)buf[pos + 1];
+            return (int)pos + 2;
+        }
+        case MSG_ACK:
+            if (len < 3) {
+                return 0;
+            }
+            msg->data.ack.sequence = buf[1];
+            msg->data.ack.flags = buf[2];
+            return 3;
+        default:
+            return -1;
+    }
+}
+
+int msg_decode(const uint8_t *buf, size_t len, Message *msg) {
+    if (!buf || !msg || len == 0) {
+        return 0;
+    }
+
+    if (buf[0] & MSG_V2_FLAG) {
+        return decode_v2(buf, len, msg);
+    }
+
+    if (!is_known_type(buf[0])) {
+        return -1;
+    }
+    if (len < sizeof(Message)) {
+        return 0;
+    }
+    memcpy(msg, buf, sizeof(Message));
+    return sizeof(Message);
+}
+
+void msg_decoder_init(MessageDecoder *decoder) {
+    if (decoder) {
+        memset(decoder, 0, sizeof(*decoder));
+    }
+}
+
+int msg_decoder_feed(MessageDecoder *decoder, uint8_t byte, Message *msg) {
+    if (!decoder || !msg) {
+        return 0;
+    }
+
+    decoder->buf[decoder->len++] = byte;
+
+    for (;;) {
+        int n = msg_decode(decoder->buf, decoder->len, msg);
+        if (n > 0) {
+            // Keep whatever followed the message (only after skipping a bad byte)
+            decoder->len -= (size_t)n;
+            memmove(decoder->buf, decoder->buf + n, decoder->len);
+            return 1;
+        }
+        if (n == 0 && decoder->len < sizeof(decoder->buf)) {
+            return 0;
+        }
+        // Not a valid message start: drop the first byte and retry from the next
+        decoder->errors++;
+        memmove(decoder->buf, decoder->buf + 1, --decoder->len);
+        if (decoder->len == 0) {
+            return 0;
+        }
+    }
+}
+
+/************* Link framing ***************/
+
+uint16_t crc16_ccitt(const uint8_t *data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// COBS: every run of non-zero bytes is prefixed with its length + 1, zeros vanish
+static size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out) {
+    size_t out_pos = 1;
+    size_t code_pos = 0;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] == 0) {
+            out[code_pos] = code;
+            code_pos = out_pos++;
+            code = 1;
+            continue;
+        }
+        out[out_pos++] = in[i];
+        if (++code == 0xFF) {
+            out[code_pos] = code;
+            code_pos = out_pos++;
+            code = 1;
+        }
+    }
+    out[code_pos] = code;
+    return out_pos;
+}
+
+// Decodes in place (output never outgrows input). Returns decoded length, or -1 if malformed
+static int cobs_decode(uint8_t *buf, size_t len) {
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+
+    while (in_pos < len) {
+        uint8_t code = buf[in_pos++];
+        if (code == 0 || in_pos + code - 1 > len) {
+            return -1;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            buf[out_pos++] = buf[in_pos++];
+        }
+        if (code != 0xFF && in_pos < len) {
+            buf[out_pos++] = 0;
+        }
+    }
+    return (int)out_pos;
+}
+
+size_t frame_encode(uint8_t seq, const uint8_t *payload, size_t len, uint8_t *out, size_t cap) {
+    uint8_t raw[FRAME_MAX_PAYLOAD + FRAME_OVERHEAD];
+
+    if (!out || (len > 0 && !payload) || len > FRAME_MAX_PAYLOAD || cap < FRAME_MAX_ENCODED_SIZE) {
+        return 0;
+    }
+
+    raw[0] = seq;
+    memcpy(raw + 1, payload, len);
+    uint16_t crc = crc16_ccitt(raw, len + 1);
+    raw[len + 1] = (uint8_t)(crc & 0xFF);
+    raw[len + 2] = (uint8_t)(crc >> 8);
+
+    size_t encoded = cobs_encode(raw, len + FRAME_OVERHEAD, out);
+    out[encoded++] = FRAME_DELIMITER;
+    return encoded;
+}
+
+void frame_decoder_init(FrameDecoder *decoder) {
+    if (decoder) {
+        memset(decoder, 0, sizeof(*decoder));
+    }
+}
+
+int frame_decoder_feed(FrameDecoder *decoder, uint8_t byte, uint8_t *seq,
+                       const uint8_t **payload, size_t *len) {
+    if (!decoder) {
+        return 0;
+    }
+
+    if (byte != FRAME_DELIMITER) {
+        if (decoder->len >= sizeof(decoder->buf)) {
+            decoder->overflow = 1;
+        } else {
+            decoder->buf[decoder->len++] = byte;
+        }
+        return 0;
+    }
+
+    // Delimiter: whatever was collected is one candidate frame
+    size_t collected = decoder->len;
+    int overflow = decoder->overflow;
+    decoder->len = 0;
+    decoder->overflow = 0;
+
+    if (collected == 0) {
+        return 0;   // back-to-back delimiters are used for resync
+    }
+
+    int decoded = overflow ? -1 : cobs_decode(decoder->buf, collected);
+    if (decoded < FRAME_OVERHEAD) {
+        decoder->stats.format_errors++;
+        return 0;
+    }
+
+    size_t body = (size_t)decoded - 2;
+    uint16_t crc = (uint16_t)(decoder->buf[body] | (decoder->buf[body + 1] << 8));
+    if (crc16_ccitt(decoder->buf, body) != crc) {
+        decoder->stats.crc_errors++;
+        return 0;
+    }
+
+    uint8_t frame_seq = decoder->buf[0];
+    if (decoder->have_seq && frame_seq != decoder->next_seq) {
+        decoder->stats.seq_gaps += (uint8_t)(frame_seq - decoder->next_seq);
+    }
+    decoder->have_seq = 1;
+    decoder->next_seq = (uint8_t)(frame_seq + 1);
+    decoder->stats.frames++;
+
+    if (seq) {
+        *seq = frame_seq;
+    }
+    if (payload) {
+        *payload = decoder->buf + 1;
+    }
+    if (len) {
+        *len = body - 1;
+    }
+    return 1;
+}
@@ -1,6 +1,7 @@
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #pragma pack(push, 1)
@@ -34,25 +35,118 @@ typedef struct {
             int16_t vertical;   // 垂直滚轮（通常为正=向上，负=向下）
             int16_t horizontal; // 水平滚轮（通常为正=向右，负=向左）
         } mouse_wheel;
+        struct {
+            uint32_t baud_rate; // 切换到的 UART 波特率
+            uint8_t padding[4]; // 填充
+        } link_config;
+        struct {
+            uint32_t sequence;  // 链路测试计数
+            uint8_t padding[4]; // 填充
+        } link_test;
+        struct {
+            uint8_t buttons;    // 按键位掩码（bit0=左，bit1=右，bit2=中）
+            int16_t dx;         // 鼠标X位移
+            int16_t dy;         // 鼠标Y位移
+            int8_t vertical;    // 垂直滚轮
+            int8_t horizontal;  // 水平滚轮
+            uint8_t padding;    // 填充
+        } mouse_report;
+        struct {
+            int16_t vertical;   // 垂直滚动，单位为 1/WHEEL_HI_RES_UNITS 格
+            int16_t horizontal; // 水平滚动
+            uint8_t padding[4]; // 填充
+        } mouse_scroll;
+        struct {
+            uint8_t count;      // 变化的按键数（1-6）
+            uint8_t pressed;    // bit i：usages[i] 按下(1)/松开(0)
+            uint8_t usages[6];  // HID 用法（修饰键为 0xE0-0xE7）
+        } keyboard_keys;
+        struct {
+            uint8_t sequence;   // 被确认的帧序号
+            uint8_t flags;      // ACK_FLAG_*
+            uint8_t padding[6]; // 填充
+        } ack;
     } data;
 } Message;
 
 #pragma pack(pop)
 
+// Caller-owned batch of outgoing messages
+#define MESSAGE_BATCH_CAPACITY 128
+
+typedef struct {
+    Message messages[MESSAGE_BATCH_CAPACITY];
+    int count;
+    unsigned int overflow;  // messages that did not fit
+} MessageBatch;
+
 // 消息类型定义
 enum MessageType {
     MSG_MOUSE_MOVE = 0x01,
     MSG_MOUSE_BUTTON = 0x02,
     MSG_KEYBOARD_REPORT = 0x03,  // 发送完整的HID键盘报告
     MSG_SWITCH = 0x04,
-    MSG_MOUSE_WHEEL = 0x05       // 鼠标滚轮事件
+    MSG_MOUSE_WHEEL = 0x05,      // 鼠标滚轮事件
+    MSG_LINK_CONFIG = 0x06,      // 切换 UART 波特率
+    MSG_LINK_TEST = 0x07,        // 链路吞吐测试（固件只计数）
+    MSG_MOUSE_REPORT = 0x08,     // 完整鼠标报告：按键掩码 + 位移 + 滚轮
+    MSG_ACK = 0x09,              // 固件 -> 服务器：帧确认
+    MSG_MOUSE_SCROLL = 0x0A,     // 高分辨率滚动（1/120 格）
+    MSG_KEYBOARD_KEYS = 0x0B     // 键盘位图中变化的按键（NKRO，不受 6 键限制）
 };
 
-// 鼠标按键定义
+// MOUSE_SCROLL units per wheel detent, as for the kernel's REL_WHEEL_HI_RES
+#define WHEEL_HI_RES_UNITS 120
+
+// Most key changes one KEYBOARD_KEYS message carries
+#define KEYBOARD_KEYS_MAX 6
+
+// ACK 标志
+// Without ACK_FLAG_HID_DELIVERED the frame was applied but produced no HID report
+// (e.g. SWITCH). With it, the host has taken the HID report built from this frame;
+// reports coalesce, so it also covers earlier unacknowledged HID frames.
+#define ACK_FLAG_HID_DELIVERED 0x01
+
+// 协议版本
+// v1: fixed 9-byte Message on the wire (type byte + 8-byte union), kept for older dongles
+// v2: variable-length encoding. The type byte carries MSG_V2_FLAG and is followed
+//     by a per-type payload; motion and wheel deltas are zigzag varints.
+//       MOUSE_MOVE      flag|0x01, varint dx, varint dy          (3-7 bytes)
+//       MOUSE_BUTTON    flag|0x02, button | state << 7           (2 bytes)
+//       KEYBOARD_REPORT flag|0x03, modifiers, n, n keycodes      (3-9 bytes)
+//       SWITCH          flag|0x04, state                         (2 bytes)
+//       MOUSE_WHEEL     flag|0x05, varint vertical, varint horiz (3-7 bytes)
+//       LINK_CONFIG     flag|0x06, baud rate (u32 little endian)    (5 bytes)
+//       LINK_TEST       flag|0x07, sequence (u32 little endian)     (5 bytes)
+//       MOUSE_REPORT    flag|0x08, buttons, varint dx, varint dy,
+//                       vertical (i8), horizontal (i8)             (6-10 bytes)
+//       ACK             flag|0x09, frame sequence, flags           (3 bytes)
+//       MOUSE_SCROLL    flag|0x0A, varint vertical, varint horiz (3-7 bytes)
+//       KEYBOARD_KEYS   flag|0x0B, n, pressed mask, n usages      (4-9 bytes)
+// Both versions can be mixed on one stream: the flag tells a decoder which one follows.
+enum ProtocolVersion {
+    PROTOCOL_V1 = 1,
+    PROTOCOL_V2 = 2
+};
+
+#define MSG_V2_FLAG 0x80
+#define MSG_MAX_ENCODED_SIZE 16
+
+// 链路帧（v2 使用，v1 为无帧的裸消息流）
+// A frame carries a sequence number, one or more encoded messages and a CRC-16,
+// COBS-encoded so that 0x00 never appears inside it, then terminated by 0x00:
+//     COBS( seq | payload... | crc16_lo | crc16_hi ) 0x00
+// A receiver that loses or corrupts bytes resynchronises at the next 0x00.
+#define FRAME_DELIMITER 0x00
+#define FRAME_MAX_PAYLOAD 128
+#define FRAME_OVERHEAD 3   // seq + crc16
+#define FRAME_MAX_ENCODED_SIZE (FRAME_MAX_PAYLOAD + FRAME_OVERHEAD + 2 + 1)
+
+// 鼠标按键定义（MOUSE_BUTTON_* 已被 TinyUSB hid.h 占用，固件同时包含两者）
 enum MouseButton {
-    MOUSE_BUTTON_LEFT = 0x01,
-    MOUSE_BUTTON_RIGHT = 0x02,
-    MOUSE_BUTTON_MIDDLE = 0x03
+    MOUSE_BTN_LEFT = 0x01,
+    MOUSE_BTN_RIGHT = 0x02,
+    MOUSE_BTN_MIDDLE = 0x03
 };
 
 // 按键状态
@@ -83,6 +177,70 @@ void msg_mouse_button(Message *msg, uint8_t button, uint8_t state);
 void msg_keyboard_report(Message *msg, const HIDKeyboardReport *report);
 void msg_switch(Message *msg, uint8_t state);
 void msg_mouse_wheel(Message *msg, int16_t vertical, int16_t horizontal);
+void msg_link_config(Message *msg, uint32_t baud_rate);
+void msg_link_test(Message *msg, uint32_t sequence);
+void msg_mouse_report(Message *msg, uint8_t buttons, int16_t dx, int16_t dy,
+                      int8_t vertical, int8_t horizontal);
+void msg_ack(Message *msg, uint8_t sequence, uint8_t flags);
+void msg_mouse_scroll(Message *msg, int16_t vertical, int16_t horizontal);
+void msg_keyboard_keys(Message *msg, uint8_t usage, uint8_t pressed);
+
+// Message batch functions
+void msg_batch_reset(MessageBatch *batch);
+// Returns the next free slot, or NULL (and counts an overflow) when the batch is full
+Message *msg_batch_append(MessageBatch *batch);
+int msg_batch_space(const MessageBatch *batch);
+
+// Wire encoding
+// Encode msg in the given protocol version into buf
+// Returns the number of bytes written, 0 if the message cannot be encoded
+size_t msg_encode(const Message *msg, int version, uint8_t *buf, size_t cap);
+
+// Decode one message (either version) from the start of buf
+// Returns bytes consumed, 0 if buf holds an incomplete message, -1 if buf[0] is not a valid message start
+int msg_decode(const uint8_t *buf, size_t len, Message *msg);
+
+// Byte-at-a-time decoder for an unframed stream
+typedef struct {
+    uint8_t buf[MSG_MAX_ENCODED_SIZE];
+    size_t len;
+    unsigned int errors;   // bytes skipped because they did not start a valid message
+} MessageDecoder;
+
+void msg_decoder_init(MessageDecoder *decoder);
+// Returns 1 when a complete message was stored in msg
+int msg_decoder_feed(MessageDecoder *decoder, uint8_t byte, Message *msg);
+
+// Link framing
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+uint16_t crc16_ccitt(const uint8_t *data, size_t len);
+
+// Build a complete frame (including the trailing delimiter) into out
+// Returns the number of bytes written, 0 if the payload is too large or out too small
+size_t frame_encode(uint8_t seq, const uint8_t *payload, size_t len, uint8_t *out, size_t cap);
+
+typedef struct {
+    uint32_t frames;        // valid frames delivered
+    uint32_t crc_errors;    // frames dropped for a bad CRC
+    uint32_t format_errors; // bad COBS, too short or too long
+    uint32_t seq_gaps;      // frames missing according to the sequence numbers
+} FrameStats;
+
+typedef struct {
+    uint8_t buf[FRAME_MAX_ENCODED_SIZE];
+    size_t len;
+    int overflow;           // current frame is too long, skip to the next delimiter
+    int have_seq;
+    uint8_t next_seq;
+    FrameStats stats;
+} FrameDecoder;
+
+void frame_decoder_init(FrameDecoder *decoder);
+
+// Feed one received byte. Returns 1 when a valid frame has been completed;
+// its payload (valid until the next call) is stored in *payload / *len
+int frame_decoder_feed(FrameDecoder *decoder, uint8_t byte, uint8_t *seq,
+                       const uint8_t **payload, size_t *len);
 
 // Legacy function (removed - no longer needed)
 // void msg_key_event(Message *msg, uint16_t keycode, uint8_t state);
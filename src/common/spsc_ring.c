@@ -0,0 +1,65 @@
+#include "spsc_ring.h"
+#include <string.h>
+
+int spsc_ring_init(SpscRing *ring, void *buffer, size_t elem_size, size_t capacity) {
+    if (!ring || !buffer || elem_size == 0 || capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return -1;
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->buffer = buffer;
+    ring->elem_size = elem_size;
+    ring->mask = capacity - 1;
+    atomic_init(&ring->high_water, 0);
+    atomic_init(&ring->full_count, 0);
+    return 0;
+}
+
+int spsc_ring_push(SpscRing *ring, const void *elem) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t depth = head - tail;
+
+    if (depth > ring->mask) {
+        atomic_fetch_add_explicit(&ring->full_count, 1, memory_order_relaxed);
+        return -1;
+    }
+
+    memcpy(ring->buffer + (head & ring->mask) * ring->elem_size, elem, ring->elem_size);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    // Only the producer updates the high-water mark, so a plain compare is enough
+    if (depth + 1 > atomic_load_explicit(&ring->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&ring->high_water, depth + 1, memory_order_relaxed);
+    }
+    return 0;
+}
+
+size_t spsc_ring_pop(SpscRing *ring, void *out, size_t max) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t count = head - tail;
+
+    if (count > max) {
+        count = max;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        memcpy((uint8_t *)out + i * ring->elem_size,
+               ring->buffer + ((tail + i) & ring->mask) * ring->elem_size, ring->elem_size);
+    }
+
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+    return count;
+}
+
+size_t spsc_ring_count(const SpscRing *ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return head - tail;
+}
+
+size_t spsc_ring_capacity(const SpscRing *ring) {
+    return ring->mask + 1;
+}
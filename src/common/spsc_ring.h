@@ -0,0 +1,37 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lock-free single-producer/single-consumer ring of fixed-size elements.
+// The storage is provided by the caller; capacity must be a power of two.
+// Exactly one thread may push and exactly one (other) thread may pop.
+
+#define SPSC_CACHE_LINE 64
+
+typedef struct {
+    _Alignas(SPSC_CACHE_LINE) atomic_size_t head;  // next slot to write (producer)
+    _Alignas(SPSC_CACHE_LINE) atomic_size_t tail;  // next slot to read (consumer)
+    _Alignas(SPSC_CACHE_LINE) uint8_t *buffer;
+    size_t elem_size;
+    size_t mask;
+    atomic_size_t high_water;                      // deepest the ring has been
+    atomic_uint full_count;                        // pushes rejected because the ring was full
+} SpscRing;
+
+// Returns 0 on success, -1 if capacity is not a power of two
+int spsc_ring_init(SpscRing *ring, void *buffer, size_t elem_size, size_t capacity);
+
+// Producer side: returns 0 on success, -1 if the ring is full
+int spsc_ring_push(SpscRing *ring, const void *elem);
+
+// Consumer side: pop up to max elements into out, returns the number popped
+size_t spsc_ring_pop(SpscRing *ring, void *out, size_t max);
+
+// Number of queued elements (exact from either end, approximate elsewhere)
+size_t spsc_ring_count(const SpscRing *ring);
+size_t spsc_ring_capacity(const SpscRing *ring);
+
+#endif // SPSC_RING_H
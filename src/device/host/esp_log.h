@@ -0,0 +1,22 @@
+/*
+ * 主机构建用的 ESP-IDF 日志替身（onekm_core.c 在 Linux 上编译时使用）
+ * E/W 总是输出到 stderr，I 在 -v 时输出，D/V 不输出（参数仍做类型检查）
+ */
+
+#ifndef ONEKM_HOST_ESP_LOG_H
+#define ONEKM_HOST_ESP_LOG_H
+
+#include <stdio.h>
+
+extern int onekm_host_verbose;
+
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) \
+    do { if (onekm_host_verbose) fprintf(stderr, "I (%s) " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, fmt, ...) \
+    do { if (0) fprintf(stderr, "D (%s) " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGV(tag, fmt, ...) \
+    do { if (0) fprintf(stderr, "V (%s) " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+
+#endif // ONEKM_HOST_ESP_LOG_H
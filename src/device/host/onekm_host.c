@@ -0,0 +1,862 @@
+/*
+ * OneKM 固件转发逻辑的 Linux 主机版本（onekm-dongle-sim）
+ *
+ * 与固件使用同一份 onekm_core.c，平台接口在这里用 pthread 实现：
+ * - 链路：创建 pty，服务器连接打印出的路径（onekm-server /dev/pts/N）
+ * - USB：模拟键盘、鼠标两个 HID IN 端点，主机每个轮询周期（-i）从每个端点各取走一份报告；
+ *   端点忙时提交失败，与 TinyUSB 的 tud_hid_n_report() 相同。
+ *   SIGUSR1 模拟拔出重插（总线复位）：端点中未取走的报告作废，与 tud_umount_cb/tud_mount_cb 相同
+ * - 报告流：每份提交成功的报告按 [接口标记][报告数据] 写入 -o 指定的文件
+ *   （标记 1 为 6KRO 键盘报告、2 为 8 位鼠标报告、3 为 16 位鼠标报告、4 为 NKRO 键盘报告
+ *   [修饰键][用法 0x00-0xDF 位图 28 字节]，X/Y 和滚轮小端；真实设备的报告不带报告 ID）。
+ *   默认模拟启用了滚轮分辨率倍率的主机：16 位鼠标报告，滚轮以 1/120 格计，键盘为 NKRO 位图；
+ *   --mouse8 模拟启动协议或 8 位备用描述符，滚轮以整格计；--keyboard6 模拟 6KRO 启动报告
+ * - --flood SEC：内部线程以最快速度向 pty 写入帧，统计每秒解码的消息数和产生的报告
+ * - --typing N：内部线程把 N 个字符的按下/松开报告成批塞进帧里一次写完，
+ *   检查键盘端点依次送出了每一份报告（一个都没有被合并掉），不一致时以状态 1 退出；
+ *   奇数帧改用 KEYBOARD_KEYS 发送同样的按下/松开，两种键盘消息进同一个 FIFO
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "common/protocol.h"
+#include "onekm_core.h"
+
+#define HOST_BOOT_BAUD_RATE 230400
+#define LINK_READ_SIZE 4096             // 与固件 UART 接收缓冲相同
+#define IDLE_TIMEOUT_MS 10              // 与固件 uart_read_bytes 超时相同
+#define ACK_QUEUE_LENGTH 64
+#define DEFAULT_POLL_INTERVAL_US 1000   // 全速 HID，bInterval 1
+#define DEFAULT_TICK_US 10000           // CONFIG_FREERTOS_HZ=100：vTaskDelay(1) 为 10 ms
+#define REPORT_TAG_KEYBOARD 1         // 报告流中区分接口的标记
+#define REPORT_TAG_MOUSE 2
+#define REPORT_TAG_MOUSE16 3
+#define REPORT_TAG_KEYBOARD_NKRO 4
+
+#define FLOOD_FRAMES 256                // 一轮恰好用完 8 位帧序号，可无缝重复
+#define FLOOD_MESSAGES_PER_FRAME 16
+#define FLOOD_KEYBOARD_EVERY 32         // 每 32 条消息中有一条键盘报告
+
+#define TYPING_CHARS_PER_FRAME 7        // 每帧 7 个字符（14 份键盘报告）加一份鼠标报告
+#define TYPING_TIMEOUT_MS 30000
+
+int onekm_host_verbose = 0;
+
+static volatile sig_atomic_t running = 1;
+// 接收循环已退出：HID 和 USB 线程要运行到此时，接收任务可能还在等交接队列
+static volatile sig_atomic_t receive_done = 0;
+// SIGUSR1：下一次接收循环模拟一次 USB 复位
+static volatile sig_atomic_t usb_reset_requested = 0;
+static int link_fd = -1;
+static unsigned int poll_interval_us = DEFAULT_POLL_INTERVAL_US;
+static unsigned int tick_us = DEFAULT_TICK_US;
+static FILE *report_file = NULL;
+static bool mouse_8bit = false;         // 8 位鼠标报告（启动协议或备用描述符）
+static bool keyboard_6kro = false;      // 6KRO 键盘报告（启动协议或备用描述符）
+
+// --typing：按提交顺序记录的键盘报告（启动格式）
+static HIDKeyboardReport *typed_reports = NULL;
+static size_t typed_count = 0;
+static size_t typed_capacity = 0;
+
+// HID 任务的二值信号量
+static pthread_mutex_t hid_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t hid_cond = PTHREAD_COND_INITIALIZER;
+static bool hid_pending = false;
+
+// ACK 队列
+static pthread_mutex_t ack_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ack_cond = PTHREAD_COND_INITIALIZER;
+static uint16_t ack_queue[ACK_QUEUE_LENGTH];
+static size_t ack_count = 0;
+
+// USB 端点（每个 HID 接口一个）
+static pthread_mutex_t usb_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool usb_busy[ONEKM_HID_COUNT];
+
+static struct {
+    uint64_t bytes_received;
+    uint64_t core_ns;           // onekm_core_receive() 占用的线程 CPU 时间
+    uint64_t reports_delivered;
+    uint64_t reports_discarded; // USB 复位时端点中作废的报告
+    uint64_t acks_sent;         // ACK 帧
+    uint32_t acks_dropped;
+    uint32_t baud_rate;
+} host_stats;
+
+static void handle_signal(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+static void handle_usb_reset_signal(int sig)
+{
+    (void)sig;
+    usb_reset_requested = 1;
+}
+
+static uint64_t clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_us(unsigned int us)
+{
+    struct timespec ts = {(time_t)(us / 1000000), (long)(us % 1000000) * 1000L};
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+/************* 平台接口 ***************/
+
+void onekm_port_notify_hid(void)
+{
+    pthread_mutex_lock(&hid_mutex);
+    hid_pending = true;
+    pthread_cond_signal(&hid_cond);
+    pthread_mutex_unlock(&hid_mutex);
+}
+
+void onekm_port_yield(void)
+{
+    sleep_us(tick_us);
+}
+
+// pty 没有波特率，只记录服务器要求的速率
+bool onekm_port_set_baud_rate(uint32_t baud_rate)
+{
+    host_stats.baud_rate = baud_rate;
+    return true;
+}
+
+void onekm_port_queue_ack(uint8_t seq, uint8_t flags)
+{
+    pthread_mutex_lock(&ack_mutex);
+    if (ack_count < ACK_QUEUE_LENGTH) {
+        ack_queue[ack_count++] = (uint16_t)(seq | (flags << 8));
+        pthread_cond_signal(&ack_cond);
+    } else {
+        host_stats.acks_dropped++;
+    }
+    pthread_mutex_unlock(&ack_mutex);
+}
+
+void onekm_port_set_led(bool on)
+{
+    if (onekm_host_verbose) {
+        fprintf(stderr, "LED %s\n", on ? "on" : "off");
+    }
+}
+
+// 主机取走端点中的报告
+static void complete_report(onekm_hid_itf_t itf)
+{
+    pthread_mutex_lock(&usb_mutex);
+    usb_busy[itf] = false;
+    host_stats.reports_delivered++;
+    pthread_mutex_unlock(&usb_mutex);
+    onekm_core_report_complete(itf);
+}
+
+// 总线复位：端点中的报告不会再被取走，也没有完成回调
+static void usb_reset(void)
+{
+    pthread_mutex_lock(&usb_mutex);
+    for (int itf = 0; itf < ONEKM_HID_COUNT; itf++) {
+        if (usb_busy[itf]) {
+            usb_busy[itf] = false;
+            host_stats.reports_discarded++;
+        }
+    }
+    pthread_mutex_unlock(&usb_mutex);
+    onekm_core_usb_reset();
+}
+
+static bool submit_report(onekm_hid_itf_t itf, const uint8_t *report, size_t len)
+{
+    pthread_mutex_lock(&usb_mutex);
+    if (usb_busy[itf]) {
+        pthread_mutex_unlock(&usb_mutex);
+        return false;
+    }
+    usb_busy[itf] = true;
+    if (report_file) {
+        fwrite(report, 1, len, report_file);
+    }
+    pthread_mutex_unlock(&usb_mutex);
+
+    if (poll_interval_us == 0) {
+        complete_report(itf);
+    }
+    return true;
+}
+
+bool onekm_port_keyboard_report(const onekm_key_bitmap_t *keys)
+{
+    HIDKeyboardReport boot;
+    bool ok;
+
+    onekm_core_boot_keyboard_report(keys, &boot);
+    if (keyboard_6kro) {
+        uint8_t report[1 + sizeof(boot)] = {REPORT_TAG_KEYBOARD};
+        memcpy(report + 1, &boot, sizeof(boot));
+        ok = submit_report(ONEKM_HID_KEYBOARD, report, sizeof(report));
+    } else {
+        uint8_t report[2 + ONEKM_KEY_MODIFIER_BYTE] = {REPORT_TAG_KEYBOARD_NKRO,
+                                                       keys->bytes[ONEKM_KEY_MODIFIER_BYTE]};
+        memcpy(report + 2, keys->bytes, ONEKM_KEY_MODIFIER_BYTE);
+        ok = submit_report(ONEKM_HID_KEYBOARD, report, sizeof(report));
+    }
+    if (!ok) {
+        return false;
+    }
+    // 只有 HID 任务提交报告，主线程在它退出后才读取
+    if (typed_count < typed_capacity) {
+        typed_reports[typed_count] = boot;
+    }
+    typed_count++;
+    return true;
+}
+
+void onekm_port_mouse_format(onekm_mouse_format_t *format)
+{
+    format->motion_limit = mouse_8bit ? 127 : 32767;
+    format->wheel_limit = format->motion_limit;
+    format->vertical_units = mouse_8bit ? 1 : WHEEL_HI_RES_UNITS;
+    format->horizontal_units = format->vertical_units;
+}
+
+bool onekm_port_mouse_report(uint8_t buttons, int16_t x, int16_t y, int16_t vertical, int16_t horizontal)
+{
+    if (mouse_8bit) {
+        uint8_t report[6] = {REPORT_TAG_MOUSE, buttons, (uint8_t)x, (uint8_t)y,
+                             (uint8_t)vertical, (uint8_t)horizontal};
+        return submit_report(ONEKM_HID_MOUSE, report, sizeof(report));
+    }
+    uint8_t report[10] = {REPORT_TAG_MOUSE16, buttons,
+                          (uint8_t)x, (uint8_t)((uint16_t)x >> 8),
+                          (uint8_t)y, (uint8_t)((uint16_t)y >> 8),
+                          (uint8_t)vertical, (uint8_t)((uint16_t)vertical >> 8),
+                          (uint8_t)horizontal, (uint8_t)((uint16_t)horizontal >> 8)};
+    return submit_report(ONEKM_HID_MOUSE, report, sizeof(report));
+}
+
+/************* 任务 ***************/
+
+static void *hid_send_task(void *arg)
+{
+    bool retry = false;
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&hid_mutex);
+        if (retry) {
+            // 提交失败：最多等一个调度周期后重试
+            uint64_t deadline = clock_ns(CLOCK_REALTIME) + (uint64_t)tick_us * 1000u;
+            struct timespec ts = {(time_t)(deadline / 1000000000ull), (long)(deadline % 1000000000ull)};
+            while (!hid_pending && !receive_done &&
+                   pthread_cond_timedwait(&hid_cond, &hid_mutex, &ts) != ETIMEDOUT) {
+            }
+        } else {
+            while (!hid_pending && !receive_done) {
+                pthread_cond_wait(&hid_cond, &hid_mutex);
+            }
+        }
+        hid_pending = false;
+        pthread_mutex_unlock(&hid_mutex);
+        if (receive_done) {
+            break;
+        }
+        retry = onekm_core_hid_send();
+    }
+    return NULL;
+}
+
+static void *ack_send_task(void *arg)
+{
+    uint16_t acks[ACK_QUEUE_LENGTH];
+    uint8_t frame[FRAME_MAX_ENCODED_SIZE];
+    (void)arg;
+
+    while (1) {
+        pthread_mutex_lock(&ack_mutex);
+        while (ack_count == 0 && running) {
+            pthread_cond_wait(&ack_cond, &ack_mutex);
+        }
+        size_t count = ack_count;
+        memcpy(acks, ack_queue, count * sizeof(uint16_t));
+        ack_count = 0;
+        pthread_mutex_unlock(&ack_mutex);
+        if (count == 0) {
+            break;
+        }
+
+        size_t done = 0;
+        while (done < count) {
+            size_t used;
+            size_t frame_len = onekm_core_pack_acks(acks + done, count - done, &used, frame, sizeof(frame));
+            // 对端未打开 pty 时丢弃
+            if (write(link_fd, frame, frame_len) < 0 && errno != EAGAIN && errno != EIO) {
+                perror("ack write failed");
+            }
+            host_stats.acks_sent++;
+            done += used;
+        }
+    }
+    return NULL;
+}
+
+// USB 主机按固定周期轮询每个端点
+static void *usb_host_task(void *arg)
+{
+    (void)arg;
+    uint64_t next = clock_ns(CLOCK_MONOTONIC);
+
+    while (!receive_done) {
+        next += (uint64_t)poll_interval_us * 1000u;
+        struct timespec ts = {(time_t)(next / 1000000000ull), (long)(next % 1000000000ull)};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+        for (int itf = 0; itf < ONEKM_HID_COUNT; itf++) {
+            pthread_mutex_lock(&usb_mutex);
+            bool busy = usb_busy[itf];
+            pthread_mutex_unlock(&usb_mutex);
+            if (busy) {
+                complete_report((onekm_hid_itf_t)itf);
+            }
+        }
+    }
+    return NULL;
+}
+
+/************* 压测 ***************/
+
+typedef struct {
+    const char *slave_path;
+    unsigned int seconds;
+    uint64_t bytes_sent;
+    uint64_t frames_sent;
+    uint64_t messages_sent;
+    uint64_t acks_received;
+    uint64_t hid_acks_received;
+    int last_ack_seq;           // 最近确认的帧序号，-1 表示尚未收到
+    FrameDecoder decoder;       // 解码回送的 ACK 帧
+} FloodContext;
+
+static int open_link_peer(const char *slave_path)
+{
+    struct termios tio;
+
+    int fd = open(slave_path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        perror("Failed to open pty");
+        return -1;
+    }
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+// 读取并统计可读的 ACK
+static void read_acks(int fd, FloodContext *ctx)
+{
+    uint8_t ack_buf[1024];
+
+    ssize_t n = read(fd, ack_buf, sizeof(ack_buf));
+    for (ssize_t i = 0; i < n; i++) {
+        uint8_t seq;
+        const uint8_t *payload;
+        size_t payload_len;
+        if (!frame_decoder_feed(&ctx->decoder, ack_buf[i], &seq, &payload, &payload_len)) {
+            continue;
+        }
+        size_t pos = 0;
+        Message msg;
+        int len;
+        while (pos < payload_len && (len = msg_decode(payload + pos, payload_len - pos, &msg)) > 0) {
+            pos += (size_t)len;
+            if (msg.type == MSG_ACK) {
+                ctx->acks_received++;
+                ctx->last_ack_seq = msg.data.ack.sequence;
+                if (msg.data.ack.flags & ACK_FLAG_HID_DELIVERED) {
+                    ctx->hid_acks_received++;
+                }
+            }
+        }
+    }
+}
+
+// 写完整段数据（pty 满时等待），期间读取 ACK
+static void write_all(int fd, const uint8_t *data, size_t len, FloodContext *ctx)
+{
+    while (len > 0 && running) {
+        struct pollfd pfd = {fd, POLLIN | POLLOUT, 0};
+        if (poll(&pfd, 1, 10) <= 0) {
+            continue;
+        }
+        if (pfd.revents & POLLIN) {
+            read_acks(fd, ctx);
+        }
+        if (pfd.revents & POLLOUT) {
+            ssize_t n = write(fd, data, len);
+            if (n > 0) {
+                ctx->bytes_sent += (uint64_t)n;
+                data += n;
+                len -= (size_t)n;
+            }
+        }
+    }
+}
+
+// 先切到 REMOTE 模式（序号 255，紧接着的帧从 0 开始）
+static void send_switch_remote(int fd, FloodContext *ctx)
+{
+    uint8_t payload[MSG_MAX_ENCODED_SIZE];
+    uint8_t frame[FRAME_MAX_ENCODED_SIZE];
+    Message msg;
+
+    msg_switch(&msg, CONTROL_REMOTE);
+    size_t len = msg_encode(&msg, PROTOCOL_V2, payload, sizeof(payload));
+    len = frame_encode(FLOOD_FRAMES - 1, payload, len, frame, sizeof(frame));
+    write_all(fd, frame, len, ctx);
+}
+
+static size_t build_flood_frames(uint8_t *out, size_t cap, uint32_t *messages_per_round)
+{
+    size_t len = 0;
+    uint32_t counter = 0;
+
+    for (int f = 0; f < FLOOD_FRAMES; f++) {
+        uint8_t payload[FRAME_MAX_PAYLOAD];
+        size_t payload_len = 0;
+        for (int m = 0; m < FLOOD_MESSAGES_PER_FRAME; m++, counter++) {
+            Message msg;
+            if (counter % FLOOD_KEYBOARD_EVERY == 0) {
+                HIDKeyboardReport report = {0};
+                if ((counter / FLOOD_KEYBOARD_EVERY) % 2 == 0) {
+                    report.keys[0] = (uint8_t)(0x04 + (counter / 64) % 26);   // a-z 按下，下一次松开
+                }
+                msg_keyboard_report(&msg, &report);
+            } else {
+                msg_mouse_report(&msg, 0, (int16_t)((int)(counter % 7) - 3), (int16_t)((int)(counter % 5) - 2), 0, 0);
+            }
+            payload_len += msg_encode(&msg, PROTOCOL_V2, payload + payload_len, sizeof(payload) - payload_len);
+        }
+        len += frame_encode((uint8_t)f, payload, payload_len, out + len, cap - len);
+    }
+    *messages_per_round = counter;
+    return len;
+}
+
+static void *flood_task(void *arg)
+{
+    FloodContext *ctx = arg;
+    static uint8_t round[FLOOD_FRAMES * FRAME_MAX_ENCODED_SIZE];
+    uint32_t messages_per_round;
+
+    int fd = open_link_peer(ctx->slave_path);
+    if (fd < 0) {
+        running = 0;
+        return NULL;
+    }
+
+    size_t round_len = build_flood_frames(round, sizeof(round), &messages_per_round);
+    size_t offset = 0;
+    uint64_t deadline = clock_ns(CLOCK_MONOTONIC) + (uint64_t)ctx->seconds * 1000000000ull;
+
+    send_switch_remote(fd, ctx);
+    ctx->bytes_sent = 0;
+
+    while (running && clock_ns(CLOCK_MONOTONIC) < deadline) {
+        struct pollfd pfd = {fd, POLLIN | POLLOUT, 0};
+        if (poll(&pfd, 1, 10) <= 0) {
+            continue;
+        }
+        if (pfd.revents & POLLIN) {
+            read_acks(fd, ctx);
+        }
+        if (pfd.revents & POLLOUT) {
+            ssize_t n = write(fd, round + offset, round_len - offset);
+            if (n > 0) {
+                ctx->bytes_sent += (uint64_t)n;
+                offset += (size_t)n;
+                if (offset == round_len) {
+                    offset = 0;
+                    ctx->frames_sent += FLOOD_FRAMES;
+                    ctx->messages_sent += messages_per_round;
+                }
+            }
+        }
+    }
+
+    // 等接收端处理完 pty 中剩余的数据
+    sleep_us(100000);
+    running = 0;
+    close(fd);
+    return NULL;
+}
+
+/************* 连续击键检查 ***************/
+
+// 第 i 个字符的键码：a-z 循环，相邻字符可能相同（按下之间隔着一次松开）
+static uint8_t typing_keycode(size_t i)
+{
+    return (uint8_t)(0x04 + (i * 7 + i / 26) % 26);
+}
+
+// 所有字符的按下/松开报告，每帧 TYPING_CHARS_PER_FRAME 个字符，一次写完，
+// 然后等最后一帧被确认（确认表示它的键盘报告都已提交并被取走）
+static void *typing_task(void *arg)
+{
+    FloodContext *ctx = arg;
+    size_t chars = typed_capacity / 2;
+    size_t frames = (chars + TYPING_CHARS_PER_FRAME - 1) / TYPING_CHARS_PER_FRAME;
+    uint8_t *burst = malloc(frames * FRAME_MAX_ENCODED_SIZE);
+    size_t len = 0;
+
+    int fd = burst ? open_link_peer(ctx->slave_path) : -1;
+    if (fd < 0) {
+        free(burst);
+        running = 0;
+        return NULL;
+    }
+
+    for (size_t f = 0; f < frames; f++) {
+        uint8_t payload[FRAME_MAX_PAYLOAD];
+        size_t payload_len = 0;
+        Message msg;
+
+        for (size_t c = f * TYPING_CHARS_PER_FRAME; c < chars && c < (f + 1) * TYPING_CHARS_PER_FRAME; c++) {
+            HIDKeyboardReport report = {0};
+            report.keys[0] = typing_keycode(c);
+            if (f % 2) {
+                msg_keyboard_keys(&msg, report.keys[0], 1);
+            } else {
+                msg_keyboard_report(&msg, &report);
+            }
+            payload_len += msg_encode(&msg, PROTOCOL_V2, payload + payload_len, sizeof(payload) - payload_len);
+            if (f % 2) {
+                msg_keyboard_keys(&msg, report.keys[0], 0);
+            } else {
+                report.keys[0] = 0;
+                msg_keyboard_report(&msg, &report);
+            }
+            payload_len += msg_encode(&msg, PROTOCOL_V2, payload + payload_len, sizeof(payload) - payload_len);
+            ctx->messages_sent += 2;
+        }
+        // 鼠标移动照常合并，不受排队的键盘报告影响
+        msg_mouse_report(&msg, 0, 1, -1, 0, 0);
+        payload_len += msg_encode(&msg, PROTOCOL_V2, payload + payload_len, sizeof(payload) - payload_len);
+        ctx->messages_sent++;
+        len += frame_encode((uint8_t)f, payload, payload_len, burst + len, frames * FRAME_MAX_ENCODED_SIZE - len);
+    }
+
+    send_switch_remote(fd, ctx);
+    write_all(fd, burst, len, ctx);
+    ctx->frames_sent = frames;
+
+    uint8_t last_seq = (uint8_t)(frames - 1);
+    uint64_t deadline = clock_ns(CLOCK_MONOTONIC) + (uint64_t)TYPING_TIMEOUT_MS * 1000000ull;
+    while (running && ctx->last_ack_seq != last_seq && clock_ns(CLOCK_MONOTONIC) < deadline) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, 10) > 0 && (pfd.revents & POLLIN)) {
+            read_acks(fd, ctx);
+        }
+    }
+    if (ctx->last_ack_seq != last_seq) {
+        fprintf(stderr, "Typing: no ack for the last frame within %d ms\n", TYPING_TIMEOUT_MS);
+    }
+
+    running = 0;
+    close(fd);
+    free(burst);
+    return NULL;
+}
+
+// 报告流必须恰好是每个字符的按下和松开，按顺序一份不少
+static bool check_typing(size_t chars)
+{
+    size_t expected = chars * 2;
+    size_t mismatches = 0;
+
+    for (size_t i = 0; i < typed_count && i < expected; i++) {
+        uint8_t key = (i % 2 == 0) ? typing_keycode(i / 2) : 0;
+        const HIDKeyboardReport *r = &typed_reports[i];
+        if (r->modifiers != 0 || r->keys[0] != key || r->keys[1] != 0) {
+            if (mismatches++ == 0) {
+                fprintf(stderr, "Typing: report %zu has key 0x%02X, expected 0x%02X\n", i, r->keys[0], key);
+            }
+        }
+    }
+    printf("Typing:   %zu characters, %zu of %zu keyboard reports delivered, %zu out of order\n",
+           chars, typed_count, expected, mismatches);
+    return typed_count == expected && mismatches == 0;
+}
+
+/************* 主程序 ***************/
+
+static int open_pty(void)
+{
+    struct termios tio;
+
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+        perror("Failed to create pty");
+        return -1;
+    }
+    // 主端也设为 raw，收发的字节不做任何转换
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+static void print_usage(const char *prog)
+{
+    printf("Usage: %s [options]\n", prog);
+    printf("Runs the dongle firmware's forwarding core on a pty\n");
+    printf("  -o, --output FILE         Write the HID report stream to FILE\n");
+    printf("  -i, --poll-interval USEC  USB host poll interval (default %d, 0 = take reports at once)\n",
+           DEFAULT_POLL_INTERVAL_US);
+    printf("  -t, --tick USEC           FreeRTOS tick for vTaskDelay(1) (default %d)\n", DEFAULT_TICK_US);
+    printf("  -8, --mouse8              Send 8-bit mouse reports with whole-detent wheels\n"
+           "                            (boot protocol / fallback descriptor)\n");
+    printf("  -6, --keyboard6           Send 6-key boot keyboard reports instead of the NKRO bitmap\n");
+    printf("  -f, --flood SEC           Benchmark: flood the core with frames for SEC seconds\n");
+    printf("  -k, --typing N            Check: type N characters in one burst, verify every report\n");
+    printf("  -v, --verbose             Print the firmware's info logs\n");
+    printf("  -h, --help                Show this help\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output_path = NULL;
+    unsigned int flood_seconds = 0;
+    unsigned int typing_chars = 0;
+
+    static const struct option long_options[] = {
+        {"output", required_argument, NULL, 'o'},
+        {"poll-interval", required_argument, NULL, 'i'},
+        {"tick", required_argument, NULL, 't'},
+        {"mouse8", no_argument, NULL, '8'},
+        {"keyboard6", no_argument, NULL, '6'},
+        {"flood", required_argument, NULL, 'f'},
+        {"typing", required_argument, NULL, 'k'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:i:t:86f:k:vh", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'o':
+                output_path = optarg;
+                break;
+            case 'i':
+                poll_interval_us = (unsigned int)atoi(optarg);
+                break;
+            case 't':
+                tick_us = (unsigned int)atoi(optarg);
+                break;
+            case '8':
+                mouse_8bit = true;
+                break;
+            case '6':
+                keyboard_6kro = true;
+                break;
+            case 'f':
+                flood_seconds = (unsigned int)atoi(optarg);
+                if (flood_seconds == 0) {
+                    fprintf(stderr, "Invalid flood duration %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'k':
+                typing_chars = (unsigned int)atoi(optarg);
+                // 帧序号 8 位，一次突发不超过 255 帧
+                if (typing_chars == 0 || typing_chars > 255 * TYPING_CHARS_PER_FRAME) {
+                    fprintf(stderr, "Invalid character count %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'v':
+                onekm_host_verbose = 1;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (output_path) {
+        report_file = fopen(output_path, "wb");
+        if (!report_file) {
+            fprintf(stderr, "Failed to create %s: %s\n", output_path, strerror(errno));
+            return 1;
+        }
+    }
+
+    if (flood_seconds && typing_chars) {
+        fprintf(stderr, "--flood and --typing cannot be combined\n");
+        return 1;
+    }
+    if (typing_chars) {
+        typed_capacity = (size_t)typing_chars * 2;
+        typed_reports = calloc(typed_capacity, sizeof(HIDKeyboardReport));
+        if (!typed_reports) {
+            perror("calloc");
+            return 1;
+        }
+    }
+
+    link_fd = open_pty();
+    if (link_fd < 0) {
+        return 1;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    signal(SIGUSR1, handle_usb_reset_signal);
+
+    onekm_core_init(HOST_BOOT_BAUD_RATE);
+    host_stats.baud_rate = HOST_BOOT_BAUD_RATE;
+
+    pthread_t hid_thread, ack_thread, usb_thread, flood_thread;
+    pthread_create(&hid_thread, NULL, hid_send_task, NULL);
+    pthread_create(&ack_thread, NULL, ack_send_task, NULL);
+    if (poll_interval_us > 0) {
+        pthread_create(&usb_thread, NULL, usb_host_task, NULL);
+    }
+
+    FloodContext flood = {.slave_path = ptsname(link_fd), .seconds = flood_seconds, .last_ack_seq = -1};
+    frame_decoder_init(&flood.decoder);
+    if (typing_chars) {
+        printf("Typing %u characters in one burst (USB poll %u us)\n", typing_chars, poll_interval_us);
+        pthread_create(&flood_thread, NULL, typing_task, &flood);
+    } else if (flood_seconds) {
+        printf("Flooding for %u s (%d messages per frame, USB poll %u us)\n",
+               flood_seconds, FLOOD_MESSAGES_PER_FRAME, poll_interval_us);
+        pthread_create(&flood_thread, NULL, flood_task, &flood);
+    } else {
+        printf("Dongle core on %s (USB poll every %u us)\n", ptsname(link_fd), poll_interval_us);
+        printf("Run: onekm-server %s\n", ptsname(link_fd));
+    }
+    fflush(stdout);
+
+    uint64_t start = clock_ns(CLOCK_MONOTONIC);
+    uint8_t data[LINK_READ_SIZE];
+
+    while (running) {
+        if (usb_reset_requested) {
+            usb_reset_requested = 0;
+            usb_reset();
+        }
+        struct pollfd pfd = {link_fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, IDLE_TIMEOUT_MS);
+        if (ready < 0 && errno != EINTR) {
+            perror("poll failed");
+            break;
+        }
+        if (ready > 0 && (pfd.revents & POLLIN)) {
+            ssize_t len = read(link_fd, data, sizeof(data));
+            if (len > 0) {
+                uint64_t cpu_start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+                onekm_core_receive(data, (size_t)len);
+                host_stats.core_ns += clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+                host_stats.bytes_received += (uint64_t)len;
+                continue;
+            }
+        } else if (ready > 0) {
+            // 对端尚未打开 pty（POLLHUP），避免空转
+            sleep_us(IDLE_TIMEOUT_MS * 1000);
+        }
+        onekm_core_idle();
+    }
+    double elapsed = (double)(clock_ns(CLOCK_MONOTONIC) - start) / 1e9;
+
+    running = 0;
+    receive_done = 1;
+    if (flood_seconds || typing_chars) {
+        pthread_join(flood_thread, NULL);
+    }
+    pthread_mutex_lock(&hid_mutex);
+    pthread_cond_broadcast(&hid_cond);
+    pthread_mutex_unlock(&hid_mutex);
+    pthread_mutex_lock(&ack_mutex);
+    pthread_cond_broadcast(&ack_cond);
+    pthread_mutex_unlock(&ack_mutex);
+    pthread_join(hid_thread, NULL);
+    pthread_join(ack_thread, NULL);
+    if (poll_interval_us > 0) {
+        pthread_join(usb_thread, NULL);
+    }
+
+    onekm_core_stats_t stats;
+    onekm_core_get_stats(&stats);
+
+    if (flood_seconds) {
+        elapsed = flood_seconds;
+        printf("Sent:     %llu frames, %llu messages, %.1f MB\n",
+               (unsigned long long)flood.frames_sent, (unsigned long long)flood.messages_sent,
+               (double)flood.bytes_sent / 1e6);
+    }
+    printf("Decoded:  %lu messages in %.2f s, %.0f messages/s, %.1f MB/s "
+           "(%.1f Mbaud of 8N1 UART)\n",
+           (unsigned long)stats.messages, elapsed, stats.messages / elapsed,
+           (double)host_stats.bytes_received / elapsed / 1e6,
+           (double)host_stats.bytes_received * 10.0 / elapsed / 1e6);
+    printf("Core:     %.0f ns CPU per message on the receive path\n",
+           stats.messages ? (double)host_stats.core_ns / stats.messages : 0.0);
+    printf("Reports:  %lu keyboard, %lu mouse submitted, %lu rejected, "
+           "%llu taken by the host, %llu discarded by %lu USB resets\n",
+           (unsigned long)stats.keyboard_reports, (unsigned long)stats.mouse_reports,
+           (unsigned long)stats.reports_rejected, (unsigned long long)host_stats.reports_delivered,
+           (unsigned long long)host_stats.reports_discarded, (unsigned long)stats.usb_resets);
+    printf("Keyboard: %lu repeated reports collapsed, FIFO full %lu times\n",
+           (unsigned long)stats.keyboard_collapsed, (unsigned long)stats.keyboard_fifo_full);
+    printf("Handoff:  deepest %lu messages, receive task waited %lu times (queue full)\n",
+           (unsigned long)stats.handoff_high_water, (unsigned long)stats.handoff_waits);
+    printf("Acks:     %llu frames sent, %lu dropped (queue full)",
+           (unsigned long long)host_stats.acks_sent, (unsigned long)host_stats.acks_dropped);
+    if (flood_seconds || typing_chars) {
+        printf(", %llu acks received (%llu HID delivered)",
+               (unsigned long long)flood.acks_received, (unsigned long long)flood.hid_acks_received);
+    }
+    printf("\n");
+    printf("Link:     frames ok %lu, crc %lu, format %lu, lost %lu, baud %lu\n",
+           (unsigned long)stats.link.frames, (unsigned long)stats.link.crc_errors,
+           (unsigned long)stats.link.format_errors, (unsigned long)stats.link.seq_gaps,
+           (unsigned long)host_stats.baud_rate);
+
+    bool ok = true;
+    if (typing_chars) {
+        ok = check_typing(typing_chars);
+        free(typed_reports);
+    }
+
+    if (report_file) {
+        fclose(report_file);
+    }
+    close(link_fd);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+/*
+ * 主机构建用的 TinyUSB 配置替身（usb-descriptors 测试只用 TinyUSB 的描述符宏）
+ * 与 ESP-IDF 的 esp_tinyusb 配置一致：ESP32-S3 全速设备，两个 HID 接口
+ */
+
+#ifndef ONEKM_HOST_TUSB_CONFIG_H
+#define ONEKM_HOST_TUSB_CONFIG_H
+
+#define CFG_TUSB_MCU OPT_MCU_ESP32S3
+#define CFG_TUD_ENABLED 1
+#define CFG_TUD_HID 2
+
+#endif // ONEKM_HOST_TUSB_CONFIG_H
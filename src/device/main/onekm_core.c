@@ -0,0 +1,672 @@
+/*
+ * OneKM 转发核心：帧解码、状态累积、HID 报告生成（与平台无关，见 onekm_core.h）
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+#include "esp_log.h"
+#include "common/spsc_ring.h"
+#include "onekm_core.h"
+
+#define TAG "onekm"
+
+// 接收任务 -> HID 任务的交接队列（SPSC，无锁）：按到达顺序传递 HID 消息和帧结束标记
+#define HANDOFF_CAPACITY 128
+
+enum {
+    HANDOFF_MESSAGE,    // 一条鼠标/键盘/SWITCH 消息
+    HANDOFF_FRAME_END,  // 帧 seq 的 HID 消息到此为止，报告被取走后确认
+};
+
+typedef struct {
+    uint8_t kind;
+    uint8_t seq;
+    Message msg;
+} handoff_t;
+
+static SpscRing handoff;
+static handoff_t handoff_storage[HANDOFF_CAPACITY];
+
+// 以下 HID 状态只由 HID 任务访问，不需要加锁
+
+typedef struct {
+    int32_t x;              // X 位移（累积值，每份报告最多送出 motion_limit）
+    int32_t y;              // Y 位移（累积值）
+    int32_t vertical_wheel;  // 垂直滚动（累积值，单位 1/WHEEL_HI_RES_UNITS 格）
+    int32_t horizontal_wheel; // 水平滚动（累积值）
+    uint8_t buttons;        // 按键位掩码 (bit0=左, bit1=右, bit2=中)
+    bool changed;           // 有尚未提交的变化
+} mouse_state_t;
+
+static mouse_state_t mouse_state = {0};
+
+// 键盘报告按到达顺序排队，每次端点空闲提交一份，不像鼠标那样合并：
+// 两次提交之间到达的按下/松开报告都会依次发出，快速击键不会丢失。
+// 队列里是每条键盘消息应用后的键位图快照
+#define KEYBOARD_FIFO_LENGTH 32     // 2 的幂，计数器回绕时下标仍连续
+
+static onekm_key_bitmap_t keyboard_fifo[KEYBOARD_FIFO_LENGTH];
+static uint32_t keyboard_queued;        // 入队的报告总数
+static uint32_t keyboard_sent;          // 已提交的报告总数
+static onekm_key_bitmap_t keyboard_last; // 当前键位图（即最近入队的报告），没有变化的消息不再入队
+// 从交接队列取出、但因键盘 FIFO 满而暂存的事件（后面的消息保持顺序）
+static handoff_t held_event;
+static bool have_held_event = false;
+
+// 端点状态：提交成功后置忙，主机取走后（onekm_core_report_complete）空闲
+static bool itf_busy[ONEKM_HID_COUNT];
+// USB 任务置位、HID 任务取走的已完成接口（1 << onekm_hid_itf_t）
+static atomic_uint completed_itfs;
+// USB 总线复位/断开后置位，HID 任务据此丢弃端点状态（onekm_core_usb_reset）
+static atomic_bool usb_reset_pending;
+
+// 控制状态（LOCAL/REMOTE）
+static volatile bool is_remote_mode = false;
+
+// 帧确认（v2）：每个帧处理完后回送 ACK；产生 HID 报告的帧等主机取走报告后再确认。
+// 同一时间只跟踪一个帧：wait_submit 中的接口提交了包含它的报告、wait_complete 中的
+// 报告都被取走后确认（也涵盖之前的帧）；跟踪期间到达的帧只记住最新的一个，随后接着跟踪
+static int16_t wait_ack_seq = -1;          // 正在跟踪的帧，-1 表示无
+static uint8_t wait_submit;                // 还有未提交变化的接口（1 << onekm_hid_itf_t）
+static uint8_t wait_complete;              // 已提交、尚未被取走的接口
+static uint32_t wait_keyboard_until;       // 键盘报告提交到此计数时，该帧的键盘报告都已提交
+static bool wait_hid;                      // 该帧的变化是否经过 USB 报告
+static uint8_t hid_ack_seq;                // 跟踪期间最近一个应用完的帧
+static bool hid_ack_pending = false;
+
+static onekm_core_stats_t stats;
+
+// 接收任务状态
+static FrameDecoder decoder;
+static uint32_t boot_baud_rate;
+static uint32_t link_baud_rate;     // 当前链路波特率
+static uint32_t bad_frames;         // 自上一个有效帧以来的坏帧数
+static uint32_t reported_tests;
+static FrameStats logged_stats;     // 上次汇报时的帧错误统计
+
+void onekm_core_init(uint32_t baud_rate)
+{
+    spsc_ring_init(&handoff, handoff_storage, sizeof(handoff_t), HANDOFF_CAPACITY);
+    memset(&mouse_state, 0, sizeof(mouse_state));
+    memset(&keyboard_last, 0, sizeof(keyboard_last));
+    keyboard_queued = 0;
+    keyboard_sent = 0;
+    memset(itf_busy, 0, sizeof(itf_busy));
+    atomic_store(&completed_itfs, 0);
+    atomic_store(&usb_reset_pending, false);
+    have_held_event = false;
+    memset(&stats, 0, sizeof(stats));
+    memset(&logged_stats, 0, sizeof(logged_stats));
+    is_remote_mode = false;
+    hid_ack_pending = false;
+    wait_ack_seq = -1;
+    frame_decoder_init(&decoder);
+    boot_baud_rate = baud_rate;
+    link_baud_rate = baud_rate;
+    bad_frames = 0;
+    reported_tests = 0;
+}
+
+bool onekm_core_is_remote(void)
+{
+    return is_remote_mode;
+}
+
+void onekm_core_set_remote(bool remote)
+{
+    is_remote_mode = remote;
+}
+
+// 主机已取走某个接口的报告：记下后唤醒 HID 任务，由它提交该接口的下一份报告
+void onekm_core_report_complete(onekm_hid_itf_t itf)
+{
+    atomic_fetch_or_explicit(&completed_itfs, 1u << itf, memory_order_release);
+    onekm_port_notify_hid();
+}
+
+// USB 复位/断开/重新枚举：端点里的报告不会再被取走，也不会再有完成回调。
+// 记下后唤醒 HID 任务，由它清除端点忙状态和帧确认的等待
+void onekm_core_usb_reset(void)
+{
+    atomic_store_explicit(&usb_reset_pending, true, memory_order_release);
+    onekm_port_notify_hid();
+}
+
+/************* 消息处理 ***************/
+
+static void key_bitmap_set(onekm_key_bitmap_t *keys, uint8_t usage, bool pressed)
+{
+    if (pressed) {
+        keys->bytes[usage / 8] |= (uint8_t)(1u << (usage % 8));
+    } else {
+        keys->bytes[usage / 8] &= (uint8_t)~(1u << (usage % 8));
+    }
+}
+
+// KEYBOARD_REPORT 是完整的 6KRO 状态，替换整个键位图；KEYBOARD_KEYS 只改其中变化的键
+static void queue_keyboard_message(const Message *msg)
+{
+    onekm_key_bitmap_t keys;
+
+    if (msg->type == MSG_KEYBOARD_REPORT) {
+        memset(&keys, 0, sizeof(keys));
+        keys.bytes[ONEKM_KEY_MODIFIER_BYTE] = msg->data.keyboard.modifiers;
+        for (int i = 0; i < 6; i++) {
+            if (msg->data.keyboard.keys[i] != 0) {
+                key_bitmap_set(&keys, msg->data.keyboard.keys[i], true);
+            }
+        }
+        ESP_LOGD(TAG, "Keyboard report: mod=0x%02X, keys=%d,%d,%d,%d,%d,%d",
+                 msg->data.keyboard.modifiers,
+                 msg->data.keyboard.keys[0], msg->data.keyboard.keys[1],
+                 msg->data.keyboard.keys[2], msg->data.keyboard.keys[3],
+                 msg->data.keyboard.keys[4], msg->data.keyboard.keys[5]);
+    } else {
+        keys = keyboard_last;
+        for (int i = 0; i < msg->data.keyboard_keys.count && i < KEYBOARD_KEYS_MAX; i++) {
+            key_bitmap_set(&keys, msg->data.keyboard_keys.usages[i],
+                           (msg->data.keyboard_keys.pressed >> i) & 1);
+        }
+        ESP_LOGD(TAG, "Keyboard keys: %d changed, first 0x%02X %s", msg->data.keyboard_keys.count,
+                 msg->data.keyboard_keys.usages[0],
+                 (msg->data.keyboard_keys.pressed & 1) ? "down" : "up");
+    }
+
+    if (memcmp(&keyboard_last, &keys, sizeof(keys)) == 0) {
+        stats.keyboard_collapsed++;
+        return;
+    }
+    keyboard_last = keys;
+    keyboard_fifo[keyboard_queued % KEYBOARD_FIFO_LENGTH] = keys;
+    keyboard_queued++;
+}
+
+// HID 任务：把接收任务交来的消息应用到鼠标/键盘状态
+static void apply_hid_message(const Message *msg)
+{
+    switch (msg->type) {
+        case MSG_MOUSE_MOVE:
+            // 累积鼠标移动（32 位累积，不会溢出）
+            mouse_state.x += msg->data.mouse_move.dx;
+            mouse_state.y += msg->data.mouse_move.dy;
+            mouse_state.changed = true;
+            ESP_LOGD(TAG, "Mouse move: dx=%d, dy=%d, accumulated: x=%ld, y=%ld",
+                     msg->data.mouse_move.dx, msg->data.mouse_move.dy,
+                     (long)mouse_state.x, (long)mouse_state.y);
+            break;
+
+        case MSG_MOUSE_BUTTON:
+            if (msg->data.mouse_button.state) {
+                mouse_state.buttons |= (1 << (msg->data.mouse_button.button - 1));
+            } else {
+                mouse_state.buttons &= ~(1 << (msg->data.mouse_button.button - 1));
+            }
+            mouse_state.changed = true;
+            ESP_LOGD(TAG, "Mouse button: button=%d, state=%d",
+                     msg->data.mouse_button.button, msg->data.mouse_button.state);
+            break;
+
+        case MSG_MOUSE_WHEEL:
+            // 整格滚动，换算成高分辨率单位累积
+            mouse_state.vertical_wheel += msg->data.mouse_wheel.vertical * WHEEL_HI_RES_UNITS;
+            mouse_state.horizontal_wheel += msg->data.mouse_wheel.horizontal * WHEEL_HI_RES_UNITS;
+            mouse_state.changed = true;
+            ESP_LOGI(TAG, "[RECV] MOUSE_WHEEL vertical=%d, horizontal=%d, accumulated: v=%ld, h=%ld",
+                     msg->data.mouse_wheel.vertical, msg->data.mouse_wheel.horizontal,
+                     (long)mouse_state.vertical_wheel, (long)mouse_state.horizontal_wheel);
+            break;
+
+        case MSG_MOUSE_SCROLL:
+            mouse_state.vertical_wheel += msg->data.mouse_scroll.vertical;
+            mouse_state.horizontal_wheel += msg->data.mouse_scroll.horizontal;
+            mouse_state.changed = true;
+            ESP_LOGD(TAG, "Mouse scroll: v=%d, h=%d (1/%d detent), accumulated: v=%ld, h=%ld",
+                     msg->data.mouse_scroll.vertical, msg->data.mouse_scroll.horizontal,
+                     WHEEL_HI_RES_UNITS, (long)mouse_state.vertical_wheel,
+                     (long)mouse_state.horizontal_wheel);
+            break;
+
+        case MSG_MOUSE_REPORT:
+            // 一条消息携带一帧的全部鼠标状态：按键掩码直接覆盖，位移和滚轮累积
+            mouse_state.buttons = msg->data.mouse_report.buttons;
+            mouse_state.x += msg->data.mouse_report.dx;
+            mouse_state.y += msg->data.mouse_report.dy;
+            mouse_state.vertical_wheel += msg->data.mouse_report.vertical * WHEEL_HI_RES_UNITS;
+            mouse_state.horizontal_wheel += msg->data.mouse_report.horizontal * WHEEL_HI_RES_UNITS;
+            mouse_state.changed = true;
+            ESP_LOGD(TAG, "Mouse report: buttons=0x%02X, dx=%d, dy=%d, v=%d, h=%d",
+                     msg->data.mouse_report.buttons, msg->data.mouse_report.dx,
+                     msg->data.mouse_report.dy, msg->data.mouse_report.vertical,
+                     msg->data.mouse_report.horizontal);
+            break;
+
+        case MSG_KEYBOARD_REPORT:
+        case MSG_KEYBOARD_KEYS:
+            // 入队（调用者保证 FIFO 有空位）；键位图没有变化的消息对主机没有意义，只计数
+            queue_keyboard_message(msg);
+            break;
+
+        case MSG_SWITCH:
+            // 重置鼠标状态（清除累积的移动数据）
+            mouse_state.x = 0;
+            mouse_state.y = 0;
+            mouse_state.vertical_wheel = 0;
+            mouse_state.horizontal_wheel = 0;
+            mouse_state.changed = false;
+            break;
+
+        default:
+            break;
+    }
+}
+
+/************* 交接 ***************/
+
+// 接收任务：把一项交给 HID 任务。队列满说明 HID 任务落后，
+// 唤醒它并等待（背压留在 UART 接收缓冲里，消息不丢）
+static void handoff_push(const handoff_t *item)
+{
+    while (spsc_ring_push(&handoff, item) != 0) {
+        stats.handoff_waits++;
+        onekm_port_notify_hid();
+        onekm_port_yield();
+    }
+}
+
+// 协议定义与 Linux 服务器共用 src/common/protocol.h，支持 v1（固定 9 字节）和 v2（变长）
+// 鼠标/键盘消息按顺序交给 HID 任务；返回 true 表示 HID 状态会变化，
+// 由调用者在整帧处理完后写入帧结束标记并唤醒 HID 任务
+static bool route_message(const Message *msg)
+{
+    handoff_t item = {.kind = HANDOFF_MESSAGE, .msg = *msg};
+
+    switch (msg->type) {
+        case MSG_MOUSE_MOVE:
+        case MSG_MOUSE_BUTTON:
+        case MSG_MOUSE_WHEEL:
+        case MSG_MOUSE_REPORT:
+        case MSG_MOUSE_SCROLL:
+        case MSG_KEYBOARD_REPORT:
+        case MSG_KEYBOARD_KEYS:
+            handoff_push(&item);
+            return true;
+
+        case MSG_SWITCH:
+            is_remote_mode = (msg->data.control.state == 1);
+            ESP_LOGI(TAG, "Mode switched: %s", is_remote_mode ? "REMOTE" : "LOCAL");
+            // HID 任务按顺序清除此前累积的鼠标移动
+            handoff_push(&item);
+            // LED 指示
+            onekm_port_set_led(is_remote_mode);
+            return false;
+
+        case MSG_LINK_TEST:
+            // 链路测试帧只计数，由 onekm_core_idle 定期汇报
+            stats.link_test_messages++;
+            return false;
+
+        default:
+            ESP_LOGW(TAG, "Unknown message type: %d", msg->type);
+            return false;
+    }
+}
+
+/************* 接收 ***************/
+
+static void log_link_errors(const FrameStats *current)
+{
+    if (current->crc_errors != logged_stats.crc_errors ||
+        current->format_errors != logged_stats.format_errors ||
+        current->seq_gaps != logged_stats.seq_gaps) {
+        ESP_LOGW(TAG, "Link errors: crc=%lu format=%lu lost=%lu (frames ok=%lu)",
+                 (unsigned long)current->crc_errors, (unsigned long)current->format_errors,
+                 (unsigned long)current->seq_gaps, (unsigned long)current->frames);
+    }
+    logged_stats = *current;
+}
+
+// 切换链路波特率：先等本端发送完成，再修改速率并清空接收缓冲，
+// 新速率下的第一帧序号不与旧速率下的序号比较
+static void set_link_baud_rate(uint32_t baud_rate)
+{
+    if (!onekm_port_set_baud_rate(baud_rate)) {
+        ESP_LOGW(TAG, "Unsupported link baud rate %lu", (unsigned long)baud_rate);
+        return;
+    }
+    decoder.len = 0;
+    decoder.overflow = 0;
+    decoder.have_seq = 0;
+    link_baud_rate = baud_rate;
+    ESP_LOGI(TAG, "Link baud rate set to %lu", (unsigned long)baud_rate);
+}
+
+void onekm_core_receive(const uint8_t *data, size_t len)
+{
+    Message msg;
+
+    // 按帧解码：0x00 为帧分隔符，损坏的帧被 CRC 丢弃，在下一个分隔符处重新同步
+    for (size_t i = 0; i < len; i++) {
+        uint8_t seq;
+        const uint8_t *payload;
+        size_t payload_len;
+
+        uint32_t errors = decoder.stats.crc_errors + decoder.stats.format_errors;
+        if (!frame_decoder_feed(&decoder, data[i], &seq, &payload, &payload_len)) {
+            // 连续坏帧说明两端速率不一致（例如服务器重启后以上电速率重连），退回上电速率
+            if (decoder.stats.crc_errors + decoder.stats.format_errors != errors &&
+                ++bad_frames >= LINK_FALLBACK_BAD_FRAMES) {
+                bad_frames = 0;
+                if (link_baud_rate != boot_baud_rate) {
+                    set_link_baud_rate(boot_baud_rate);
+                    break;
+                }
+            }
+            continue;
+        }
+        bad_frames = 0;
+
+        // 帧内可包含多条消息，按顺序处理，整帧处理完后只唤醒一次 HID 任务
+        size_t pos = 0;
+        bool hid_changed = false;
+        bool baud_changed = false;
+        while (pos < payload_len) {
+            int n = msg_decode(payload + pos, payload_len - pos, &msg);
+            if (n <= 0) {
+                ESP_LOGW(TAG, "Malformed message in frame %u", seq);
+                break;
+            }
+            pos += (size_t)n;
+            stats.messages++;
+            if (msg.type == MSG_LINK_CONFIG) {
+                // 本批剩余数据按旧速率接收，切换后丢弃
+                set_link_baud_rate(msg.data.link_config.baud_rate);
+                baud_changed = true;
+                break;
+            }
+            hid_changed |= route_message(&msg);
+        }
+        if (hid_changed) {
+            handoff_t end = {.kind = HANDOFF_FRAME_END, .seq = seq};
+            handoff_push(&end);
+            onekm_port_notify_hid();
+        } else if (!baud_changed) {
+            // 没有 HID 输出的帧（如 SWITCH）处理完即确认；切换波特率的帧不确认
+            onekm_port_queue_ack(seq, 0);
+        }
+        if (baud_changed) {
+            break;
+        }
+    }
+
+    if (len > 0) {
+        log_link_errors(&decoder.stats);
+    }
+}
+
+void onekm_core_idle(void)
+{
+    if (stats.link_test_messages != reported_tests) {
+        // 空闲时汇报链路测试结果
+        ESP_LOGI(TAG, "Link test: %lu messages, frames ok=%lu crc=%lu format=%lu lost=%lu",
+                 (unsigned long)(stats.link_test_messages - reported_tests),
+                 (unsigned long)decoder.stats.frames, (unsigned long)decoder.stats.crc_errors,
+                 (unsigned long)decoder.stats.format_errors, (unsigned long)decoder.stats.seq_gaps);
+        reported_tests = stats.link_test_messages;
+    }
+}
+
+/************* HID 发送 ***************/
+
+// 报告格式能携带的位移范围是对称的 [-limit, limit]
+static int16_t clamp_motion(int32_t value, int32_t limit)
+{
+    return (int16_t)(value > limit ? limit : (value < -limit ? -limit : value));
+}
+
+// 累积的滚动（1/WHEEL_HI_RES_UNITS 格）换算成报告单位（每格 units 个），不足一个单位的留到下一份
+static int16_t wheel_report_value(int32_t accumulated, uint8_t units, int16_t limit)
+{
+    int64_t value = (int64_t)accumulated * units / WHEEL_HI_RES_UNITS;
+    return (int16_t)(value > limit ? limit : (value < -limit ? -limit : value));
+}
+
+static bool keyboard_fifo_full(void)
+{
+    return keyboard_queued - keyboard_sent >= KEYBOARD_FIFO_LENGTH;
+}
+
+static uint8_t itfs_with_changes(void)
+{
+    return (uint8_t)((keyboard_queued != keyboard_sent ? 1u << ONEKM_HID_KEYBOARD : 0) |
+                     (mouse_state.changed ? 1u << ONEKM_HID_MOUSE : 0));
+}
+
+static void start_ack_wait(uint8_t seq);
+
+// 跟踪的帧已送达时确认它，并开始跟踪期间到达的最新帧
+static void check_ack_wait(void)
+{
+    if (wait_ack_seq < 0) {
+        return;
+    }
+    // 变化被撤销（如 SWITCH 清除了累积的移动）的接口不再有报告要等
+    wait_submit &= itfs_with_changes();
+    if (wait_submit != 0 || wait_complete != 0) {
+        return;
+    }
+    onekm_port_queue_ack((uint8_t)wait_ack_seq, wait_hid ? ACK_FLAG_HID_DELIVERED : 0);
+    wait_ack_seq = -1;
+    if (hid_ack_pending) {
+        hid_ack_pending = false;
+        start_ack_wait(hid_ack_seq);
+    }
+}
+
+// 帧 seq 的消息已全部应用到 HID 状态：等仍未提交的变化和端点中的报告
+static void start_ack_wait(uint8_t seq)
+{
+    wait_ack_seq = seq;
+    wait_submit = itfs_with_changes();
+    wait_keyboard_until = keyboard_queued;
+    wait_complete = 0;
+    for (int itf = 0; itf < ONEKM_HID_COUNT; itf++) {
+        if (itf_busy[itf]) {
+            wait_complete |= (uint8_t)(1u << itf);
+        }
+    }
+    wait_hid = (wait_submit | wait_complete) != 0;
+    check_ack_wait();
+}
+
+static void report_submitted(onekm_hid_itf_t itf)
+{
+    itf_busy[itf] = true;
+    // 键盘 FIFO 中该帧的报告要全部提交，只提交了其中前面的几份时继续等
+    if (itf == ONEKM_HID_KEYBOARD && (int32_t)(keyboard_sent - wait_keyboard_until) < 0) {
+        return;
+    }
+    if (wait_submit & (1u << itf)) {
+        wait_submit &= (uint8_t)~(1u << itf);
+        wait_complete |= (uint8_t)(1u << itf);
+    }
+}
+
+// 主机取走报告的接口变为空闲；USB 复位后所有接口都空闲，
+// 跟踪中的帧不再等端点里的报告，确认时不带 ACK_FLAG_HID_DELIVERED
+static void collect_completions(void)
+{
+    if (atomic_exchange_explicit(&usb_reset_pending, false, memory_order_acquire)) {
+        atomic_store_explicit(&completed_itfs, 0, memory_order_relaxed);
+        memset(itf_busy, 0, sizeof(itf_busy));
+        wait_submit = 0;
+        wait_complete = 0;
+        wait_hid = false;
+        stats.usb_resets++;
+        check_ack_wait();
+        return;
+    }
+
+    unsigned int done = atomic_exchange_explicit(&completed_itfs, 0, memory_order_acquire);
+
+    for (int itf = 0; itf < ONEKM_HID_COUNT; itf++) {
+        if (done & (1u << itf)) {
+            itf_busy[itf] = false;
+            wait_complete &= (uint8_t)~(1u << itf);
+        }
+    }
+    check_ack_wait();
+}
+
+// 从交接队列取出消息应用到 HID 状态。键盘 FIFO 满时暂存下一份键盘报告并停止取出，
+// 等键盘端点提交出一份后再继续（后面的消息保持顺序）
+static void drain_handoff(void)
+{
+    handoff_t item;
+
+    while (1) {
+        if (have_held_event) {
+            item = held_event;
+        } else if (spsc_ring_pop(&handoff, &item, 1) == 0) {
+            return;
+        }
+
+        if (item.kind == HANDOFF_MESSAGE &&
+            (item.msg.type == MSG_KEYBOARD_REPORT || item.msg.type == MSG_KEYBOARD_KEYS) &&
+            keyboard_fifo_full()) {
+            if (!have_held_event) {
+                stats.keyboard_fifo_full++;
+            }
+            held_event = item;
+            have_held_event = true;
+            return;
+        }
+        have_held_event = false;
+
+        if (item.kind == HANDOFF_FRAME_END) {
+            if (wait_ack_seq < 0) {
+                start_ack_wait(item.seq);
+            } else {
+                hid_ack_seq = item.seq;
+                hid_ack_pending = true;
+            }
+        } else {
+            apply_hid_message(&item.msg);
+        }
+    }
+}
+
+// 空闲的端点立即提交下一份报告；忙的端点等 onekm_core_report_complete() 再提交
+bool onekm_core_hid_send(void)
+{
+    bool retry = false;
+
+    collect_completions();
+    drain_handoff();
+
+    // 发送键盘事件：每次端点空闲提交 FIFO 中最早的一份
+    if (keyboard_queued != keyboard_sent && !itf_busy[ONEKM_HID_KEYBOARD]) {
+        if (onekm_port_keyboard_report(&keyboard_fifo[keyboard_sent % KEYBOARD_FIFO_LENGTH])) {
+            keyboard_sent++;
+            report_submitted(ONEKM_HID_KEYBOARD);
+            stats.keyboard_reports++;
+            ESP_LOGV(TAG, "Sent keyboard report");
+        } else {
+            stats.reports_rejected++;
+            retry = true;
+        }
+        // FIFO 腾出了空位：继续取出被挡住的消息
+        drain_handoff();
+    }
+
+    // 发送鼠标事件
+    if (mouse_state.changed && !itf_busy[ONEKM_HID_MOUSE]) {
+        // 16 位报告一次送出整帧的移动；8 位报告（启动协议或备用描述符）超出部分留到下一份。
+        // 滚轮在主机启用分辨率倍率时按 1/120 格送出，否则按整格送出
+        onekm_mouse_format_t format;
+        onekm_port_mouse_format(&format);
+        int16_t dx = clamp_motion(mouse_state.x, format.motion_limit);
+        int16_t dy = clamp_motion(mouse_state.y, format.motion_limit);
+        int16_t vertical_wheel = wheel_report_value(mouse_state.vertical_wheel,
+                                                    format.vertical_units, format.wheel_limit);
+        int16_t horizontal_wheel = wheel_report_value(mouse_state.horizontal_wheel,
+                                                      format.horizontal_units, format.wheel_limit);
+
+        if (onekm_port_mouse_report(mouse_state.buttons, dx, dy, vertical_wheel, horizontal_wheel)) {
+            report_submitted(ONEKM_HID_MOUSE);
+            stats.mouse_reports++;
+            ESP_LOGI(TAG, "[SEND] HID_MOUSE_REPORT buttons=0x%x dx=%d dy=%d wheel_v=%d wheel_h=%d",
+                     mouse_state.buttons, dx, dy, vertical_wheel, horizontal_wheel);
+
+            // 减去已发送的值（保留未发送的部分）
+            mouse_state.x -= dx;
+            mouse_state.y -= dy;
+            mouse_state.vertical_wheel -= vertical_wheel * WHEEL_HI_RES_UNITS / format.vertical_units;
+            mouse_state.horizontal_wheel -= horizontal_wheel * WHEEL_HI_RES_UNITS / format.horizontal_units;
+            // 如果已经发送完所有累积值（滚动只剩不足一个报告单位的余数），清除changed标志
+            if ((mouse_state.x == 0 && mouse_state.y == 0 &&
+                 wheel_report_value(mouse_state.vertical_wheel, format.vertical_units, format.wheel_limit) == 0 &&
+                 wheel_report_value(mouse_state.horizontal_wheel, format.horizontal_units, format.wheel_limit) == 0) ||
+                !is_remote_mode) {
+                mouse_state.changed = false;
+            }
+        } else {
+            stats.reports_rejected++;
+            retry = true;
+        }
+    }
+
+    check_ack_wait();
+
+    return retry;
+}
+
+/************* ACK ***************/
+
+// 格式与服务器发来的帧相同：一个 v2 帧内多条 MSG_ACK
+size_t onekm_core_pack_acks(const uint16_t *acks, size_t count, size_t *used,
+                            uint8_t *frame, size_t frame_size)
+{
+    static uint8_t tx_seq = 0;
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    size_t len = 0;
+    size_t n = 0;
+    Message msg;
+
+    while (n < count && len + MSG_MAX_ENCODED_SIZE <= sizeof(payload)) {
+        msg_ack(&msg, (uint8_t)acks[n], (uint8_t)(acks[n] >> 8));
+        len += msg_encode(&msg, PROTOCOL_V2, payload + len, sizeof(payload) - len);
+        n++;
+    }
+    *used = n;
+    if (n == 0) {
+        return 0;
+    }
+    return frame_encode(tx_seq++, payload, len, frame, frame_size);
+}
+
+void onekm_core_boot_keyboard_report(const onekm_key_bitmap_t *keys, HIDKeyboardReport *report)
+{
+    size_t count = 0;
+
+    memset(report, 0, sizeof(*report));
+    report->modifiers = keys->bytes[ONEKM_KEY_MODIFIER_BYTE];
+    for (int i = 0; i < ONEKM_KEY_MODIFIER_BYTE; i++) {
+        uint8_t bits = keys->bytes[i];
+        while (bits) {
+            int bit = __builtin_ctz(bits);
+            bits &= (uint8_t)(bits - 1);
+            if (count >= sizeof(report->keys)) {
+                memset(report->keys, ONEKM_KEY_ERROR_ROLLOVER, sizeof(report->keys));
+                return;
+            }
+            report->keys[count++] = (uint8_t)(i * 8 + bit);
+        }
+    }
+}
+
+void onekm_core_get_stats(onekm_core_stats_t *out)
+{
+    *out = stats;
+    out->link = decoder.stats;
+    out->handoff_high_water = (uint32_t)atomic_load_explicit(&handoff.high_water, memory_order_relaxed);
+}
@@ -0,0 +1,123 @@
+/*
+ * OneKM 转发核心（与平台无关）
+ *
+ * 帧解码、鼠标/键盘状态累积、HID 报告生成和帧确认都在这里，
+ * 不依赖 FreeRTOS/TinyUSB/ESP-IDF 驱动。平台相关的部分由 onekm_port_* 函数实现：
+ * - onekm_esp32.c：FreeRTOS 任务 + TinyUSB（真实固件）
+ * - src/device/host/onekm_host.c：pthread + pty + 文件（Linux 主机上的模拟与压测）
+ *
+ * 线程模型与固件相同：一个接收任务调用 onekm_core_receive()，
+ * 一个 HID 任务在被唤醒后调用 onekm_core_hid_send()，
+ * USB 主机取走报告后调用 onekm_core_report_complete()。
+ * 接收任务通过无锁 SPSC 队列（src/common/spsc_ring）把消息交给 HID 任务，
+ * 鼠标/键盘状态只由 HID 任务访问；报告被取走时唤醒 HID 任务提交下一份，
+ * 端点忙时报告留在状态里等待，不会被丢弃。鼠标移动在等待期间合并，
+ * 键盘报告按顺序排队、每次提交一份，快速的按下/松开不会被合并掉。
+ * 键盘状态是 256 位的键位图（NKRO）：KEYBOARD_REPORT 整体替换它，KEYBOARD_KEYS 只改变化的位。
+ */
+
+#ifndef ONEKM_CORE_H
+#define ONEKM_CORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "common/protocol.h"
+
+#define LINK_FALLBACK_BAD_FRAMES 16  // 连续坏帧达到此数时退回上电波特率
+
+// HID 接口：键盘和鼠标各有自己的接口和 IN 端点，互不阻塞
+typedef enum {
+    ONEKM_HID_KEYBOARD = 0,
+    ONEKM_HID_MOUSE = 1,
+    ONEKM_HID_COUNT
+} onekm_hid_itf_t;
+
+// 键盘状态：每个 HID 用法（0x00-0xFF）一位，用法 u 为 bytes[u / 8] 的 bit (u % 8)；
+// 修饰键 0xE0-0xE7 即 bytes[28]，位序与启动报告的修饰键字节相同
+#define ONEKM_KEY_BITMAP_BYTES 32
+#define ONEKM_KEY_MODIFIER_BYTE 28
+#define ONEKM_KEY_ERROR_ROLLOVER 0x01   // 启动报告装不下时 6 个位置都填此用法
+
+typedef struct {
+    uint8_t bytes[ONEKM_KEY_BITMAP_BYTES];
+} onekm_key_bitmap_t;
+
+// 统计（仅用于观测，各字段由写入它的任务单独更新）
+typedef struct {
+    uint32_t messages;          // 解码出的消息数
+    uint32_t link_test_messages;
+    uint32_t keyboard_reports;  // 提交给 USB 的报告数
+    uint32_t mouse_reports;
+    uint32_t reports_rejected;  // USB 未就绪等原因提交失败（稍后重试）
+    uint32_t keyboard_collapsed; // 与上一份相同、未单独提交的键盘报告（不丢键）
+    uint32_t keyboard_fifo_full; // 键盘 FIFO 满，交接队列暂停取出的次数
+    uint32_t handoff_waits;     // 交接队列满，接收任务等待 HID 任务的次数
+    uint32_t handoff_high_water; // 交接队列的最大深度
+    uint32_t usb_resets;        // USB 复位/断开后丢弃端点状态的次数
+    FrameStats link;            // 帧统计（成功/CRC/格式/丢帧）
+} onekm_core_stats_t;
+
+/************* 平台接口（由各平台实现） ***************/
+
+// 唤醒 HID 发送任务（二值信号量语义：多次唤醒合并为一次）
+void onekm_port_notify_hid(void);
+// 让出 CPU 约一个调度周期
+void onekm_port_yield(void);
+// 等本端发送完成后切换链路波特率并清空接收缓冲；不支持的速率返回 false
+bool onekm_port_set_baud_rate(uint32_t baud_rate);
+// 排队一个待回送的 ACK，由 ACK 任务用 onekm_core_pack_acks() 打包发送
+void onekm_port_queue_ack(uint8_t seq, uint8_t flags);
+// 模式指示灯
+void onekm_port_set_led(bool on);
+// 提交 HID 报告到对应接口的端点；端点忙等原因失败时返回 false
+// 键盘报告以键位图给出：NKRO 描述符直接发送位图，启动协议用 onekm_core_boot_keyboard_report() 转换
+bool onekm_port_keyboard_report(const onekm_key_bitmap_t *keys);
+// 当前鼠标报告格式（随主机选择的协议和设置的分辨率倍率变化）
+typedef struct {
+    int16_t motion_limit;       // 单份报告的最大位移：16 位报告为 32767，8 位报告为 127
+    int16_t wheel_limit;        // 单份报告的最大滚轮值
+    uint8_t vertical_units;     // 每格滚轮的报告单位（须整除 WHEEL_HI_RES_UNITS）：
+    uint8_t horizontal_units;   // 主机启用分辨率倍率时为 WHEEL_HI_RES_UNITS，否则为 1
+} onekm_mouse_format_t;
+
+void onekm_port_mouse_format(onekm_mouse_format_t *format);
+// 按当前格式提交鼠标报告：x/y 不超过 motion_limit，滚轮以报告单位计、不超过 wheel_limit
+bool onekm_port_mouse_report(uint8_t buttons, int16_t x, int16_t y, int16_t vertical, int16_t horizontal);
+
+/************* 核心 ***************/
+
+void onekm_core_init(uint32_t boot_baud_rate);
+
+// 接收任务：处理从链路读到的一段字节
+void onekm_core_receive(const uint8_t *data, size_t len);
+
+// 接收任务：链路空闲（一次读取超时无数据）时调用，汇报链路测试结果
+void onekm_core_idle(void);
+
+// HID 任务：被唤醒后取出交接的消息，向空闲的端点提交变化的键盘/鼠标报告。
+// 返回 true 表示有报告提交失败（USB 未就绪等），应在约一个调度周期后再次调用
+bool onekm_core_hid_send(void);
+
+// USB 主机已取走该接口上一份报告（tud_hid_report_complete_cb，可在任意任务中调用）：
+// 唤醒 HID 任务提交下一份
+void onekm_core_report_complete(onekm_hid_itf_t itf);
+
+// USB 复位、断开或重新枚举（tud_umount_cb/tud_mount_cb，可在任意任务中调用）：
+// 端点中未取走的报告作废，HID 任务把所有接口视为空闲，跟踪中的帧不再等待这些报告
+void onekm_core_usb_reset(void);
+
+bool onekm_core_is_remote(void);
+void onekm_core_set_remote(bool remote);
+
+// 把 acks[0..count) 尽量多地打包进一个 v2 帧，返回帧长度，*used 为已打包的个数
+// ack 格式：序号 | 标志 << 8
+size_t onekm_core_pack_acks(const uint16_t *acks, size_t count, size_t *used,
+                            uint8_t *frame, size_t frame_size);
+
+void onekm_core_get_stats(onekm_core_stats_t *stats);
+
+// 键位图 -> 6KRO 启动格式报告（按用法从小到大；超过 6 个非修饰键时为 ErrorRollOver）
+void onekm_core_boot_keyboard_report(const onekm_key_bitmap_t *keys, HIDKeyboardReport *report);
+
+#endif // ONEKM_CORE_H
@@ -13,6 +13,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "driver/uart.h"
 #include "driver/gpio.h"
 #include "soc/uart_periph.h"
@@ -21,6 +22,9 @@
 #include "tinyusb.h"
 #include "tinyusb_default_config.h"
 #include "class/hid/hid_device.h"
+#include "common/protocol.h"
+#include "onekm_core.h"
+#include "onekm_usb_descriptors.h"
 
 #define TAG "onekm"
 
@@ -28,283 +32,230 @@
 #define UART_NUM UART_NUM_0
 #define UART_TX_PIN GPIO_NUM_43
 #define UART_RX_PIN GPIO_NUM_44
-static const int UART_BAUD_RATE = 230400;  // 波特率（可修改为230400等）
+// 上电波特率，可在 menuconfig 中修改；服务器可通过 LINK_CONFIG 消息切换到更高速率
+#ifdef CONFIG_ONEKM_UART_BAUD_RATE
+#define UART_BAUD_RATE CONFIG_ONEKM_UART_BAUD_RATE
+#else
+#define UART_BAUD_RATE 230400
+#endif
+#ifdef CONFIG_ONEKM_UART_RX_BUFFER_SIZE
+#define UART_RX_BUF_SIZE CONFIG_ONEKM_UART_RX_BUFFER_SIZE
+#else
+#define UART_RX_BUF_SIZE 4096
+#endif
 #define UART_BUF_SIZE 128
+#define ACK_QUEUE_LENGTH 64
 
 // 按钮配置
 #define APP_BUTTON GPIO_NUM_0
 
-// 共享数据结构
-typedef struct {
-    int16_t x;              // X 位移（累积值）
-    int16_t y;              // Y 位移（累积值）
-    int8_t vertical_wheel;  // 垂直滚轮（累积值）
-    int8_t horizontal_wheel; // 水平滚轮（累积值）
-    uint8_t buttons;        // 按键位掩码 (bit0=左, bit1=右, bit2=中)
-    bool changed;           // 状态变化标志
-} mouse_state_t;
-
-// 键盘直接转发状态
-typedef struct {
-    uint8_t modifiers;     // 修饰键
-    uint8_t reserved;      // 保留
-    uint8_t keys[6];       // 按键码
-    bool changed;          // 状态变化标志
-} keyboard_state_t;
-
-// 全局共享变量
-static mouse_state_t mouse_state = {0};
-static keyboard_state_t keyboard_state = {0};
-static SemaphoreHandle_t state_mutex;      // 保护共享状态
+// 转发逻辑（解码、累积、报告）在 onekm_core.c，本文件只实现 FreeRTOS/TinyUSB 平台接口
 static SemaphoreHandle_t hid_update_sem;   // 触发 HID 发送
-
-// 控制状态（LOCAL/REMOTE）
-static volatile bool is_remote_mode = false;
+static QueueHandle_t ack_queue;            // 待发送的 ACK（序号 | 标志 << 8）
 
 /************* USB HID 描述符 ***************/
 
-#define TUSB_DESC_TOTAL_LEN (TUD_CONFIG_DESC_LEN + CFG_TUD_HID * TUD_HID_DESC_LEN)
+// 接口、端点、报告描述符和配置描述符见 onekm_usb_descriptors.h
 
-// HID 报告描述符：键盘 + 鼠标
-const uint8_t hid_report_descriptor[] = {
-    TUD_HID_REPORT_DESC_KEYBOARD(HID_REPORT_ID(1)),
-    TUD_HID_REPORT_DESC_MOUSE(HID_REPORT_ID(2))
-};
+// 主机写入的分辨率倍率特性报告（TinyUSB 任务写，HID 任务读）；USB 断开时复位
+static volatile uint8_t mouse_multiplier = 0;
 
 // 字符串描述符
-const char* hid_string_descriptor[5] = {
+const char* hid_string_descriptor[6] = {
     (char[]){0x09, 0x04},  // 语言：英语
     "OneKM",               // 制造商
     "OneKM Device",        // 产品
     "123456",              // 序列号
-    "OneKM HID Interface", // HID 接口
-};
-
-// 配置描述符
-static const uint8_t hid_configuration_descriptor[] = {
-    TUD_CONFIG_DESCRIPTOR(1, 1, 0, TUSB_DESC_TOTAL_LEN, TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100),
-    TUD_HID_DESCRIPTOR(0, 4, false, sizeof(hid_report_descriptor), 0x81, 16, 10),
+    "OneKM Keyboard",      // 键盘接口
+    "OneKM Mouse",         // 鼠标接口
 };
 
 /************* TinyUSB 回调函数 ***************/
 
 uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance)
 {
-    return hid_report_descriptor;
+    return instance == ITF_NUM_MOUSE ? mouse_report_descriptor : keyboard_report_descriptor;
 }
 
 uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t* buffer, uint16_t reqlen)
 {
+    if (ONEKM_MOUSE_16BIT && instance == ITF_NUM_MOUSE && report_type == HID_REPORT_TYPE_FEATURE && reqlen >= 1) {
+        buffer[0] = mouse_multiplier;
+        return 1;
+    }
     return 0;
 }
 
 void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const* buffer, uint16_t bufsize)
 {
+    if (ONEKM_MOUSE_16BIT && instance == ITF_NUM_MOUSE && report_type == HID_REPORT_TYPE_FEATURE && bufsize >= 1) {
+        mouse_multiplier = buffer[0];
+        ESP_LOGI(TAG, "Wheel resolution multiplier: vertical %s, horizontal %s",
+                 (mouse_multiplier & MOUSE_MULTIPLIER_VERTICAL) ? "on" : "off",
+                 (mouse_multiplier & MOUSE_MULTIPLIER_HORIZONTAL) ? "on" : "off");
+    }
 }
 
-/************* 协议定义（与Linux服务器一致） ***************/
-typedef struct {
-    uint8_t type;          // 消息类型
-    union {
-        struct {
-            int16_t dx;    // 鼠标X位移
-            int16_t dy;    // 鼠标Y位移
-        } mouse_move;
-        struct {
-            uint8_t button; // 鼠标按键（1=左，2=右，3=中）
-            uint8_t state;  // 状态（0=释放，1=按下）
-            uint8_t padding[2]; // 填充
-        } mouse_button;
-        struct {
-            uint8_t modifiers;     // 修饰键位掩码
-            uint8_t reserved;      // 保留（必须为0）
-            uint8_t keys[6];       // 最多6个同时按下的按键
-        } keyboard;
-        struct {
-            uint8_t state;  // 控制状态（0=本地，1=远程）
-            uint8_t padding[3]; // 填充
-        } control;
-        struct {
-            int16_t vertical;   // 垂直滚轮
-            int16_t horizontal; // 水平滚轮
-        } mouse_wheel;
-    } data;
-} __attribute__((packed)) input_message_t;
-
-enum MessageType {
-    MSG_MOUSE_MOVE = 0x01,
-    MSG_MOUSE_BUTTON = 0x02,
-    MSG_KEYBOARD_REPORT = 0x03,
-    MSG_SWITCH = 0x04,
-    MSG_MOUSE_WHEEL = 0x05
-};
+// 主机已取走某个接口的报告：唤醒 HID 任务提交该接口的下一份
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const* report, uint16_t len)
+{
+    onekm_core_report_complete((onekm_hid_itf_t)instance);
+}
+
+// 枚举完成/USB 断开或总线复位：端点中的报告已作废，不会再有完成回调，
+// 否则 HID 任务会一直认为端点忙
+void tud_mount_cb(void)
+{
+    onekm_core_usb_reset();
+}
+
+void tud_umount_cb(void)
+{
+    onekm_core_usb_reset();
+}
+
+/************* 平台接口 ***************/
+
+void onekm_port_notify_hid(void)
+{
+    xSemaphoreGive(hid_update_sem);
+}
+
+void onekm_port_yield(void)
+{
+    vTaskDelay(1);
+}
+
+bool onekm_port_set_baud_rate(uint32_t baud_rate)
+{
+    uart_wait_tx_done(UART_NUM, pdMS_TO_TICKS(20));
+    if (uart_set_baudrate(UART_NUM, baud_rate) != ESP_OK) {
+        return false;
+    }
+    uart_flush_input(UART_NUM);
+    return true;
+}
+
+void onekm_port_queue_ack(uint8_t seq, uint8_t flags)
+{
+    uint16_t ack = (uint16_t)(seq | (flags << 8));
+    if (xQueueSend(ack_queue, &ack, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "ACK queue full, dropping ack for frame %u", seq);
+    }
+}
+
+void onekm_port_set_led(bool on)
+{
+    gpio_set_level(GPIO_NUM_48, on ? 1 : 0);
+}
+
+bool onekm_port_keyboard_report(const onekm_key_bitmap_t *keys)
+{
+    if (!ONEKM_KEYBOARD_NKRO || tud_hid_n_get_protocol(ITF_NUM_KEYBOARD) == HID_PROTOCOL_BOOT) {
+        HIDKeyboardReport boot;
+        onekm_core_boot_keyboard_report(keys, &boot);
+        return tud_hid_n_keyboard_report(ITF_NUM_KEYBOARD, 0, boot.modifiers, boot.keys);
+    }
+    keyboard_nkro_report_t report;
+    report.modifiers = keys->bytes[ONEKM_KEY_MODIFIER_BYTE];
+    memcpy(report.keys, keys->bytes, sizeof(report.keys));
+    return tud_hid_n_report(ITF_NUM_KEYBOARD, 0, &report, sizeof(report));
+}
+
+// 启动协议下主机按 8 位的启动格式解析报告（SET_PROTOCOL 由 TinyUSB 处理）
+static bool mouse_boot_format(void)
+{
+    return !ONEKM_MOUSE_16BIT || tud_hid_n_get_protocol(ITF_NUM_MOUSE) == HID_PROTOCOL_BOOT;
+}
+
+void onekm_port_mouse_format(onekm_mouse_format_t *format)
+{
+    if (mouse_boot_format()) {
+        format->motion_limit = 127;
+        format->wheel_limit = 127;
+        format->vertical_units = 1;
+        format->horizontal_units = 1;
+        return;
+    }
+    uint8_t multiplier = mouse_multiplier;
+    format->motion_limit = 32767;
+    format->wheel_limit = 32767;
+    format->vertical_units = (multiplier & MOUSE_MULTIPLIER_VERTICAL) ? WHEEL_HI_RES_UNITS : 1;
+    format->horizontal_units = (multiplier & MOUSE_MULTIPLIER_HORIZONTAL) ? WHEEL_HI_RES_UNITS : 1;
+}
+
+bool onekm_port_mouse_report(uint8_t buttons, int16_t x, int16_t y, int16_t vertical, int16_t horizontal)
+{
+    if (mouse_boot_format()) {
+        return tud_hid_n_mouse_report(ITF_NUM_MOUSE, 0, buttons, (int8_t)x, (int8_t)y,
+                                      (int8_t)vertical, (int8_t)horizontal);
+    }
+    mouse16_report_t report = {
+        .buttons = buttons,
+        .x = x,
+        .y = y,
+        .wheel = vertical,
+        .pan = horizontal,
+    };
+    return tud_hid_n_report(ITF_NUM_MOUSE, 0, &report, sizeof(report));
+}
 
 /************* UART 接收任务 ***************/
 static void uart_receive_task(void *pvParameters)
 {
     uint8_t data[UART_BUF_SIZE];
-    input_message_t msg;
-    size_t bytes_received = 0;
 
     ESP_LOGI(TAG, "UART receive task started");
 
     while (1) {
         // 读取 UART 数据
         int len = uart_read_bytes(UART_NUM, data, sizeof(data), 10 / portTICK_PERIOD_MS);
-
         if (len > 0) {
-            for (int i = 0; i < len; i++) {
-                // 累加字节到消息缓冲区
-                ((uint8_t*)&msg)[bytes_received++] = data[i];
-
-                // 如果接收到了完整的消息
-                if (bytes_received == sizeof(input_message_t)) {
-                    // 处理消息
-                    switch (msg.type) {
-                        case MSG_MOUSE_MOVE:
-                            xSemaphoreTake(state_mutex, portMAX_DELAY);
-                            // 累积鼠标移动（不移除int16_t转换，直接累积）
-                            mouse_state.x += msg.data.mouse_move.dx;
-                            mouse_state.y += msg.data.mouse_move.dy;
-                            mouse_state.changed = true;
-                            xSemaphoreGive(state_mutex);
-                            xSemaphoreGive(hid_update_sem);
-                            ESP_LOGD(TAG, "Mouse move: dx=%d, dy=%d, accumulated: x=%d, y=%d",
-                                     msg.data.mouse_move.dx, msg.data.mouse_move.dy,
-                                     mouse_state.x, mouse_state.y);
-                            break;
-
-                        case MSG_MOUSE_BUTTON:
-                            xSemaphoreTake(state_mutex, portMAX_DELAY);
-                            if (msg.data.mouse_button.state) {
-                                mouse_state.buttons |= (1 << (msg.data.mouse_button.button - 1));
-                            } else {
-                                mouse_state.buttons &= ~(1 << (msg.data.mouse_button.button - 1));
-                            }
-                            mouse_state.changed = true;
-                            xSemaphoreGive(state_mutex);
-                            xSemaphoreGive(hid_update_sem);
-                            ESP_LOGD(TAG, "Mouse button: button=%d, state=%d",
-                                     msg.data.mouse_button.button, msg.data.mouse_button.state);
-                            break;
-
-                        case MSG_MOUSE_WHEEL:
-                            xSemaphoreTake(state_mutex, portMAX_DELAY);
-                            // Accumulate wheel movement
-                            mouse_state.vertical_wheel += msg.data.mouse_wheel.vertical;
-                            mouse_state.horizontal_wheel += msg.data.mouse_wheel.horizontal;
-                            mouse_state.changed = true;
-                            xSemaphoreGive(state_mutex);
-                            xSemaphoreGive(hid_update_sem);
-                            ESP_LOGI(TAG, "[RECV] MOUSE_WHEEL vertical=%d, horizontal=%d, accumulated: v=%d, h=%d",
-                                     msg.data.mouse_wheel.vertical, msg.data.mouse_wheel.horizontal,
-                                     mouse_state.vertical_wheel, mouse_state.horizontal_wheel);
-                            break;
-
-                        case MSG_KEYBOARD_REPORT:
-                            // 直接复制键盘报告
-                            xSemaphoreTake(state_mutex, portMAX_DELAY);
-                            memcpy(&keyboard_state, &msg.data.keyboard, sizeof(keyboard_state_t) - sizeof(bool));
-                            keyboard_state.changed = true;
-                            xSemaphoreGive(state_mutex);
-                            xSemaphoreGive(hid_update_sem);
-                            ESP_LOGD(TAG, "Keyboard report: mod=0x%02X, keys=%d,%d,%d,%d,%d,%d",
-                                     msg.data.keyboard.modifiers,
-                                     msg.data.keyboard.keys[0], msg.data.keyboard.keys[1],
-                                     msg.data.keyboard.keys[2], msg.data.keyboard.keys[3],
-                                     msg.data.keyboard.keys[4], msg.data.keyboard.keys[5]);
-                            break;
-
-                        case MSG_SWITCH:
-                            is_remote_mode = (msg.data.control.state == 1);
-                            ESP_LOGI(TAG, "Mode switched: %s", is_remote_mode ? "REMOTE" : "LOCAL");
-
-                            // 重置鼠标状态（清除累积的移动数据）
-                            xSemaphoreTake(state_mutex, portMAX_DELAY);
-                            mouse_state.x = 0;
-                            mouse_state.y = 0;
-                            mouse_state.vertical_wheel = 0;
-                            mouse_state.horizontal_wheel = 0;
-                            mouse_state.changed = false;
-                            xSemaphoreGive(state_mutex);
-
-                            // LED 指示
-                            if (is_remote_mode) {
-                                gpio_set_level(GPIO_NUM_48, 1);
-                            } else {
-                                gpio_set_level(GPIO_NUM_48, 0);
-                            }
-                            break;
-
-                        default:
-                            ESP_LOGW(TAG, "Unknown message type: %d", msg.type);
-                            break;
-                    }
-
-                    bytes_received = 0; // 重置接收缓冲区
-                }
-            }
+            onekm_core_receive(data, (size_t)len);
+        } else {
+            onekm_core_idle();
         }
     }
 }
 
-/************* HID 发送任务 ***************/
-static void hid_send_task(void *pvParameters)
+/************* ACK 发送任务 ***************/
+// 把排队的 ACK 打包进帧写回 UART TX，格式与服务器发来的帧相同
+static void ack_send_task(void *pvParameters)
 {
-    ESP_LOGI(TAG, "HID send task started");
+    uint16_t acks[ACK_QUEUE_LENGTH];
+    uint8_t frame[FRAME_MAX_ENCODED_SIZE];
 
     while (1) {
-        // 等待信号量（由 UART 任务触发）
-        if (xSemaphoreTake(hid_update_sem, portMAX_DELAY) == pdTRUE) {
-            // 获取互斥锁，读取状态
-            xSemaphoreTake(state_mutex, portMAX_DELAY);
-
-            bool kb_changed = keyboard_state.changed;
-            bool mouse_changed = mouse_state.changed;
-
-            keyboard_state_t kb_local = keyboard_state;
-            mouse_state_t mouse_local = mouse_state;
+        if (xQueueReceive(ack_queue, &acks[0], portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
 
-            // 清除变化标志
-            keyboard_state.changed = false;
-            mouse_state.changed = false;
+        // 一次取走所有已排队的 ACK
+        size_t count = 1;
+        while (count < ACK_QUEUE_LENGTH && xQueueReceive(ack_queue, &acks[count], 0) == pdTRUE) {
+            count++;
+        }
 
-            xSemaphoreGive(state_mutex);
+        size_t done = 0;
+        while (done < count) {
+            size_t used;
+            size_t frame_len = onekm_core_pack_acks(acks + done, count - done, &used, frame, sizeof(frame));
+            uart_write_bytes(UART_NUM, frame, frame_len);
+            done += used;
+        }
+    }
+}
 
-            // 发送键盘事件
-            if (kb_changed) {
-                tud_hid_keyboard_report(HID_ITF_PROTOCOL_KEYBOARD,
-                    kb_local.modifiers, kb_local.keys);
-                ESP_LOGV(TAG, "Sent keyboard report");
-            }
+/************* HID 发送任务 ***************/
+static void hid_send_task(void *pvParameters)
+{
+    ESP_LOGI(TAG, "HID send task started");
 
-            // 发送鼠标事件
-            if (mouse_changed) {
-                // 将int16_t转换为int8_t（TinyUSB API需要int8_t）
-                int8_t dx = (int8_t)(mouse_local.x > 127 ? 127 : (mouse_local.x < -128 ? -128 : mouse_local.x));
-                int8_t dy = (int8_t)(mouse_local.y > 127 ? 127 : (mouse_local.y < -128 ? -128 : mouse_local.y));
-                // 滚轮直接使用int8_t值（无需转换）
-                int8_t vertical_wheel = mouse_local.vertical_wheel;
-                int8_t horizontal_wheel = mouse_local.horizontal_wheel;
-
-                tud_hid_mouse_report(HID_ITF_PROTOCOL_MOUSE,
-                    mouse_local.buttons, dx, dy, vertical_wheel, horizontal_wheel);
-                ESP_LOGI(TAG, "[SEND] HID_MOUSE_REPORT buttons=0x%x dx=%d dy=%d wheel_v=%d wheel_h=%d",
-                         mouse_local.buttons, dx, dy, vertical_wheel, horizontal_wheel);
-
-                // 减去已发送的值（保留未发送的部分）
-                xSemaphoreTake(state_mutex, portMAX_DELAY);
-                mouse_state.x -= dx;
-                mouse_state.y -= dy;
-                mouse_state.vertical_wheel = 0;
-                mouse_state.horizontal_wheel = 0;
-                // 如果已经发送完所有累积值，清除changed标志
-                if ((mouse_state.x == 0 && mouse_state.y == 0) || !is_remote_mode) {
-                    mouse_state.changed = false;
-                }
-                xSemaphoreGive(state_mutex);
-            }
-        }
+    bool retry = false;
+    while (1) {
+        // 等待信号量（由 UART 任务或报告完成回调触发）；提交失败时一个节拍后重试
+        xSemaphoreTake(hid_update_sem, retry ? 1 : portMAX_DELAY);
+        retry = onekm_core_hid_send();
     }
 }
 
@@ -347,7 +298,7 @@ void app_main(void)
     };
 
     // 安装 UART 驱动
-    ESP_ERROR_CHECK(uart_driver_install(UART_NUM, UART_BUF_SIZE * 2, UART_BUF_SIZE * 2, 0, NULL, 0));
+    ESP_ERROR_CHECK(uart_driver_install(UART_NUM, UART_RX_BUF_SIZE, UART_BUF_SIZE * 2, 0, NULL, 0));
     ESP_ERROR_CHECK(uart_param_config(UART_NUM, &uart_config));
 
     // 手动设置引脚映射（绕过默认的 USB CDC 映射）
@@ -360,12 +311,22 @@ void app_main(void)
 
     ESP_LOGI(TAG, "UART0 initialized: baud=%d, TX=GPIO%d, RX=GPIO%d", UART_BAUD_RATE, UART_TX_PIN, UART_RX_PIN);
 
+    // 控制台也在 UART0 上：ACK 帧走同一条 TX 线，日志文本夹在帧之间会让下一个帧 CRC 出错，
+    // 所以链路建立后关闭日志（ONEKM_UART_LOGS 保留日志供 idf.py monitor 调试）。
+    // 再补一个帧分隔符，结束此前的启动信息，服务器把它当作一个坏帧丢弃
+#ifndef CONFIG_ONEKM_UART_LOGS
+    esp_log_level_set("*", ESP_LOG_NONE);
+#endif
+    const uint8_t delimiter = FRAME_DELIMITER;
+    uart_write_bytes(UART_NUM, &delimiter, 1);
+
     // 3. 创建信号量和互斥锁
-    state_mutex = xSemaphoreCreateMutex();
+    onekm_core_init(UART_BAUD_RATE);
     hid_update_sem = xSemaphoreCreateBinary();
+    ack_queue = xQueueCreate(ACK_QUEUE_LENGTH, sizeof(uint16_t));
 
-    if (state_mutex == NULL || hid_update_sem == NULL) {
-        ESP_LOGE(TAG, "Failed to create semaphore/mutex");
+    if (hid_update_sem == NULL || ack_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create semaphore/queue");
         return;
     }
 
@@ -406,6 +367,17 @@ void app_main(void)
         1                       // Core 1
     );
 
+    // ACK 发送任务（Core 0）
+    xTaskCreatePinnedToCore(
+        ack_send_task,          // 任务函数
+        "ack_send",             // 任务名
+        2048,                   // 堆栈大小
+        NULL,                   // 参数
+        5,                      // 优先级
+        NULL,                   // 任务句柄
+        0                       // Core 0
+    );
+
     ESP_LOGI(TAG, "All tasks created");
     ESP_LOGI(TAG, "Waiting for USB connection...");
 
@@ -414,7 +386,7 @@ void app_main(void)
         if (tud_mounted()) {
             // USB 已连接，LED 闪烁指示
             static bool led_state = false;
-            if (is_remote_mode) {
+            if (onekm_core_is_remote()) {
                 // REMOTE 模式：LED 常亮
                 gpio_set_level(GPIO_NUM_48, 1);
             } else {
@@ -423,6 +395,8 @@ void app_main(void)
                 gpio_set_level(GPIO_NUM_48, led_state ? 1 : 0);
             }
         } else {
+            // 重新枚举后由主机重新设置滚轮分辨率倍率
+            mouse_multiplier = 0;
             // USB 未连接：LED 快闪
             static int counter = 0;
             if (counter++ % 10 == 0) {
@@ -432,8 +406,8 @@ void app_main(void)
 
         // 检查 BOOT 按钮（手动切换模式）
         if (gpio_get_level(APP_BUTTON) == 0) {
-            is_remote_mode = !is_remote_mode;
-            ESP_LOGI(TAG, "Manual mode switch: %s", is_remote_mode ? "REMOTE" : "LOCAL");
+            onekm_core_set_remote(!onekm_core_is_remote());
+            ESP_LOGI(TAG, "Manual mode switch: %s", onekm_core_is_remote() ? "REMOTE" : "LOCAL");
             vTaskDelay(pdMS_TO_TICKS(500)); // 防抖
         }
 
@@ -0,0 +1,189 @@
+/*
+ * OneKM USB HID 描述符：接口/端点编号、报告描述符、报告结构和配置描述符
+ *
+ * 只由 onekm_esp32.c 包含（描述符是 static 常量），
+ * 主机上的 usb-descriptors 测试（src/tests/usb_descriptors_test.c）用 TinyUSB 的头文件
+ * 编译同一份表，检查接口、端点、轮询间隔和报告 ID 的布局
+ */
+
+#ifndef ONEKM_USB_DESCRIPTORS_H
+#define ONEKM_USB_DESCRIPTORS_H
+
+#include "tusb.h"
+#include "common/protocol.h"
+#include "onekm_core.h"
+
+// 键盘和鼠标是两个独立的 HID 接口，各有一个 IN 端点，每 1 ms 轮询一次：
+// 键盘端点忙时鼠标报告照样能发出，同一帧里两者都能被主机取走。
+// HID 实例号与接口号一致（TinyUSB 按配置描述符中的顺序编号）
+#define ITF_NUM_KEYBOARD ONEKM_HID_KEYBOARD
+#define ITF_NUM_MOUSE    ONEKM_HID_MOUSE
+#define ITF_NUM_TOTAL    ONEKM_HID_COUNT
+
+#define EPNUM_KEYBOARD 0x81
+#define EPNUM_MOUSE    0x82
+#define HID_POLL_INTERVAL_MS 1
+
+#define TUSB_DESC_TOTAL_LEN (TUD_CONFIG_DESC_LEN + ITF_NUM_TOTAL * TUD_HID_DESC_LEN)
+
+// HID 报告描述符：每个接口只有一种报告，不带报告 ID
+// 键盘默认是 NKRO 位图报告：修饰键 8 位 + 用法 0x00-0xDF 各 1 位，同时按住任意多个键都能送出。
+// 键盘接口声明为启动设备，BIOS 等切到启动协议的主机收到 8 字节的 6KRO 启动报告；
+// 不接受位图描述符的主机可在 menuconfig 中关闭 ONEKM_KEYBOARD_NKRO，改用 TinyUSB 的启动格式描述符
+#ifdef CONFIG_ONEKM_KEYBOARD_NKRO
+#define ONEKM_KEYBOARD_NKRO 1
+#else
+#define ONEKM_KEYBOARD_NKRO 0
+#endif
+
+#define NKRO_KEY_BYTES ONEKM_KEY_MODIFIER_BYTE    // 用法 0x00-0xDF 的位图
+
+// 输入报告：修饰键 1 字节 + 位图 28 字节；输出报告（LED）与启动格式相同
+#define ONEKM_HID_REPORT_DESC_KEYBOARD_NKRO() \
+    HID_USAGE_PAGE ( HID_USAGE_PAGE_DESKTOP     )                    ,\
+    HID_USAGE      ( HID_USAGE_DESKTOP_KEYBOARD )                    ,\
+    HID_COLLECTION ( HID_COLLECTION_APPLICATION )                    ,\
+      HID_USAGE_PAGE  ( HID_USAGE_PAGE_KEYBOARD )                    ,\
+        HID_USAGE_MIN   ( 0xE0                                     ) ,\
+        HID_USAGE_MAX   ( 0xE7                                     ) ,\
+        HID_LOGICAL_MIN ( 0                                        ) ,\
+        HID_LOGICAL_MAX ( 1                                        ) ,\
+        HID_REPORT_COUNT( 8                                        ) ,\
+        HID_REPORT_SIZE ( 1                                        ) ,\
+        HID_INPUT       ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE   ) ,\
+        HID_USAGE_MIN   ( 0x00                                     ) ,\
+        HID_USAGE_MAX   ( NKRO_KEY_BYTES * 8 - 1                   ) ,\
+        HID_REPORT_COUNT( NKRO_KEY_BYTES * 8                       ) ,\
+        HID_REPORT_SIZE ( 1                                        ) ,\
+        HID_INPUT       ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE   ) ,\
+      HID_USAGE_PAGE  ( HID_USAGE_PAGE_LED )                         ,\
+        HID_USAGE_MIN   ( 1                                        ) ,\
+        HID_USAGE_MAX   ( 5                                        ) ,\
+        HID_REPORT_COUNT( 5                                        ) ,\
+        HID_REPORT_SIZE ( 1                                        ) ,\
+        HID_OUTPUT      ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE   ) ,\
+        HID_REPORT_COUNT( 1                                        ) ,\
+        HID_REPORT_SIZE ( 3                                        ) ,\
+        HID_OUTPUT      ( HID_CONSTANT                             ) ,\
+    HID_COLLECTION_END
+
+typedef struct TU_ATTR_PACKED {
+    uint8_t modifiers;
+    uint8_t keys[NKRO_KEY_BYTES];
+} keyboard_nkro_report_t;
+
+static const uint8_t keyboard_report_descriptor[] = {
+#if ONEKM_KEYBOARD_NKRO
+    ONEKM_HID_REPORT_DESC_KEYBOARD_NKRO()
+#else
+    TUD_HID_REPORT_DESC_KEYBOARD()
+#endif
+};
+
+// 鼠标默认使用 16 位 X/Y：高 DPI 鼠标一帧的移动放进一份报告，不必拆成多个 ±127 的报告。
+// 两个滚轮也是 16 位，并带分辨率倍率（Resolution Multiplier）特性报告：Windows、Linux 等
+// 主机写入倍率后按 1/120 格平滑滚动，不支持的主机保持倍率 1，仍按整格滚动。
+// 鼠标接口声明为启动设备，BIOS 等切到启动协议的主机收到 8 位的启动格式报告；
+// 连 16 位描述符都不接受的主机可在 menuconfig 中关闭 ONEKM_MOUSE_16BIT，改用 TinyUSB 的 8 位描述符
+#ifdef CONFIG_ONEKM_MOUSE_16BIT
+#define ONEKM_MOUSE_16BIT 1
+#else
+#define ONEKM_MOUSE_16BIT 0
+#endif
+
+// 输入报告：5 个按键 + 3 位填充，X/Y、垂直滚轮、水平滚轮各 16 位 [-32767, 32767]
+// 特性报告（1 字节）：bit0-1 垂直滚轮倍率，bit2-3 水平滚轮倍率（0 = 1 倍，1 = 120 倍）
+#define MOUSE_MULTIPLIER_VERTICAL   0x01
+#define MOUSE_MULTIPLIER_HORIZONTAL 0x04
+
+#define ONEKM_HID_REPORT_DESC_MOUSE16() \
+    HID_USAGE_PAGE ( HID_USAGE_PAGE_DESKTOP      )                   ,\
+    HID_USAGE      ( HID_USAGE_DESKTOP_MOUSE     )                   ,\
+    HID_COLLECTION ( HID_COLLECTION_APPLICATION  )                   ,\
+      HID_USAGE      ( HID_USAGE_DESKTOP_POINTER )                   ,\
+      HID_COLLECTION ( HID_COLLECTION_PHYSICAL   )                   ,\
+        HID_USAGE_PAGE  ( HID_USAGE_PAGE_BUTTON  )                   ,\
+          HID_USAGE_MIN   ( 1                                      ) ,\
+          HID_USAGE_MAX   ( 5                                      ) ,\
+          HID_LOGICAL_MIN ( 0                                      ) ,\
+          HID_LOGICAL_MAX ( 1                                      ) ,\
+          HID_REPORT_COUNT( 5                                      ) ,\
+          HID_REPORT_SIZE ( 1                                      ) ,\
+          HID_INPUT       ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ) ,\
+          HID_REPORT_COUNT( 1                                      ) ,\
+          HID_REPORT_SIZE ( 3                                      ) ,\
+          HID_INPUT       ( HID_CONSTANT                           ) ,\
+        HID_USAGE_PAGE  ( HID_USAGE_PAGE_DESKTOP )                   ,\
+          HID_USAGE       ( HID_USAGE_DESKTOP_X                    ) ,\
+          HID_USAGE       ( HID_USAGE_DESKTOP_Y                    ) ,\
+          HID_LOGICAL_MIN_N( 0x8001, 2                             ) ,\
+          HID_LOGICAL_MAX_N( 0x7fff, 2                             ) ,\
+          HID_REPORT_COUNT( 2                                      ) ,\
+          HID_REPORT_SIZE ( 16                                     ) ,\
+          HID_INPUT       ( HID_DATA | HID_VARIABLE | HID_RELATIVE ) ,\
+        HID_COLLECTION ( HID_COLLECTION_LOGICAL  )                   ,\
+          HID_USAGE       ( HID_USAGE_DESKTOP_RESOLUTION_MULTIPLIER ),\
+          HID_LOGICAL_MIN ( 0                                      ) ,\
+          HID_LOGICAL_MAX ( 1                                      ) ,\
+          HID_PHYSICAL_MIN( 1                                      ) ,\
+          HID_PHYSICAL_MAX( WHEEL_HI_RES_UNITS                     ) ,\
+          HID_REPORT_COUNT( 1                                      ) ,\
+          HID_REPORT_SIZE ( 2                                      ) ,\
+          HID_FEATURE     ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ) ,\
+          HID_USAGE       ( HID_USAGE_DESKTOP_WHEEL                ) ,\
+          HID_LOGICAL_MIN_N( 0x8001, 2                             ) ,\
+          HID_LOGICAL_MAX_N( 0x7fff, 2                             ) ,\
+          HID_PHYSICAL_MIN( 0                                      ) ,\
+          HID_PHYSICAL_MAX( 0                                      ) ,\
+          HID_REPORT_SIZE ( 16                                     ) ,\
+          HID_INPUT       ( HID_DATA | HID_VARIABLE | HID_RELATIVE ) ,\
+        HID_COLLECTION_END                                           ,\
+        HID_COLLECTION ( HID_COLLECTION_LOGICAL  )                   ,\
+          HID_USAGE       ( HID_USAGE_DESKTOP_RESOLUTION_MULTIPLIER ),\
+          HID_LOGICAL_MIN ( 0                                      ) ,\
+          HID_LOGICAL_MAX ( 1                                      ) ,\
+          HID_PHYSICAL_MIN( 1                                      ) ,\
+          HID_PHYSICAL_MAX( WHEEL_HI_RES_UNITS                     ) ,\
+          HID_REPORT_SIZE ( 2                                      ) ,\
+          HID_FEATURE     ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ) ,\
+          HID_USAGE_PAGE  ( HID_USAGE_PAGE_CONSUMER )                ,\
+          HID_USAGE_N     ( HID_USAGE_CONSUMER_AC_PAN, 2           ) ,\
+          HID_LOGICAL_MIN_N( 0x8001, 2                             ) ,\
+          HID_LOGICAL_MAX_N( 0x7fff, 2                             ) ,\
+          HID_PHYSICAL_MIN( 0                                      ) ,\
+          HID_PHYSICAL_MAX( 0                                      ) ,\
+          HID_REPORT_SIZE ( 16                                     ) ,\
+          HID_INPUT       ( HID_DATA | HID_VARIABLE | HID_RELATIVE ) ,\
+        HID_COLLECTION_END                                           ,\
+        /* 特性报告补齐到 1 字节 */ \
+        HID_REPORT_SIZE ( 4                                        ) ,\
+        HID_FEATURE     ( HID_CONSTANT                             ) ,\
+      HID_COLLECTION_END                                             ,\
+    HID_COLLECTION_END
+
+typedef struct TU_ATTR_PACKED {
+    uint8_t buttons;
+    int16_t x;
+    int16_t y;
+    int16_t wheel;
+    int16_t pan;
+} mouse16_report_t;
+
+static const uint8_t mouse_report_descriptor[] = {
+#if ONEKM_MOUSE_16BIT
+    ONEKM_HID_REPORT_DESC_MOUSE16()
+#else
+    TUD_HID_REPORT_DESC_MOUSE()
+#endif
+};
+
+// 配置描述符
+static const uint8_t hid_configuration_descriptor[] = {
+    TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, TUSB_DESC_TOTAL_LEN, TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100),
+    TUD_HID_DESCRIPTOR(ITF_NUM_KEYBOARD, 4, HID_ITF_PROTOCOL_KEYBOARD, sizeof(keyboard_report_descriptor),
+                       EPNUM_KEYBOARD, 32, HID_POLL_INTERVAL_MS),
+    TUD_HID_DESCRIPTOR(ITF_NUM_MOUSE, 5, HID_ITF_PROTOCOL_MOUSE, sizeof(mouse_report_descriptor),
+                       EPNUM_MOUSE, 16, HID_POLL_INTERVAL_MS),
+};
+
+#endif // ONEKM_USB_DESCRIPTORS_H
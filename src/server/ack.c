@@ -0,0 +1,141 @@
+#include "ack.h"
+#include "latency.h"
+#include <stdatomic.h>
+
+#define ACK_TABLE_SIZE 256   // one slot per frame sequence number
+#define ACK_COALESCE_WINDOW_NS 100000000ull  // older unacked frames are not merged into a report ack
+
+#define KEYBOARD_TYPES (ACK_TYPE_BIT(MSG_KEYBOARD_REPORT) | ACK_TYPE_BIT(MSG_KEYBOARD_KEYS))
+#define HID_TYPES (ACK_TYPE_BIT(MSG_MOUSE_MOVE) | ACK_TYPE_BIT(MSG_MOUSE_BUTTON) | \
+                   ACK_TYPE_BIT(MSG_MOUSE_WHEEL) | ACK_TYPE_BIT(MSG_MOUSE_REPORT) | \
+                   ACK_TYPE_BIT(MSG_MOUSE_SCROLL) | KEYBOARD_TYPES)
+
+// Written by the writer thread, claimed by the event loop. sent_ns doubles as
+// the "outstanding" flag and is published last
+typedef struct {
+    atomic_uint_fast64_t sent_ns;
+    atomic_uint_fast64_t input_ns;
+    atomic_uint type_mask;
+} AckSlot;
+
+static AckSlot slots[ACK_TABLE_SIZE];
+static FrameDecoder decoder;
+static int decoder_ready = 0;
+
+static atomic_uint_fast64_t frames_tracked;
+static atomic_uint_fast64_t unacked;
+static uint64_t acks;
+static uint64_t hid_delivered;
+static uint64_t stray_acks;
+
+void ack_frame_sent(uint8_t seq, uint32_t type_mask, uint64_t input_ns) {
+    AckSlot *slot = &slots[seq];
+
+    if (atomic_exchange_explicit(&slot->sent_ns, 0, memory_order_relaxed) != 0) {
+        atomic_fetch_add_explicit(&unacked, 1, memory_order_relaxed);
+    }
+    atomic_store_explicit(&slot->input_ns, input_ns, memory_order_relaxed);
+    atomic_store_explicit(&slot->type_mask, type_mask, memory_order_relaxed);
+    atomic_store_explicit(&slot->sent_ns, latency_now_ns(), memory_order_release);
+    atomic_fetch_add_explicit(&frames_tracked, 1, memory_order_relaxed);
+}
+
+// Claim an outstanding slot; returns 0 if it was not outstanding
+static int complete_slot(AckSlot *slot, uint64_t now, int hid_delivered_flag) {
+    uint64_t sent = atomic_load_explicit(&slot->sent_ns, memory_order_acquire);
+    if (sent == 0 ||
+        !atomic_compare_exchange_strong_explicit(&slot->sent_ns, &sent, 0,
+                                                 memory_order_acquire, memory_order_relaxed)) {
+        return 0;
+    }
+
+    uint32_t mask = atomic_load_explicit(&slot->type_mask, memory_order_relaxed);
+    uint64_t rtt = now > sent ? now - sent : 0;
+    if (mask & KEYBOARD_TYPES) {
+        latency_record(LATENCY_ACK_KEYBOARD, rtt);
+    }
+    if (mask & (HID_TYPES & ~KEYBOARD_TYPES)) {
+        latency_record(LATENCY_ACK_MOUSE, rtt);
+    }
+    if (!(mask & HID_TYPES)) {
+        latency_record(LATENCY_ACK_CONTROL, rtt);
+    }
+    if (hid_delivered_flag) {
+        uint64_t input = atomic_load_explicit(&slot->input_ns, memory_order_relaxed);
+        if (input != 0) {
+            latency_record(LATENCY_INPUT_TO_USB, now > input ? now - input : 0);
+        }
+        hid_delivered++;
+    }
+    acks++;
+    return 1;
+}
+
+static void handle_ack(uint8_t seq, uint8_t flags) {
+    uint64_t now = latency_now_ns();
+
+    if (!(flags & ACK_FLAG_HID_DELIVERED)) {
+        if (!complete_slot(&slots[seq], now, 0)) {
+            stray_acks++;
+        }
+        return;
+    }
+
+    // The host took a report that may merge several frames: also complete the
+    // outstanding HID frames written shortly before seq. Frames without HID output
+    // and frames written after seq (slots reused since) are left alone
+    uint64_t acked_sent = atomic_load_explicit(&slots[seq].sent_ns, memory_order_acquire);
+    if (acked_sent == 0) {
+        stray_acks++;
+        return;
+    }
+    for (int back = 0; back < ACK_TABLE_SIZE; back++) {
+        AckSlot *slot = &slots[(uint8_t)(seq - back)];
+        uint64_t sent = atomic_load_explicit(&slot->sent_ns, memory_order_acquire);
+        if (sent == 0 || sent > acked_sent || acked_sent - sent > ACK_COALESCE_WINDOW_NS ||
+            !(atomic_load_explicit(&slot->type_mask, memory_order_relaxed) & HID_TYPES)) {
+            continue;
+        }
+        complete_slot(slot, now, 1);
+    }
+}
+
+void ack_receive(const uint8_t *data, size_t len) {
+    if (!decoder_ready) {
+        frame_decoder_init(&decoder);
+        decoder_ready = 1;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t seq;
+        const uint8_t *payload;
+        size_t payload_len;
+        if (!frame_decoder_feed(&decoder, data[i], &seq, &payload, &payload_len)) {
+            continue;
+        }
+
+        size_t pos = 0;
+        Message msg;
+        while (pos < payload_len) {
+            int n = msg_decode(payload + pos, payload_len - pos, &msg);
+            if (n <= 0) {
+                break;
+            }
+            if (msg.type == MSG_ACK) {
+                handle_ack(msg.data.ack.sequence, msg.data.ack.flags);
+            }
+            pos += (size_t)n;
+        }
+    }
+}
+
+void ack_get_stats(AckStats *stats) {
+    if (!stats) {
+        return;
+    }
+    stats->frames_tracked = atomic_load_explicit(&frames_tracked, memory_order_relaxed);
+    stats->acks = acks;
+    stats->hid_delivered = hid_delivered;
+    stats->unacked = atomic_load_explicit(&unacked, memory_order_relaxed);
+    stats->stray_acks = stray_acks;
+}
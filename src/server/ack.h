@@ -0,0 +1,32 @@
+#ifndef ACK_H
+#define ACK_H
+
+#include <stdint.h>
+#include "common/protocol.h"
+
+// Round-trip tracking of v2 frames. The dongle acknowledges each frame once it
+// has been applied, or once the host has taken the HID report built from it
+// (ACK_FLAG_HID_DELIVERED). Round trips land in the LATENCY_ACK_* histograms,
+// and the input age at HID delivery in LATENCY_INPUT_TO_USB.
+
+typedef struct {
+    uint64_t frames_tracked;    // frames recorded by the writer
+    uint64_t acks;              // acks that matched an outstanding frame
+    uint64_t hid_delivered;     // frames confirmed as taken by the USB host
+    uint64_t unacked;           // frames overwritten in the table without an ack
+    uint64_t stray_acks;        // acks for unknown or already acknowledged frames
+} AckStats;
+
+// Mask bit for a message type in ack_frame_sent()
+#define ACK_TYPE_BIT(type) (1u << (type))
+
+// Writer thread: frame seq, carrying messages of the types in type_mask, is
+// about to be written. input_ns is the oldest input behind it (0 = none)
+void ack_frame_sent(uint8_t seq, uint32_t type_mask, uint64_t input_ns);
+
+// Event loop thread: feed bytes received from the dongle
+void ack_receive(const uint8_t *data, size_t len);
+
+void ack_get_stats(AckStats *stats);
+
+#endif // ACK_H
@@ -1,28 +1,132 @@
 #include "input_capture.h"
 #include "state_machine.h"
+#include "latency.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
 #include <dirent.h>
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
 #include <linux/input.h>
 #include <libevdev/libevdev.h>
 
-#define MAX_DEVICES 10
-static struct libevdev *devices[MAX_DEVICES];
+#define INPUT_DIR "/dev/input"
+#define KEY_STATE_BYTES (KEY_MAX / 8 + 1)
+
+typedef struct {
+    struct libevdev *evdev;
+    int fd;
+    int id;                              // stable for the device's lifetime (trace index)
+    InputDeviceClass device_class;
+    char path[64];
+    int dropping;                        // SYN_DROPPED seen, discarding until SYN_REPORT
+    int resync_pending;                  // key state must be re-read with EVIOCGKEY
+    int removed;                         // read() returned ENODEV
+    uint8_t key_state[KEY_STATE_BYTES];  // key state as last delivered to the pipeline
+    InputDeviceStats stats;              // name, index and class are filled on demand
+} InputDevice;
+
+// Grows as devices are plugged in; removed devices are swapped out
+static InputDevice *devices = NULL;
 static int num_devices = 0;
+static int device_capacity = 0;
+static int next_device_id = 0;
 static int grab_devices = 0;
+static int hotplug_fd = -1;
+
+static InputDevice *find_device(int fd) {
+    for (int i = 0; i < num_devices; i++) {
+        if (devices[i].fd == fd) {
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
+
+static int is_device_open(const char *path) {
+    for (int i = 0; i < num_devices; i++) {
+        if (strcmp(devices[i].path, path) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Open path if it is a keyboard or mouse. Returns its fd, -1 if it was not added
+static int open_device(const char *path) {
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct libevdev *dev = NULL;
+    if (libevdev_new_from_fd(fd, &dev) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    if (!libevdev_has_event_type(dev, EV_KEY) && !libevdev_has_event_type(dev, EV_REL)) {
+        libevdev_free(dev);
+        close(fd);
+        return -1;
+    }
+
+    if (num_devices == device_capacity) {
+        int capacity = device_capacity ? device_capacity * 2 : 16;
+        InputDevice *grown = realloc(devices, (size_t)capacity * sizeof(*grown));
+        if (!grown) {
+            fprintf(stderr, "Out of memory adding %s\n", path);
+            libevdev_free(dev);
+            close(fd);
+            return -1;
+        }
+        devices = grown;
+        device_capacity = capacity;
+    }
+
+    InputDevice *device = &devices[num_devices++];
+    memset(device, 0, sizeof(*device));
+    device->evdev = dev;
+    device->fd = fd;
+    device->id = next_device_id++;
+    device->device_class = libevdev_has_event_code(dev, EV_KEY, KEY_A) ?
+                           INPUT_CLASS_KEYBOARD : INPUT_CLASS_POINTER;
+    snprintf(device->path, sizeof(device->path), "%s", path);
+    // Start from the current kernel state so keys held at startup are known
+    ioctl(fd, EVIOCGKEY(sizeof(device->key_state)), device->key_state);
+    // Event timestamps on the same clock as latency_now_ns()
+    if (libevdev_set_clock_id(dev, CLOCK_MONOTONIC) != 0) {
+        fprintf(stderr, "Warning: %s keeps realtime event timestamps\n", path);
+    }
+    // A device plugged in while in REMOTE mode must not reach the local desktop
+    if (grab_devices) {
+        libevdev_grab(dev, LIBEVDEV_GRAB);
+    }
+    printf("Added device: %s (%s%s)\n", libevdev_get_name(dev), path,
+           device->device_class == INPUT_CLASS_KEYBOARD ? ", keyboard" : "");
+    return fd;
+}
 
 int init_input_capture(void) {
-    const char *input_dir = "/dev/input";
     DIR *dir;
     struct dirent *entry;
-    int fd;
 
-    dir = opendir(input_dir);
+    // Watch before scanning so a device appearing in between is not missed
+    // (is_device_open() filters the duplicate event)
+    hotplug_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (hotplug_fd >= 0 && inotify_add_watch(hotplug_fd, INPUT_DIR, IN_CREATE | IN_ATTRIB) < 0) {
+        close(hotplug_fd);
+        hotplug_fd = -1;
+    }
+    if (hotplug_fd < 0) {
+        perror("Warning: input hotplug unavailable");
+    }
+
+    dir = opendir(INPUT_DIR);
     if (!dir) {
         perror("Failed to open input directory");
         return -1;
@@ -30,46 +134,83 @@ int init_input_capture(void) {
 
     printf("Scanning input devices...\n");
 
-    while ((entry = readdir(dir)) != NULL && num_devices < MAX_DEVICES) {
+    while ((entry = readdir(dir)) != NULL) {
         if (strncmp(entry->d_name, "event", 5) != 0) {
             continue;
         }
 
         char device_path[512];
-        snprintf(device_path, sizeof(device_path), "%s/%s", input_dir, entry->d_name);
+        snprintf(device_path, sizeof(device_path), "%s/%s", INPUT_DIR, entry->d_name);
+        open_device(device_path);
+    }
 
-        fd = open(device_path, O_RDONLY | O_NONBLOCK);
-        if (fd < 0) {
-            continue;
+    closedir(dir);
+
+    if (num_devices == 0) {
+        if (hotplug_fd < 0) {
+            fprintf(stderr, "No input devices found\n");
+            return -1;
         }
+        printf("No input devices yet, waiting for one to be plugged in\n");
+        return 0;
+    }
 
-        struct libevdev *dev = NULL;
-        int rc = libevdev_new_from_fd(fd, &dev);
-        if (rc < 0) {
-            close(fd);
-            continue;
+    printf("Initialized %d input device(s)\n", num_devices);
+    return 0;
+}
+
+int get_hotplug_fd(void) {
+    return hotplug_fd;
+}
+
+int handle_hotplug(int *fds, int max_fds) {
+    // Events read but not yet handled when fds filled up are kept for the next call
+    static char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    static size_t buf_len = 0;
+    static size_t buf_pos = 0;
+    int count = 0;
+
+    while (count < max_fds) {
+        if (buf_pos >= buf_len) {
+            ssize_t len = read(hotplug_fd, buf, sizeof(buf));
+            if (len <= 0) {
+                break;
+            }
+            buf_len = (size_t)len;
+            buf_pos = 0;
         }
 
-        if (libevdev_has_event_type(dev, EV_KEY) ||
-            libevdev_has_event_type(dev, EV_REL)) {
-            devices[num_devices++] = dev;
-            printf("Added device: %s (%s)\n",
-                   libevdev_get_name(dev), device_path);
-        } else {
-            libevdev_free(dev);
-            close(fd);
+        const struct inotify_event *ev = (const struct inotify_event *)(buf + buf_pos);
+        buf_pos += sizeof(*ev) + ev->len;
+
+        if (ev->len == 0 || strncmp(ev->name, "event", 5) != 0) {
+            continue;
+        }
+        char device_path[512];
+        snprintf(device_path, sizeof(device_path), "%s/%s", INPUT_DIR, ev->name);
+        // udev creates the node first and fixes its permissions afterwards
+        // (IN_ATTRIB), so a node that could not be opened yet is retried then
+        if (is_device_open(device_path)) {
+            continue;
+        }
+        int fd = open_device(device_path);
+        if (fd >= 0) {
+            fds[count++] = fd;
         }
     }
+    return count;
+}
 
-    closedir(dir);
-
-    if (num_devices == 0) {
-        fprintf(stderr, "No input devices found\n");
-        return -1;
+void remove_input_device(int fd) {
+    InputDevice *device = find_device(fd);
+    if (!device) {
+        return;
     }
 
-    printf("Initialized %d input device(s)\n", num_devices);
-    return 0;
+    printf("Removed device: %s (%s)\n", libevdev_get_name(device->evdev), device->path);
+    libevdev_free(device->evdev);
+    close(device->fd);
+    *device = devices[--num_devices];
 }
 
 void set_device_grab(int grab) {
@@ -80,9 +221,9 @@ void set_device_grab(int grab) {
     grab_devices = grab;
     for (int i = 0; i < num_devices; i++) {
         if (grab) {
-            libevdev_grab(devices[i], LIBEVDEV_GRAB);
+            libevdev_grab(devices[i].evdev, LIBEVDEV_GRAB);
         } else {
-            libevdev_grab(devices[i], LIBEVDEV_UNGRAB);
+            libevdev_grab(devices[i].evdev, LIBEVDEV_UNGRAB);
         }
     }
 
@@ -96,43 +237,245 @@ void set_device_grab(int grab) {
 int get_device_fds(int *fds, int max_fds) {
     int count = num_devices < max_fds ? num_devices : max_fds;
     for (int i = 0; i < count; i++) {
-        fds[i] = libevdev_get_fd(devices[i]);
+        fds[i] = devices[i].fd;
     }
     return count;
 }
 
-int capture_input(InputEvent *event) {
-    int rc;
-    struct input_event ev;
+int get_device_count(void) {
+    return num_devices;
+}
 
+int get_device_index(int fd) {
+    InputDevice *device = find_device(fd);
+    return device ? device->id : -1;
+}
+
+int get_device_names(const char **names, int max_names) {
+    int count = 0;
+    for (int i = 0; i < max_names; i++) {
+        names[i] = NULL;
+    }
     for (int i = 0; i < num_devices; i++) {
-        rc = libevdev_next_event(devices[i], LIBEVDEV_READ_FLAG_NORMAL, &ev);
+        int id = devices[i].id;
+        if (id >= 0 && id < max_names) {
+            names[id] = libevdev_get_name(devices[i].evdev);
+            if (id >= count) {
+                count = id + 1;
+            }
+        }
+    }
+    return count;
+}
+
+InputDeviceClass get_device_class(int fd) {
+    InputDevice *device = find_device(fd);
+    return device ? device->device_class : INPUT_CLASS_POINTER;
+}
+
+int get_device_stats(InputDeviceStats *stats, int max_stats) {
+    int count = num_devices < max_stats ? num_devices : max_stats;
+    for (int i = 0; i < count; i++) {
+        stats[i] = devices[i].stats;
+        stats[i].name = libevdev_get_name(devices[i].evdev);
+        stats[i].index = devices[i].id;
+        stats[i].device_class = devices[i].device_class;
+    }
+    return count;
+}
+
+static int key_bit(const uint8_t *bits, int code) {
+    return (bits[code / 8] >> (code % 8)) & 1;
+}
+
+static void set_key_bit(uint8_t *bits, int code, int pressed) {
+    if (pressed) {
+        bits[code / 8] |= (uint8_t)(1 << (code % 8));
+    } else {
+        bits[code / 8] &= (uint8_t)~(1 << (code % 8));
+    }
+}
+
+static void store_event(InputEvent *event, uint16_t type, uint16_t code, int32_t value,
+                        uint64_t time_ns) {
+    event->type = type;
+    event->code = code;
+    event->value = value;
+    event->time_ns = time_ns;
+}
+
+static uint64_t event_time_ns(const struct input_event *ev) {
+    return (uint64_t)ev->time.tv_sec * 1000000000ull + (uint64_t)ev->time.tv_usec * 1000ull;
+}
 
-        if (rc == LIBEVDEV_READ_STATUS_SUCCESS) {
-            if (ev.type == EV_SYN || ev.type == EV_MSC) {
+// Emit synthetic key events for every key whose state in target differs from what
+// the pipeline last saw, followed by a SYN_REPORT. Each emitted change is recorded, so
+// a sync cut short by a full batch simply continues on the next call; *done is set
+// once everything including the SYN_REPORT has been emitted.
+static int sync_key_state(InputDevice *device, const uint8_t *target,
+                          InputEvent *events, int max_events, int *done) {
+    uint64_t now = latency_now_ns();
+    int count = 0;
+
+    *done = 0;
+    for (int byte = 0; byte < KEY_STATE_BYTES; byte++) {
+        if (target[byte] == device->key_state[byte]) {
+            continue;
+        }
+        for (int bit = 0; bit < 8; bit++) {
+            int code = byte * 8 + bit;
+            int pressed = key_bit(target, code);
+            if (pressed == key_bit(device->key_state, code)) {
                 continue;
             }
+            // Keep one slot for the closing SYN_REPORT
+            if (count >= max_events - 1) {
+                return count;
+            }
+            store_event(&events[count++], EV_KEY, (uint16_t)code, pressed, now);
+            set_key_bit(device->key_state, code, pressed);
+        }
+    }
 
-            if (ev.type != EV_KEY && ev.type != EV_REL) {
-                continue;
+    if (count < max_events) {
+        store_event(&events[count++], EV_SYN, SYN_REPORT, 0, now);
+        *done = 1;
+    }
+    return count;
+}
+
+// Re-read the kernel key state after SYN_DROPPED and deliver the differences
+static int resync_device(InputDevice *device, InputEvent *events, int max_events) {
+    uint8_t kernel_state[KEY_STATE_BYTES] = {0};
+    int done;
+
+    if (ioctl(device->fd, EVIOCGKEY(sizeof(kernel_state)), kernel_state) < 0) {
+        device->resync_pending = 0;
+        return 0;
+    }
+
+    int count = sync_key_state(device, kernel_state, events, max_events, &done);
+    if (done) {
+        device->resync_pending = 0;
+        printf("[INPUT] Resynced key state of %s after SYN_DROPPED\n",
+               libevdev_get_name(device->evdev));
+    }
+    return count;
+}
+
+// Release whatever the pipeline still believes is held on a removed device, so an
+// unplugged keyboard cannot leave a key stuck down on the remote side.
+// Returns -1 once nothing is left to release
+static int release_removed_device(InputDevice *device, InputEvent *events, int max_events) {
+    static const uint8_t released[KEY_STATE_BYTES];
+    int done;
+
+    if (memcmp(device->key_state, released, sizeof(released)) == 0) {
+        return -1;
+    }
+    return sync_key_state(device, released, events, max_events, &done);
+}
+
+int capture_input_batch(int fd, InputEvent *events, int max_events) {
+    struct input_event raw[INPUT_BATCH_SIZE];
+    InputDevice *device = find_device(fd);
+    int count = 0;
+
+    if (!device || !events || max_events <= 0) {
+        return -1;
+    }
+
+    if (device->removed) {
+        return release_removed_device(device, events, max_events);
+    }
+
+    if (device->resync_pending) {
+        count = resync_device(device, events, max_events);
+        if (device->resync_pending || count >= max_events) {
+            return count;
+        }
+    }
+
+    int room = max_events - count;
+    if (room > INPUT_BATCH_SIZE) {
+        room = INPUT_BATCH_SIZE;
+    }
+
+    ssize_t len = read(fd, raw, sizeof(struct input_event) * (size_t)room);
+    if (len < 0) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return count;
+        }
+        if (errno == ENODEV) {
+            device->removed = 1;
+            if (count == 0) {
+                return release_removed_device(device, events, max_events);
             }
+        }
+        return count > 0 ? count : -1;
+    }
 
-            event->type = ev.type;
-            event->code = ev.code;
-            event->value = ev.value;
+    int num_raw = (int)(len / (ssize_t)sizeof(struct input_event));
+    int first_read = count;
+    for (int i = 0; i < num_raw; i++) {
+        const struct input_event *ev = &raw[i];
 
-            return 0;
-        } else if (rc == -EAGAIN) {
+        if (device->dropping) {
+            // The kernel buffer overflowed: everything up to the next SYN_REPORT is
+            // incomplete, and whatever follows it in this read predates the state we
+            // are about to query, so drop the rest of the batch and resync instead.
+            if (ev->type == EV_SYN && ev->code == SYN_REPORT) {
+                device->dropping = 0;
+                device->resync_pending = 1;
+                break;
+            }
             continue;
-        } else if (rc < 0) {
-            if (rc == -ENODEV) {
-                printf("Device removed\n");
+        }
+
+        if (ev->type == EV_SYN) {
+            if (ev->code == SYN_DROPPED) {
+                device->dropping = 1;
+            } else if (ev->code == SYN_REPORT) {
+                store_event(&events[count++], ev->type, ev->code, ev->value, event_time_ns(ev));
             }
             continue;
         }
+
+        if (ev->type != EV_KEY && ev->type != EV_REL) {
+            continue;
+        }
+
+        if (ev->type == EV_KEY && ev->code <= KEY_MAX && ev->value != 2) {
+            set_key_bit(device->key_state, ev->code, ev->value);
+        }
+        store_event(&events[count++], ev->type, ev->code, ev->value, event_time_ns(ev));
     }
 
-    return -1;
+    if (count > first_read) {
+        InputDeviceStats *stats = &device->stats;
+        uint64_t now = latency_now_ns();
+        stats->reads++;
+        stats->events += (uint64_t)(count - first_read);
+        if ((uint32_t)num_raw > stats->max_batch) {
+            stats->max_batch = (uint32_t)num_raw;
+        }
+        if (num_raw == room) {
+            stats->full_reads++;
+        }
+        for (int i = first_read; i < count; i++) {
+            uint64_t age = now > events[i].time_ns ? now - events[i].time_ns : 0;
+            stats->age_ns_total += age;
+            if (age > stats->age_ns_max) {
+                stats->age_ns_max = age;
+            }
+        }
+    }
+
+    if (device->resync_pending && count < max_events) {
+        count += resync_device(device, events + count, max_events - count);
+    }
+
+    return count;
 }
 
 int get_hardware_keyboard_state(uint8_t key_states[32]) {
@@ -146,11 +489,11 @@ int get_hardware_keyboard_state(uint8_t key_states[32]) {
     // Query all keyboard devices and merge their states
     for (int i = 0; i < num_devices; i++) {
         // Only check devices with keyboard capability
-        if (!libevdev_has_event_type(devices[i], EV_KEY)) {
+        if (!libevdev_has_event_type(devices[i].evdev, EV_KEY)) {
             continue;
         }
 
-        int fd = libevdev_get_fd(devices[i]);
+        int fd = devices[i].fd;
         if (fd < 0) {
             continue;
         }
@@ -172,12 +515,20 @@ void cleanup_input_capture(void) {
     set_device_grab(0);
 
     for (int i = 0; i < num_devices; i++) {
-        if (devices[i]) {
-            int fd = libevdev_get_fd(devices[i]);
-            libevdev_free(devices[i]);
-            close(fd);
-            devices[i] = NULL;
+        if (devices[i].evdev) {
+            libevdev_free(devices[i].evdev);
+            close(devices[i].fd);
+            devices[i].evdev = NULL;
+            devices[i].fd = -1;
         }
     }
     num_devices = 0;
+    free(devices);
+    devices = NULL;
+    device_capacity = 0;
+
+    if (hotplug_fd >= 0) {
+        close(hotplug_fd);
+        hotplug_fd = -1;
+    }
 }
@@ -7,11 +7,70 @@ typedef struct {
     uint16_t type;
     uint16_t code;
     int32_t value;
+    uint64_t time_ns;   // kernel timestamp, CLOCK_MONOTONIC (synthetic events: time of resync)
 } InputEvent;
 
+// Upper bound on events handed out by one capture_input_batch() call
+#define INPUT_BATCH_SIZE 64
+
+// Scheduling class: keyboards are drained before pointing devices in each wakeup
+typedef enum {
+    INPUT_CLASS_POINTER,
+    INPUT_CLASS_KEYBOARD    // has letter keys (a receiver with both counts as one)
+} InputDeviceClass;
+
+typedef struct {
+    const char *name;
+    int index;                  // get_device_index()
+    InputDeviceClass device_class;
+    uint64_t reads;             // reads that returned events
+    uint64_t events;
+    uint32_t max_batch;         // most events one read returned
+    uint64_t full_reads;        // reads that filled the batch (more was queued behind)
+    uint64_t age_ns_total;      // input age at read() summed over events
+    uint64_t age_ns_max;
+} InputDeviceStats;
+
+// Open every keyboard and mouse under /dev/input and start watching it for new ones.
+// Succeeds with no devices as long as hotplug is available
 int init_input_capture(void);
-int capture_input(InputEvent *event);
+
+// Read everything pending on the device behind fd (as returned by get_device_fds)
+// with a single read(). Stores EV_KEY, EV_REL and EV_SYN/SYN_REPORT frame markers.
+// After a SYN_DROPPED overflow the key state is re-read with EVIOCGKEY and the
+// differences are delivered as synthetic key events. Once the device is gone
+// (ENODEV), keys still held on it are delivered as releases.
+// Returns the number of events stored (0 = nothing pending), -1 on error or once a
+// removed device has nothing left to deliver: stop polling fd and call
+// remove_input_device()
+int capture_input_batch(int fd, InputEvent *events, int max_events);
 int get_device_fds(int *fds, int max_fds);
+int get_device_count(void);
+
+// Hotplug: inotify descriptor on /dev/input, readable when devices may have been
+// added. -1 if unavailable (the device set is then fixed at startup)
+int get_hotplug_fd(void);
+
+// Open keyboards and mice that appeared since the last call; they are grabbed
+// right away while grabbing is on. Stores up to max_fds of their fds and returns
+// the number stored; call again until it returns 0
+int handle_hotplug(int *fds, int max_fds);
+
+// Close a device and drop it from the table (after capture_input_batch() returned -1)
+void remove_input_device(int fd);
+
+// Stable number of the device behind fd (in get_device_fds() order for the devices
+// found at startup, counting up for hotplugged ones), -1 if unknown
+int get_device_index(int fd);
+
+// Device names indexed by get_device_index(), NULL for ids without a device.
+// Returns one past the highest id stored (0 if none)
+int get_device_names(const char **names, int max_names);
+
+InputDeviceClass get_device_class(int fd);
+
+// Per-device capture counters in get_device_fds() order. Returns the number stored
+int get_device_stats(InputDeviceStats *stats, int max_stats);
 void set_device_grab(int grab);
 void cleanup_input_capture(void);
 
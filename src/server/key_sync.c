@@ -18,6 +18,16 @@ static int xtest_available = 0;
 // X11 keycodes are typically evdev keycodes + 8
 #define X11_KEYCODE_OFFSET 8
 
+// 256-bit key state (one bit per keycode) as 64-bit words
+#define KEY_STATE_WORDS 4
+
+static void load_key_words(const uint8_t *bytes, size_t len, uint64_t words[KEY_STATE_WORDS]) {
+    memset(words, 0, KEY_STATE_WORDS * sizeof(uint64_t));
+    for (size_t i = 0; i < len && i < KEY_STATE_WORDS * 8; i++) {
+        words[i / 8] |= (uint64_t)bytes[i] << (8 * (i % 8));
+    }
+}
+
 int key_sync_init(void) {
     // Open X11 display for querying keyboard state and injecting events
     x_display = XOpenDisplay(NULL);
@@ -83,23 +93,24 @@ int key_sync_on_mode_switch(void) {
     char x11_key_states[32] = {0};
     XQueryKeymap(x_display, x11_key_states);
 
-    // Compare X11 state with hardware state
-    // X11 uses keycodes starting from 8 (evdev keycode + 8)
-    for (int x11_keycode = 8; x11_keycode < 256; x11_keycode++) {
-        int linux_keycode = x11_keycode - X11_KEYCODE_OFFSET;
-        if (linux_keycode < 0 || linux_keycode >= 256) {
-            continue;
-        }
-
-        // Check if X11 thinks this key is pressed
-        int x11_pressed = (x11_key_states[x11_keycode / 8] >> (x11_keycode % 8)) & 1;
-        
-        // Check if hardware reports this key as pressed
-        int hw_pressed = (hw_key_states[linux_keycode / 8] >> (linux_keycode % 8)) & 1;
-
-        // If X11 thinks key is pressed but hardware says it's not,
-        // we need to inject a release event
-        if (x11_pressed && !hw_pressed) {
+    // Compare X11 state with hardware state a word at a time: bit k of the
+    // hardware words is evdev keycode k, and X11 keycode k + 8 is the same key.
+    // Only keys X11 holds but the hardware does not are visited
+    uint64_t x11_words[KEY_STATE_WORDS];
+    uint64_t hw_words[KEY_STATE_WORDS];
+    load_key_words((const uint8_t *)x11_key_states + X11_KEYCODE_OFFSET / 8,
+                   sizeof(x11_key_states) - X11_KEYCODE_OFFSET / 8, x11_words);
+    load_key_words(hw_key_states, sizeof(hw_key_states), hw_words);
+
+    for (int w = 0; w < KEY_STATE_WORDS; w++) {
+        uint64_t stuck = x11_words[w] & ~hw_words[w];
+        while (stuck) {
+            int linux_keycode = w * 64 + __builtin_ctzll(stuck);
+            int x11_keycode = linux_keycode + X11_KEYCODE_OFFSET;
+            stuck &= stuck - 1;
+
+            // X11 thinks the key is pressed but hardware says it's not,
+            // we need to inject a release event
             printf("[KEY_SYNC] X11 stuck key detected: linux_keycode=%d (0x%02X), x11_keycode=%d\n", 
                    linux_keycode, linux_keycode, x11_keycode);
             
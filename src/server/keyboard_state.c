@@ -93,10 +93,28 @@ static const uint8_t linux_to_hid_keymap[256] = {
     [126] = 231     // KEY_RIGHTMETA -> Right GUI (Win key)
 };
 
+// Two views of the same state: the 6KRO boot report sent as KEYBOARD_REPORT, and
+// one bit per HID usage (no rollover limit) for KEYBOARD_KEYS and lookups
 static HIDKeyboardReport current_report = {0};
+static KeyBitmap current_keys = {{0}};
 
 void keyboard_state_init(void) {
     memset(&current_report, 0, sizeof(HIDKeyboardReport));
+    memset(&current_keys, 0, sizeof(current_keys));
+}
+
+static int key_bitmap_test(uint8_t usage) {
+    return (current_keys.words[usage / 64] >> (usage % 64)) & 1;
+}
+
+// Returns 1 if the key's bit changed
+static int key_bitmap_update(uint8_t usage, uint8_t value) {
+    uint64_t bit = 1ull << (usage % 64);
+    uint64_t *word = &current_keys.words[usage / 64];
+    uint64_t old = *word;
+
+    *word = value ? (old | bit) : (old & ~bit);
+    return *word != old;
 }
 
 static int find_key_in_report(uint8_t keycode) {
@@ -133,14 +151,15 @@ static int add_key_to_report(uint8_t keycode) {
     return -1;
 }
 
-int keyboard_state_process_key(uint16_t linux_keycode, uint8_t value, HIDKeyboardReport *report) {
-    if (!report || linux_keycode >= 256) {
+// Returns the HID usage for a Linux keycode, 0 if it has none
+static uint8_t lookup_usage(uint16_t linux_keycode, uint8_t value) {
+    if (linux_keycode >= 256) {
         return 0;
     }
 
     uint8_t hid_keycode = linux_to_hid_keymap[linux_keycode];
 
-    if (hid_keycode == 0 && linux_keycode != 57) {
+    if (hid_keycode == 0) {
         if (value) {
             fprintf(stderr, "[WARNING] Unknown key pressed: linux_keycode=%u (0x%02X)\n", linux_keycode, linux_keycode);
         }
@@ -150,72 +169,63 @@ int keyboard_state_process_key(uint16_t linux_keycode, uint8_t value, HIDKeyboar
     if (value) {
         fprintf(stderr, "[DEBUG] Key: linux=%u hid=%u\n", linux_keycode, hid_keycode);
     }
+    return hid_keycode;
+}
 
-    int state_changed = 0;
+// Apply one key event to both views. Returns 1 if the 6KRO report changed
+// (modifier events always count, as before), *bitmap_changed tells about the bitmap
+static int apply_key(uint8_t hid_keycode, uint8_t value, int *bitmap_changed) {
+    *bitmap_changed = key_bitmap_update(hid_keycode, value);
 
-    switch (hid_keycode) {
-        case 224:  // LCtrl
-            if (value) current_report.modifiers |= MODIFIER_LEFT_CTRL;
-            else current_report.modifiers &= ~MODIFIER_LEFT_CTRL;
-            state_changed = 1;
-            break;
-        case 228:  // RCtrl
-            if (value) current_report.modifiers |= MODIFIER_RIGHT_CTRL;
-            else current_report.modifiers &= ~MODIFIER_RIGHT_CTRL;
-            state_changed = 1;
-            break;
-        case 225:  // LShift
-            if (value) current_report.modifiers |= MODIFIER_LEFT_SHIFT;
-            else current_report.modifiers &= ~MODIFIER_LEFT_SHIFT;
-            state_changed = 1;
-            break;
-        case 229:  // RShift
-            if (value) current_report.modifiers |= MODIFIER_RIGHT_SHIFT;
-            else current_report.modifiers &= ~MODIFIER_RIGHT_SHIFT;
-            state_changed = 1;
-            break;
-        case 226:  // LAlt
-            if (value) current_report.modifiers |= MODIFIER_LEFT_ALT;
-            else current_report.modifiers &= ~MODIFIER_LEFT_ALT;
-            state_changed = 1;
-            break;
-        case 230:  // RAlt
-            if (value) current_report.modifiers |= MODIFIER_RIGHT_ALT;
-            else current_report.modifiers &= ~MODIFIER_RIGHT_ALT;
-            state_changed = 1;
-            break;
-        case 227:  // LGUI (Left Win key)
-            if (value) current_report.modifiers |= MODIFIER_LEFT_GUI;
-            else current_report.modifiers &= ~MODIFIER_LEFT_GUI;
-            state_changed = 1;
-            break;
-        case 231:  // RGUI (Right Win key)
-            if (value) current_report.modifiers |= MODIFIER_RIGHT_GUI;
-            else current_report.modifiers &= ~MODIFIER_RIGHT_GUI;
-            state_changed = 1;
-            break;
-        default:
-            if (value) {
-                if (add_key_to_report(hid_keycode) > 0) {
-                    state_changed = 1;
-                }
-            } else {
-                remove_key_from_report(hid_keycode);
-                state_changed = 1;
-            }
-            break;
+    if (hid_keycode >= KEY_USAGE_LEFT_CTRL) {
+        // Modifier usages 0xE0-0xE7 are the bits of the modifier byte, in order
+        uint8_t modifier = (uint8_t)(1u << (hid_keycode - KEY_USAGE_LEFT_CTRL));
+        if (value) current_report.modifiers |= modifier;
+        else current_report.modifiers &= (uint8_t)~modifier;
+        return 1;
     }
 
-    if (state_changed) {
-        memcpy(report, &current_report, sizeof(HIDKeyboardReport));
-        return 1;
+    if (value) {
+        return add_key_to_report(hid_keycode) > 0;
+    }
+    remove_key_from_report(hid_keycode);
+    return 1;
+}
+
+int keyboard_state_process_key(uint16_t linux_keycode, uint8_t value, HIDKeyboardReport *report) {
+    if (!report) {
+        return 0;
     }
 
-    return 0;
+    uint8_t hid_keycode = lookup_usage(linux_keycode, value);
+    int bitmap_changed;
+
+    if (hid_keycode == 0 || !apply_key(hid_keycode, value, &bitmap_changed)) {
+        return 0;
+    }
+    memcpy(report, &current_report, sizeof(HIDKeyboardReport));
+    return 1;
+}
+
+int keyboard_state_process_key_bitmap(uint16_t linux_keycode, uint8_t value, uint8_t *usage) {
+    if (!usage) {
+        return 0;
+    }
+
+    uint8_t hid_keycode = lookup_usage(linux_keycode, value);
+    int bitmap_changed;
+
+    if (hid_keycode == 0) {
+        return 0;
+    }
+    apply_key(hid_keycode, value, &bitmap_changed);
+    *usage = hid_keycode;
+    return bitmap_changed;
 }
 
 void keyboard_state_reset(HIDKeyboardReport *report) {
     memset(&current_report, 0, sizeof(HIDKeyboardReport));
+    memset(&current_keys, 0, sizeof(current_keys));
     if (report) {
         memcpy(report, &current_report, sizeof(HIDKeyboardReport));
     }
@@ -225,6 +235,10 @@ const HIDKeyboardReport* keyboard_state_get_current(void) {
     return &current_report;
 }
 
+const KeyBitmap* keyboard_state_get_keys(void) {
+    return &current_keys;
+}
+
 int keyboard_state_is_key_pressed(uint16_t linux_keycode) {
     if (linux_keycode >= 256) {
         return 0;
@@ -234,27 +248,5 @@ int keyboard_state_is_key_pressed(uint16_t linux_keycode) {
     if (hid_keycode == 0) {
         return 0;
     }
-
-    // Check modifiers
-    switch (hid_keycode) {
-        case 224:  // LCtrl
-            return (current_report.modifiers & MODIFIER_LEFT_CTRL) != 0;
-        case 228:  // RCtrl
-            return (current_report.modifiers & MODIFIER_RIGHT_CTRL) != 0;
-        case 225:  // LShift
-            return (current_report.modifiers & MODIFIER_LEFT_SHIFT) != 0;
-        case 229:  // RShift
-            return (current_report.modifiers & MODIFIER_RIGHT_SHIFT) != 0;
-        case 226:  // LAlt
-            return (current_report.modifiers & MODIFIER_LEFT_ALT) != 0;
-        case 230:  // RAlt
-            return (current_report.modifiers & MODIFIER_RIGHT_ALT) != 0;
-        case 227:  // LGUI (Left Win key)
-            return (current_report.modifiers & MODIFIER_LEFT_GUI) != 0;
-        case 231:  // RGUI (Right Win key)
-            return (current_report.modifiers & MODIFIER_RIGHT_GUI) != 0;
-        default:
-            // Check regular keys
-            return find_key_in_report(hid_keycode) >= 0;
-    }
+    return key_bitmap_test(hid_keycode);
 }
@@ -4,15 +4,30 @@
 #include <stdint.h>
 #include "common/protocol.h"
 
+// One bit per HID usage 0x00-0xFF (bit usage % 64 of words[usage / 64]),
+// modifiers included as usages 0xE0-0xE7
+#define KEY_BITMAP_WORDS 4
+typedef struct {
+    uint64_t words[KEY_BITMAP_WORDS];
+} KeyBitmap;
+
+#define KEY_USAGE_LEFT_CTRL 0xE0   // first modifier usage
+
 void keyboard_state_init(void);
 
+// 6KRO: copy the boot-format report into *report when it changed.
+// A seventh simultaneous key is left out of the report (but tracked in the bitmap)
 int keyboard_state_process_key(uint16_t linux_keycode, uint8_t value, HIDKeyboardReport *report);
 
+// NKRO: O(1) bitmap update. Returns 1 if the key's bit changed, with its HID usage in *usage
+int keyboard_state_process_key_bitmap(uint16_t linux_keycode, uint8_t value, uint8_t *usage);
+
 void keyboard_state_reset(HIDKeyboardReport *report);
 
 // Get current software keyboard state
 // Returns pointer to internal state (do not modify)
 const HIDKeyboardReport* keyboard_state_get_current(void);
+const KeyBitmap* keyboard_state_get_keys(void);
 
 // Check if a specific Linux keycode is pressed in software state
 int keyboard_state_is_key_pressed(uint16_t linux_keycode);
@@ -0,0 +1,134 @@
+#include "latency.h"
+#include <stdio.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define SUB_BUCKET_BITS 5
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define MAX_VALUE_BITS 40   // values are clamped below 2^40 ns (about 18 minutes)
+#define BUCKET_COUNT ((MAX_VALUE_BITS - SUB_BUCKET_BITS) * SUB_BUCKETS + SUB_BUCKETS)
+
+typedef struct {
+    atomic_uint_fast64_t buckets[BUCKET_COUNT];
+    atomic_uint_fast64_t max;
+} Histogram;
+
+static Histogram histograms[LATENCY_STAGE_COUNT];
+
+static const char *stage_names[LATENCY_STAGE_COUNT] = {
+    [LATENCY_READ] = "read (input age)",
+    [LATENCY_TRANSLATE] = "state machine",
+    [LATENCY_KEYBOARD] = "keyboard_state",
+    [LATENCY_PACE] = "pacer hold",
+    [LATENCY_ENCODE] = "encode",
+    [LATENCY_WRITE] = "write (input age)",
+    [LATENCY_WRITE_CALL] = "write() syscall",
+    [LATENCY_ACK_MOUSE] = "ack rtt mouse",
+    [LATENCY_ACK_KEYBOARD] = "ack rtt keyboard",
+    [LATENCY_ACK_CONTROL] = "ack rtt control",
+    [LATENCY_INPUT_TO_USB] = "input -> usb host",
+};
+
+// Values below 2 * SUB_BUCKETS get a bucket each; above that each power of two
+// is split into SUB_BUCKETS equal parts
+static int bucket_index(uint64_t value) {
+    if (value < 2 * SUB_BUCKETS) {
+        return (int)value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - SUB_BUCKET_BITS;
+    return shift * SUB_BUCKETS + (int)(value >> shift);
+}
+
+// Upper bound of the values that land in bucket index
+static uint64_t bucket_value(int index) {
+    if (index < 2 * SUB_BUCKETS) {
+        return (uint64_t)index;
+    }
+    int shift = index / SUB_BUCKETS - 1;
+    uint64_t sub = (uint64_t)(index % SUB_BUCKETS + SUB_BUCKETS);
+    return ((sub + 1) << shift) - 1;
+}
+
+uint64_t latency_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void latency_record(LatencyStage stage, uint64_t ns) {
+    if (stage >= LATENCY_STAGE_COUNT) {
+        return;
+    }
+    Histogram *h = &histograms[stage];
+    if (ns >= (1ull << MAX_VALUE_BITS)) {
+        ns = (1ull << MAX_VALUE_BITS) - 1;
+    }
+
+    atomic_fetch_add_explicit(&h->buckets[bucket_index(ns)], 1, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (ns > max &&
+           !atomic_compare_exchange_weak_explicit(&h->max, &max, ns,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+void latency_record_since(LatencyStage stage, uint64_t start_ns) {
+    if (start_ns == 0) {
+        return;
+    }
+    uint64_t now = latency_now_ns();
+    // Timestamps from a device that ignored EVIOCSCLOCKID may be on another clock
+    latency_record(stage, now > start_ns ? now - start_ns : 0);
+}
+
+// Buckets are read one by one while other threads may still record, so the
+// percentiles come from a snapshot that can be off by the events in flight
+static void print_histogram(const char *name, Histogram *h) {
+    static const double quantiles[] = {0.50, 0.99, 0.999};
+    uint64_t values[3] = {0};
+    uint64_t total = 0;
+    uint64_t snapshot[BUCKET_COUNT];
+
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        snapshot[i] = atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        total += snapshot[i];
+    }
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+
+    if (total == 0) {
+        printf("[LATENCY] %-18s %10s\n", name, "no samples");
+        return;
+    }
+
+    for (int q = 0; q < 3; q++) {
+        uint64_t rank = (uint64_t)(quantiles[q] * (double)total);
+        uint64_t seen = 0;
+        if (rank == 0) {
+            rank = 1;
+        }
+        for (int i = 0; i < BUCKET_COUNT; i++) {
+            seen += snapshot[i];
+            if (seen >= rank) {
+                values[q] = bucket_value(i);
+                break;
+            }
+        }
+        if (values[q] > max) {
+            values[q] = max;
+        }
+    }
+
+    printf("[LATENCY] %-18s %10llu  %10.2f %10.2f %10.2f %10.2f\n", name,
+           (unsigned long long)total, values[0] / 1000.0, values[1] / 1000.0,
+           values[2] / 1000.0, max / 1000.0);
+}
+
+void latency_print(void) {
+    printf("[LATENCY] %-18s %10s  %10s %10s %10s %10s\n", "stage (us)", "count",
+           "p50", "p99", "p99.9", "max");
+    for (int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+        print_histogram(stage_names[i], &histograms[i]);
+    }
+}
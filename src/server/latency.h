@@ -0,0 +1,39 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+// Per-stage latency histograms. Recording is lock-free (relaxed atomic counters)
+// and safe from any thread; buckets are log-linear like HdrHistogram, with 32
+// sub-buckets per power of two (about 3% relative error).
+//
+// Input-age stages measure from the kernel evdev timestamp of the input event
+// (CLOCK_MONOTONIC) to the end of the stage; the others are the duration of the
+// stage itself.
+
+typedef enum {
+    LATENCY_READ,       // input age when read() returned it to us
+    LATENCY_TRANSLATE,  // process_event() duration, per event
+    LATENCY_KEYBOARD,   // keyboard_state_process_key() duration, per key event
+    LATENCY_PACE,       // time motion waited in the pacer for its slot, per update
+    LATENCY_ENCODE,     // encode and frame one message in the writer
+    LATENCY_WRITE,      // input age when the write() carrying its message returned
+    LATENCY_WRITE_CALL, // duration of one transport write() / send() call
+    LATENCY_ACK_MOUSE,      // frame written -> dongle ack, frames with mouse messages
+    LATENCY_ACK_KEYBOARD,   // frame written -> dongle ack, frames with keyboard reports
+    LATENCY_ACK_CONTROL,    // frame written -> dongle ack, frames without HID output
+    LATENCY_INPUT_TO_USB,   // input age when the USB host took the resulting HID report
+    LATENCY_STAGE_COUNT
+} LatencyStage;
+
+uint64_t latency_now_ns(void);
+
+void latency_record(LatencyStage stage, uint64_t ns);
+
+// Record now minus start_ns; start_ns == 0 means "no timestamp" and is ignored
+void latency_record_since(LatencyStage stage, uint64_t start_ns);
+
+// Print count, p50, p99, p99.9 and max per stage
+void latency_print(void);
+
+#endif // LATENCY_H
@@ -0,0 +1,229 @@
+#include "link.h"
+#include "uart.h"
+#include "common/protocol.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LINK_PREAMBLE_FRAMES 24        // bad frames that make the dongle fall back to its boot rate
+#define LINK_TEST_MESSAGES_PER_FRAME 16
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int write_all(int fd, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = write(fd, data, len);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("UART write failed");
+            return -1;
+        }
+        data += sent;
+        len -= (size_t)sent;
+    }
+    return 0;
+}
+
+int link_switch_baud_rate(int fd, int boot_baud, int link_baud) {
+    uint8_t preamble[LINK_PREAMBLE_FRAMES * 2];
+    uint8_t payload[MSG_MAX_ENCODED_SIZE];
+    uint8_t frame[FRAME_MAX_ENCODED_SIZE];
+    struct timespec settle = {0, 20 * 1000000L};
+    Message msg;
+
+    if (link_baud == boot_baud) {
+        return 0;
+    }
+
+    // A dongle left at a higher rate by a previous session sees this as garbage;
+    // one still at the boot rate sees a run of undecodable one-byte frames.
+    // Either way it ends up at its boot rate, ready for LINK_CONFIG.
+    for (int i = 0; i < LINK_PREAMBLE_FRAMES; i++) {
+        preamble[i * 2] = 0x55;
+        preamble[i * 2 + 1] = FRAME_DELIMITER;
+    }
+    if (write_all(fd, preamble, sizeof(preamble)) != 0) {
+        return -1;
+    }
+    uart_drain(fd);
+    nanosleep(&settle, NULL);
+
+    msg_link_config(&msg, (uint32_t)link_baud);
+    size_t len = msg_encode(&msg, PROTOCOL_V2, payload, sizeof(payload));
+    len = frame_encode(0, payload, len, frame, sizeof(frame));
+    if (write_all(fd, frame, len) != 0) {
+        return -1;
+    }
+    uart_drain(fd);
+    nanosleep(&settle, NULL);
+
+    if (uart_set_baud_rate(fd, link_baud) != 0) {
+        return -1;
+    }
+    uart_flush_input(fd);
+    printf("Link switched from %d to %d baud\n", boot_baud, link_baud);
+    return 0;
+}
+
+typedef struct {
+    uint64_t bytes_sent;
+    uint64_t frames_sent;
+    uint64_t frames_received;
+    uint64_t messages_received;
+    uint64_t acks_received;     // a dongle acknowledges frames instead of echoing them
+    uint64_t payload_errors;    // frames that decoded but carried unexpected content
+} LinkTestCounters;
+
+static size_t build_test_frame(uint8_t seq, uint32_t *sequence, uint8_t *frame, size_t cap) {
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    size_t len = 0;
+    Message msg;
+
+    for (int i = 0; i < LINK_TEST_MESSAGES_PER_FRAME; i++) {
+        msg_link_test(&msg, (*sequence)++);
+        len += msg_encode(&msg, PROTOCOL_V2, payload + len, sizeof(payload) - len);
+    }
+    return frame_encode(seq, payload, len, frame, cap);
+}
+
+static void check_test_payload(const uint8_t *payload, size_t len, LinkTestCounters *counters) {
+    size_t pos = 0;
+    Message msg;
+
+    while (pos < len) {
+        int n = msg_decode(payload + pos, len - pos, &msg);
+        if (n <= 0 || (msg.type != MSG_LINK_TEST && msg.type != MSG_ACK)) {
+            counters->payload_errors++;
+            return;
+        }
+        if (msg.type == MSG_ACK) {
+            counters->acks_received++;
+        } else {
+            counters->messages_received++;
+        }
+        pos += (size_t)n;
+    }
+}
+
+int link_run_test(int fd, int baud_rate, int seconds) {
+    uint8_t frame[FRAME_MAX_ENCODED_SIZE];
+    uint8_t rx[4096];
+    size_t frame_len = 0;
+    size_t frame_pos = 0;
+    uint8_t seq = 0;
+    uint32_t sequence = 0;
+    FrameDecoder decoder;
+    LinkTestCounters counters = {0};
+
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        perror("Failed to make UART non-blocking");
+        return -1;
+    }
+
+    frame_decoder_init(&decoder);
+    uart_flush_input(fd);
+    printf("Link test: streaming frames at %d baud for %d s...\n", baud_rate, seconds);
+
+    uint64_t start = now_ns();
+    uint64_t deadline = start + (uint64_t)seconds * 1000000000ull;
+    uint64_t tx_end = start;
+    int sending = 1;
+
+    // Keep reading for a short grace period after the last frame so the echo can arrive
+    while (sending || now_ns() < tx_end + 200000000ull) {
+        struct pollfd pfd = {fd, POLLIN | (sending ? POLLOUT : 0), 0};
+        if (poll(&pfd, 1, 50) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll failed");
+            break;
+        }
+
+        if (pfd.revents & POLLOUT) {
+            if (frame_pos == frame_len) {
+                frame_len = build_test_frame(seq++, &sequence, frame, sizeof(frame));
+                frame_pos = 0;
+            }
+            ssize_t sent = write(fd, frame + frame_pos, frame_len - frame_pos);
+            if (sent > 0) {
+                frame_pos += (size_t)sent;
+                counters.bytes_sent += (uint64_t)sent;
+                if (frame_pos == frame_len) {
+                    counters.frames_sent++;
+                }
+            } else if (sent < 0 && errno != EAGAIN && errno != EINTR) {
+                perror("UART write failed");
+                break;
+            }
+        }
+
+        if (pfd.revents & POLLIN) {
+            ssize_t len = read(fd, rx, sizeof(rx));
+            for (ssize_t i = 0; i < len; i++) {
+                uint8_t frame_seq;
+                const uint8_t *payload;
+                size_t payload_len;
+                if (frame_decoder_feed(&decoder, rx[i], &frame_seq, &payload, &payload_len)) {
+                    counters.frames_received++;
+                    check_test_payload(payload, payload_len, &counters);
+                }
+            }
+        }
+
+        // Stop only on a frame boundary so the receiver never sees a torn frame
+        if (sending && frame_pos == frame_len && now_ns() >= deadline) {
+            uart_drain(fd);
+            sending = 0;
+            tx_end = now_ns();
+        }
+    }
+
+    fcntl(fd, F_SETFL, flags);
+
+    double elapsed = (double)(tx_end - start) / 1e9;
+    double bytes_per_s = elapsed > 0 ? (double)counters.bytes_sent / elapsed : 0;
+    double wire_capacity = baud_rate / 10.0;   // 8N1: 10 bits per byte
+
+    printf("[LINK] sent %llu frames (%llu messages), %llu bytes in %.2f s\n",
+           (unsigned long long)counters.frames_sent,
+           (unsigned long long)counters.frames_sent * LINK_TEST_MESSAGES_PER_FRAME,
+           (unsigned long long)counters.bytes_sent, elapsed);
+    printf("[LINK] throughput %.0f bytes/s, %.1f%% of %d baud wire capacity\n",
+           bytes_per_s, wire_capacity > 0 ? bytes_per_s * 100.0 / wire_capacity : 0.0, baud_rate);
+
+    if (counters.frames_received == 0 && decoder.stats.crc_errors == 0 &&
+        decoder.stats.format_errors == 0) {
+        printf("[LINK] nothing came back: loop TX to RX or run against a pty echo to measure errors\n");
+        return 0;
+    }
+
+    uint64_t bad = decoder.stats.crc_errors + decoder.stats.format_errors + counters.payload_errors;
+    uint64_t lost = counters.frames_sent > counters.frames_received ?
+                    counters.frames_sent - counters.frames_received : 0;
+    printf("[LINK] received %llu frames (%llu messages): crc errors %u, format errors %u, "
+           "payload errors %llu, sequence gaps %u\n",
+           (unsigned long long)counters.frames_received,
+           (unsigned long long)counters.messages_received,
+           decoder.stats.crc_errors, decoder.stats.format_errors,
+           (unsigned long long)counters.payload_errors, decoder.stats.seq_gaps);
+    if (counters.acks_received > 0) {
+        printf("[LINK] dongle acknowledged %llu frames\n", (unsigned long long)counters.acks_received);
+    }
+    printf("[LINK] frame error rate %.6f (%llu bad, %llu missing of %llu sent)\n",
+           counters.frames_sent ? (double)(bad + lost) / (double)counters.frames_sent : 0.0,
+           (unsigned long long)bad, (unsigned long long)lost,
+           (unsigned long long)counters.frames_sent);
+    return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef LINK_H
+#define LINK_H
+
+// Link setup and diagnostics on an open UART fd (v2 framed protocol only)
+
+// Move the link from boot_baud (the dongle's power-on rate) to link_baud.
+// Sends a resync preamble and a LINK_CONFIG frame at boot_baud, waits for it
+// to drain, then retunes the local port. Returns 0 on success, -1 on failure
+int link_switch_baud_rate(int fd, int boot_baud, int link_baud);
+
+// Stream LINK_TEST frames for the given number of seconds while decoding
+// whatever comes back on the same fd (TX-RX loopback or a pty echo), then
+// print achieved throughput and the frame error rate. Returns 0 on success
+int link_run_test(int fd, int baud_rate, int seconds);
+
+#endif // LINK_H
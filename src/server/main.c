@@ -9,21 +9,62 @@
 #include <termios.h>
 #include <sys/ioctl.h>
 #include <stdarg.h>
+#include <getopt.h>
 #include <linux/input.h>
 #include <time.h>
 #include <sched.h>
 #include <pthread.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/stat.h>
 #include "common/protocol.h"
 #include "input_capture.h"
 #include "state_machine.h"
 #include "keyboard_state.h"
 #include "key_sync.h"
+#include "transmit.h"
+#include "uart.h"
+#include "transport.h"
+#include "link.h"
+#include "latency.h"
+#include "ack.h"
+#include "trace.h"
+#include "pacer.h"
+
+#define MAX_EPOLL_EVENTS 16
+#define STATS_MAX_DEVICES 32
+
+// How often a pty with no peer is checked for a reopened slave side
+#define TRANSPORT_RECHECK_MS 200
+
+#define HEARTBEAT_INTERVAL_S 30
+#define HEARTBEAT_STEP_MS 5
+#define HEARTBEAT_STEPS 5
 
 static int running = 1;
-static int uart_fd = -1;
+static Transport transport = {.fd = -1};
+static int transport_waiting_for_peer = 0;     // pty hung up, re-armed once a peer reopens it
 static struct termios saved_termios;
 
+static int epoll_fd = -1;
+static int signal_fd = -1;
+static int heartbeat_timer_fd = -1;
+static int heartbeat_mouse_moved = 0;
+
+// --record: every captured batch is appended to the trace
+static TraceWriter trace_writer;
+static int recording = 0;
+
+// Capture and translate stage counters (event loop thread only)
+static struct {
+    uint64_t reads;            // capture_input_batch() calls that returned events
+    uint64_t events;           // input events captured
+    uint32_t max_batch;        // most events one read returned (kernel queue depth seen)
+    uint64_t messages;         // messages produced by the state machine
+} pipeline_stats;
+
 static void set_raw_terminal_mode(void) {
     struct termios raw;
     tcgetattr(STDIN_FILENO, &saved_termios);
@@ -38,111 +79,705 @@ static void restore_terminal_mode(void) {
     tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_termios);
 }
 
-void signal_handler(int sig) {
-    if (sig == SIGINT || sig == SIGTERM) {
-        running = 0;
-        printf("\nShutting down...\n");
-    }
-}
-
 void emergency_cleanup(void) {
     printf("\nEmergency cleanup - releasing all input devices...\n");
     restore_terminal_mode();
+    transmit_stop();
+    if (recording) {
+        trace_writer_close(&trace_writer);
+        recording = 0;
+    }
     set_device_grab(0);
     key_sync_cleanup();
     cleanup_input_capture();
+    transport_close(&transport);
+}
+
+int init_transport(const char *spec, int baud_rate) {
+    if (transport_open(&transport, spec, baud_rate) != 0) {
+        return -1;
+    }
+
+    printf("Transport initialized: %s\n", transport.description);
+    return 0;
+}
+
+static void print_pipeline_stats(void) {
+    TransmitStats tx;
+    TransportStats io;
+    AckStats acks;
+    transmit_get_stats(&tx);
+    transport_get_stats(&transport, &io);
+    ack_get_stats(&acks);
+
+    printf("[STATS] capture:   %llu events in %llu reads, max batch %u\n",
+           (unsigned long long)pipeline_stats.events, (unsigned long long)pipeline_stats.reads,
+           pipeline_stats.max_batch);
+    InputDeviceStats devices[STATS_MAX_DEVICES];
+    int num_devices = get_device_stats(devices, STATS_MAX_DEVICES);
+    for (int i = 0; i < num_devices; i++) {
+        const InputDeviceStats *d = &devices[i];
+        if (d->reads == 0) {
+            continue;
+        }
+        printf("[STATS]   device %d (%s%s): %llu events in %llu reads, max batch %u, "
+               "%llu full reads, input age %.1f us avg, %.1f us max\n",
+               d->index, d->name, d->device_class == INPUT_CLASS_KEYBOARD ? ", keyboard" : "",
+               (unsigned long long)d->events, (unsigned long long)d->reads, d->max_batch,
+               (unsigned long long)d->full_reads,
+               (double)d->age_ns_total / (double)d->events / 1000.0, (double)d->age_ns_max / 1000.0);
+    }
+    printf("[STATS] translate: %llu messages\n", (unsigned long long)pipeline_stats.messages);
+    PacerStats pace;
+    pacer_get_stats(&pace);
+    if (pace.slot_us > 0) {
+        printf("[STATS] pacer:     %llu motion messages in %llu updates, %llu passed through, "
+               "slot %u us (min %u, max %u), widened %llu times\n",
+               (unsigned long long)pace.motion_in, (unsigned long long)pace.updates,
+               (unsigned long long)pace.passthrough, pace.slot_us, pace.slot_us_min,
+               pace.slot_us_max, (unsigned long long)pace.slot_raises);
+    }
+    printf("[STATS] tx queue:  depth %u/%u, high water %u, %llu producer stalls\n",
+           tx.queue_depth, tx.queue_capacity, tx.queue_high_water,
+           (unsigned long long)tx.producer_stalls);
+    printf("[STATS] transmit:  %llu/%llu messages in %llu frames, %llu bytes, %llu writes, %llu errors\n",
+           (unsigned long long)tx.messages_written, (unsigned long long)tx.messages_queued,
+           (unsigned long long)tx.frames_written, (unsigned long long)tx.bytes_written,
+           (unsigned long long)tx.write_calls, (unsigned long long)tx.write_errors);
+    printf("[STATS] transport: %s, %llu calls, %.2f us avg, %.2f us max per write, %llu bytes read, "
+           "%llu dropped\n",
+           transport.description, (unsigned long long)io.write_calls,
+           io.write_calls ? (double)io.write_ns / (double)io.write_calls / 1000.0 : 0.0,
+           (double)io.write_ns_max / 1000.0, (unsigned long long)io.bytes_read,
+           (unsigned long long)io.bytes_dropped);
+    if (acks.frames_tracked > 0) {
+        printf("[STATS] acks:      %llu/%llu frames acked, %llu delivered to USB host, "
+               "%llu never acked, %llu stray\n",
+               (unsigned long long)acks.acks, (unsigned long long)acks.frames_tracked,
+               (unsigned long long)acks.hid_delivered, (unsigned long long)acks.unacked,
+               (unsigned long long)acks.stray_acks);
+    }
+}
+
+static int epoll_add_events(int fd, uint32_t events) {
+    struct epoll_event ev = {0};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        perror("epoll_ctl failed");
+        return -1;
+    }
+    return 0;
+}
 
-    if (uart_fd >= 0) {
-        close(uart_fd);
+static int epoll_add(int fd) {
+    return epoll_add_events(fd, EPOLLIN);
+}
+
+// A socket peer that closes its end only reports EPOLLIN (read returns 0 from then on);
+// EPOLLRDHUP makes that visible too
+static int epoll_add_transport(void) {
+    return epoll_add_events(transport.fd, EPOLLIN | EPOLLRDHUP);
+}
+
+// Arm a timerfd: first expiry after value_ms, then every interval_ms (0 = one-shot, 0/0 = disarm)
+static void arm_timer(int fd, long value_ms, long interval_ms) {
+    struct itimerspec its = {0};
+    its.it_value.tv_sec = value_ms / 1000;
+    its.it_value.tv_nsec = (value_ms % 1000) * 1000000L;
+    its.it_interval.tv_sec = interval_ms / 1000;
+    its.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+    timerfd_settime(fd, 0, &its, NULL);
+}
+
+// Consume a timerfd expiration so it stops reporting readable
+static void ack_timer(int fd) {
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        perror("timerfd read failed");
     }
 }
 
-int init_uart(const char *port, int baud_rate) {
-    struct termios tty;
-    speed_t baud;
+static int init_event_loop(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGUSR1);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) != 0) {
+        perror("sigprocmask failed");
+        return -1;
+    }
 
-    uart_fd = open(port, O_RDWR | O_NOCTTY | O_SYNC);
-    if (uart_fd < 0) {
-        perror("Failed to open UART device");
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    heartbeat_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll_fd < 0 || signal_fd < 0 || heartbeat_timer_fd < 0) {
+        perror("Failed to create event loop descriptors");
         return -1;
     }
 
-    switch (baud_rate) {
-        case 230400: baud = B230400; break;
-        case 460800: baud = B460800; break;
-        case 921600: baud = B921600; break;
-        default: baud = B115200; break;
+    if (epoll_add(signal_fd) != 0 || epoll_add(heartbeat_timer_fd) != 0) {
+        return -1;
+    }
+    if (transport_is_readable(&transport) && epoll_add_transport() != 0) {
+        return -1;
     }
 
-    if (tcgetattr(uart_fd, &tty) != 0) {
-        perror("tcgetattr failed");
-        close(uart_fd);
+    if (get_hotplug_fd() >= 0 && epoll_add(get_hotplug_fd()) != 0) {
         return -1;
     }
 
-    cfsetospeed(&tty, baud);
-    cfsetispeed(&tty, baud);
+    int num_fds = get_device_count();
+    int *device_fds = calloc((size_t)num_fds + 1, sizeof(int));
+    if (!device_fds) {
+        return -1;
+    }
+    num_fds = get_device_fds(device_fds, num_fds);
+    for (int i = 0; i < num_fds; i++) {
+        if (epoll_add(device_fds[i]) != 0) {
+            free(device_fds);
+            return -1;
+        }
+    }
+    free(device_fds);
 
-    tty.c_cflag &= ~PARENB;
-    tty.c_cflag &= ~CSTOPB;
-    tty.c_cflag &= ~CSIZE;
-    tty.c_cflag |= CS8;
-    tty.c_cflag &= ~CRTSCTS;
-    tty.c_cflag |= CREAD | CLOCAL;
+    arm_timer(heartbeat_timer_fd, HEARTBEAT_INTERVAL_S * 1000, HEARTBEAT_INTERVAL_S * 1000);
+    return 0;
+}
 
-    tty.c_lflag &= ~ICANON;
-    tty.c_lflag &= ~ECHO;
-    tty.c_lflag &= ~ECHOE;
-    tty.c_lflag &= ~ECHONL;
-    tty.c_lflag &= ~ISIG;
+static void cleanup_event_loop(void) {
+    int *fds[] = {&heartbeat_timer_fd, &signal_fd, &epoll_fd};
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (*fds[i] >= 0) {
+            close(*fds[i]);
+            *fds[i] = -1;
+        }
+    }
+}
 
-    tty.c_iflag &= ~(IXON | IXOFF | IXANY);
+static void handle_signal(void) {
+    struct signalfd_siginfo info;
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGINT || info.ssi_signo == SIGTERM) {
+            running = 0;
+            printf("\nShutting down...\n");
+        } else if (info.ssi_signo == SIGUSR1) {
+            latency_print();
+        }
+    }
+}
 
-    tty.c_oflag &= ~OPOST;
+// LOCAL mode keeps the target awake with a short wiggle every HEARTBEAT_INTERVAL_S.
+// The timer runs at the 30 s period and switches to HEARTBEAT_STEP_MS while a wiggle is in flight.
+static void handle_heartbeat(void) {
+    Message msg;
 
-    tty.c_cc[VMIN] = 0;
-    tty.c_cc[VTIME] = 10;
+    ack_timer(heartbeat_timer_fd);
 
-    if (tcsetattr(uart_fd, TCSANOW, &tty) != 0) {
-        perror("tcsetattr failed");
-        close(uart_fd);
-        return -1;
+    if (get_current_state() != STATE_LOCAL) {
+        if (heartbeat_mouse_moved > 0) {
+            heartbeat_mouse_moved = 0;
+            arm_timer(heartbeat_timer_fd, HEARTBEAT_INTERVAL_S * 1000, HEARTBEAT_INTERVAL_S * 1000);
+        }
+        return;
     }
 
-    printf("UART initialized: %s at %d baud\n", port, baud_rate);
-    return 0;
+    if (heartbeat_mouse_moved == 0) {
+        printf("[HEARTBEAT] Starting mouse movement heartbeat\n");
+        heartbeat_mouse_moved = HEARTBEAT_STEPS;
+        arm_timer(heartbeat_timer_fd, HEARTBEAT_STEP_MS, HEARTBEAT_STEP_MS);
+        return;
+    }
+
+    int xy_move = (heartbeat_mouse_moved % 2 == 0) ? 1 : -1;
+    heartbeat_mouse_moved--;
+    msg_mouse_move(&msg, xy_move, xy_move);
+    transmit_submit(&msg, NULL, 1);
+
+    if (heartbeat_mouse_moved == 0) {
+        printf("[HEARTBEAT] Mouse movement heartbeat sent\n");
+        arm_timer(heartbeat_timer_fd, HEARTBEAT_INTERVAL_S * 1000, HEARTBEAT_INTERVAL_S * 1000);
+    }
+}
+
+// Kernel timestamp of the input event behind each message in the batch
+static uint64_t batch_input_ns[MESSAGE_BATCH_CAPACITY];
+
+static void send_batch(MessageBatch *batch) {
+    pipeline_stats.messages += (uint64_t)batch->count;
+    pacer_submit(batch->messages, batch_input_ns, batch->count);
+    msg_batch_reset(batch);
 }
 
-void send_message(Message *msg) {
-    if (uart_fd >= 0 && msg) {
-        int sent = write(uart_fd, msg, sizeof(Message));
-        if (sent != sizeof(Message)) {
-            fprintf(stderr, "UART write error: %s\n", strerror(errno));
+// Translate one read() worth of events and hand the messages to the transmit stage.
+// input_ns overrides the event timestamps for the latency histograms (0 = use them)
+static void process_input_batch(const InputEvent *events, int count, uint64_t input_ns) {
+    static MessageBatch batch;
+
+    if (count > 0) {
+        pipeline_stats.reads++;
+        pipeline_stats.events += (uint64_t)count;
+        if ((uint32_t)count > pipeline_stats.max_batch) {
+            pipeline_stats.max_batch = (uint32_t)count;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        const InputEvent *event = &events[i];
+
+        if (get_current_state() == STATE_LOCAL) {
+            // Devices are not grabbed in LOCAL mode; only PAUSE matters here
+            if (event->type != EV_KEY || event->code != KEY_PAUSE || event->value != 1) {
+                continue;
+            }
+            if (heartbeat_mouse_moved > 0) {
+                printf("[HEARTBEAT] Canceling pending mouse movements before mode switch\n");
+                heartbeat_mouse_moved = 0;
+                arm_timer(heartbeat_timer_fd, HEARTBEAT_INTERVAL_S * 1000, HEARTBEAT_INTERVAL_S * 1000);
+            }
+        }
+
+        if (msg_batch_space(&batch) < MAX_MESSAGES_PER_EVENT) {
+            send_batch(&batch);
+        }
+        uint64_t start = latency_now_ns();
+        int first = batch.count;
+        int appended = process_event(event, &batch);
+        latency_record_since(LATENCY_TRANSLATE, start);
+        for (int m = first; m < first + appended; m++) {
+            batch_input_ns[m] = input_ns ? input_ns : event->time_ns;
         }
     }
+
+    send_batch(&batch);
+}
+
+static void handle_device_input(int fd, uint32_t revents) {
+    InputEvent events[INPUT_BATCH_SIZE];
+
+    // One read per wakeup; level-triggered epoll brings us back if more is queued
+    int count = capture_input_batch(fd, events, INPUT_BATCH_SIZE);
+    uint64_t read_done = latency_now_ns();
+    for (int i = 0; i < count; i++) {
+        latency_record(LATENCY_READ, read_done > events[i].time_ns ? read_done - events[i].time_ns : 0);
+    }
+
+    if (recording && count > 0 &&
+        trace_write_batch(&trace_writer, get_device_index(fd), events, count) != 0) {
+        fprintf(stderr, "Recording stopped\n");
+        trace_writer_close(&trace_writer);
+        recording = 0;
+    }
+
+    process_input_batch(events, count, 0);
+
+    // A removed device reports HUP/ERR forever under level-triggered epoll; keep
+    // reading until its held keys have been released, then evict it
+    if (count < 0 || (count == 0 && (revents & (EPOLLHUP | EPOLLERR)))) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        remove_input_device(fd);
+    }
+}
+
+// One read per ready device per wakeup, keyboards before pointing devices, so a
+// key press never queues behind a burst of motion from a high-rate mouse. Among
+// devices of one class this is round-robin: epoll hands level-triggered fds that
+// are still readable back at the tail of its ready list.
+static void drain_ready_devices(const struct epoll_event *ready, int count) {
+    static const InputDeviceClass order[] = {INPUT_CLASS_KEYBOARD, INPUT_CLASS_POINTER};
+
+    for (size_t pass = 0; pass < sizeof(order) / sizeof(order[0]); pass++) {
+        for (int i = 0; i < count && running && !should_exit(); i++) {
+            if (get_device_class(ready[i].data.fd) == order[pass]) {
+                handle_device_input(ready[i].data.fd, ready[i].events);
+            }
+        }
+    }
+}
+
+static void handle_input_hotplug(void) {
+    int fds[16];
+    int count;
+
+    while ((count = handle_hotplug(fds, 16)) > 0) {
+        for (int i = 0; i < count; i++) {
+            epoll_add(fds[i]);
+        }
+    }
+}
+
+// The level-triggered fd would report the hangup on every epoll_wait. A pty only
+// has no peer for now: the event loops check it every TRANSPORT_RECHECK_MS
+// (transport_epoll_timeout) and register it again once a peer reopens it
+static void transport_hangup(void) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, transport.fd, NULL);
+    if (transport_hangup_is_transient(&transport)) {
+        fprintf(stderr, "%s has no peer, polling for acks again once one connects\n",
+                transport.description);
+        transport_waiting_for_peer = 1;
+    } else {
+        fprintf(stderr, "%s hangup, no longer polling for input\n", transport.description);
+    }
+}
+
+static void transport_check_peer(void) {
+    struct pollfd pfd = {transport.fd, POLLIN, 0};
+
+    if (!transport_waiting_for_peer || poll(&pfd, 1, 0) < 0 || (pfd.revents & (POLLHUP | POLLERR))) {
+        return;
+    }
+    if (epoll_add_transport() == 0) {
+        transport_waiting_for_peer = 0;
+        fprintf(stderr, "%s peer connected, polling for acks\n", transport.description);
+    }
+}
+
+static int transport_epoll_timeout(int timeout_ms) {
+    if (transport_waiting_for_peer && (timeout_ms < 0 || timeout_ms > TRANSPORT_RECHECK_MS)) {
+        return TRANSPORT_RECHECK_MS;
+    }
+    return timeout_ms;
+}
+
+// The dongle sends back frame acks (v2). One read per wakeup: with VMIN=0/VTIME>0
+// a read on an empty port would block for VTIME.
+static void handle_transport_input(uint32_t revents) {
+    uint8_t buf[256];
+    ssize_t len;
+
+    if (revents & (EPOLLHUP | EPOLLERR)) {
+        transport_hangup();
+        return;
+    }
+    len = transport_read(&transport, buf, sizeof(buf));
+    if (len < 0) {
+        if (errno != EAGAIN) {
+            fprintf(stderr, "%s read error: %s\n", transport.description, strerror(errno));
+        }
+        return;
+    }
+    // End of stream: the socket peer closed its side. A serial port reads 0 when
+    // the pending bytes were flushed after the wakeup, which is not a hangup
+    if (len == 0) {
+        if (!transport_is_serial(&transport)) {
+            transport_hangup();
+        }
+        return;
+    }
+    ack_receive(buf, (size_t)len);
+}
+
+// Block until CLOCK_MONOTONIC reaches deadline_ns, still answering signals and
+// dongle acks. With poll_only just handle what is pending. Returns -1 on shutdown
+static int wait_replay_deadline(int timer_fd, uint64_t deadline_ns, int poll_only) {
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+
+    if (!poll_only) {
+        struct itimerspec its = {0};
+        its.it_value.tv_sec = (time_t)(deadline_ns / 1000000000ull);
+        its.it_value.tv_nsec = (long)(deadline_ns % 1000000000ull);
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+    }
+
+    while (running && !should_exit()) {
+        int n = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, transport_epoll_timeout(poll_only ? 0 : -1));
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait failed");
+            return -1;
+        }
+        transport_check_peer();
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == signal_fd) {
+                handle_signal();
+            } else if (fd == transport.fd) {
+                handle_transport_input(events[i].events);
+            } else if (fd == timer_fd) {
+                ack_timer(timer_fd);
+                return 0;
+            }
+        }
+        if (poll_only) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// --replay: feed a recorded trace through the same translate/transmit path as
+// live input. Messages are written synchronously, one write per recorded read(),
+// so the output bytes depend only on the trace, not on timing or scheduling
+static int run_replay(const char *trace_path, uint64_t from_ns, int fast, int protocol_version) {
+    TraceReader trace;
+    int timer_fd;
+    sigset_t mask;
+
+    if (trace_reader_open(&trace, trace_path) != 0) {
+        return -1;
+    }
+    printf("Replaying %s: %llu events from %d device(s)%s\n", trace_path,
+           (unsigned long long)trace.record_count, trace.header->device_count,
+           fast ? ", as fast as possible" : "");
+    for (int i = 0; i < trace.header->device_count; i++) {
+        if (trace.devices[i].name[0] == '\0') {
+            continue;
+        }
+        printf("  device %d: %.*s\n", i, TRACE_DEVICE_NAME_SIZE, trace.devices[i].name);
+    }
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll_fd < 0 || signal_fd < 0 || timer_fd < 0 ||
+        epoll_add(signal_fd) != 0 || epoll_add(timer_fd) != 0) {
+        perror("Failed to create replay event loop");
+        trace_reader_close(&trace);
+        return -1;
+    }
+    if (transport_is_readable(&transport)) {
+        epoll_add_transport();
+    }
+
+    init_state_machine();
+    set_combined_mouse_reports(protocol_version == PROTOCOL_V2);
+    keyboard_state_init();
+    transmit_start_sync(&transport, protocol_version);
+    // Pacing depends on wall-clock timing; replay output must depend only on the trace
+    pacer_init(0, 0);
+
+    uint64_t next = from_ns ? trace_reader_find_time(&trace, from_ns) : 0;
+    while (next > 0 && next < trace.record_count && !(trace.records[next].flags & TRACE_READ_START)) {
+        next--;
+    }
+
+    // Recorded timestamps are shifted onto the current clock; only their spacing matters
+    uint64_t first_ns = next < trace.record_count ? trace.records[next].time_ns : 0;
+    uint64_t replay_start = latency_now_ns();
+    uint64_t batches = 0;
+
+    while (running && !should_exit() && next < trace.record_count) {
+        InputEvent events[INPUT_BATCH_SIZE];
+        int count = 0;
+
+        do {
+            const TraceRecord *record = &trace.records[next++];
+            events[count].type = record->type;
+            events[count].code = record->code;
+            events[count].value = record->value;
+            events[count].time_ns = replay_start +
+                (record->time_ns > first_ns ? record->time_ns - first_ns : 0);
+            count++;
+        } while (next < trace.record_count && count < INPUT_BATCH_SIZE &&
+                 !(trace.records[next].flags & TRACE_READ_START));
+
+        if (wait_replay_deadline(timer_fd, events[0].time_ns, fast) != 0) {
+            break;
+        }
+        process_input_batch(events, count, fast ? latency_now_ns() : 0);
+        batches++;
+    }
+
+    printf("Replay %s after %llu reads\n", next < trace.record_count ? "stopped" : "finished",
+           (unsigned long long)batches);
+
+    transmit_stop();
+    close(timer_fd);
+    cleanup_event_loop();
+    cleanup_state_machine();
+    trace_reader_close(&trace);
+    return 0;
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options] [transport] [baud_rate]\n", prog);
+    printf("  transport is where the messages go (default /dev/ttyACM0):\n");
+    printf("%s", TRANSPORT_USAGE);
+    printf("  baud_rate is the dongle's boot rate (default 230400)\n");
+    printf("  -p, --protocol N     Wire protocol: 2 = compact (default), 1 = fixed 9-byte for older dongles\n");
+    printf("  -b, --link-baud N    Switch the link to N baud (up to %d) after connecting\n", UART_MAX_BAUD_RATE);
+    printf("  -t, --link-test SEC  Measure link throughput and error rate for SEC seconds, then exit\n");
+    printf("  -l, --max-frame-latency USEC\n");
+    printf("                       Hold messages up to USEC microseconds to pack more into\n");
+    printf("                       each write (default 0: send whatever is ready at once)\n");
+    printf("  -P, --pace USEC      Send mouse motion at most once per USEC, merging what\n");
+    printf("                       arrives in between (default %d: one USB poll; 0 = off)\n",
+           PACER_DEFAULT_SLOT_US);
+    printf("  -n, --nkro           Send key changes for the dongle's N-key rollover keyboard\n");
+    printf("                       instead of 6-key boot reports (protocol v2 and a dongle that knows them)\n");
+    printf("  -r, --record FILE    Record all captured input to FILE\n");
+    printf("  -R, --replay FILE    Replay a recorded session instead of capturing input\n");
+    printf("  -f, --fast           Replay as fast as possible instead of at the recorded pace\n");
+    printf("  -s, --replay-from SEC\n");
+    printf("                       Start the replay about SEC seconds into the recording\n");
+    printf("  -h, --help           Show this help\n");
 }
 
 int main(int argc, char *argv[]) {
-    Message msg;
-    const char *uart_port = "/dev/ttyACM0";
+    const char *transport_spec = "/dev/ttyACM0";
     int baud_rate = 230400;
+    int link_baud_rate = 0;
+    int link_test_seconds = 0;
+    int max_frame_latency_us = 0;
+    int pace_us = PACER_DEFAULT_SLOT_US;
+    int protocol_version = PROTOCOL_V2;
+    int nkro = 0;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    int replay_fast = 0;
+    double replay_from_seconds = 0;
+
+    static const struct option long_options[] = {
+        {"protocol", required_argument, NULL, 'p'},
+        {"link-baud", required_argument, NULL, 'b'},
+        {"link-test", required_argument, NULL, 't'},
+        {"max-frame-latency", required_argument, NULL, 'l'},
+        {"pace", required_argument, NULL, 'P'},
+        {"nkro", no_argument, NULL, 'n'},
+        {"record", required_argument, NULL, 'r'},
+        {"replay", required_argument, NULL, 'R'},
+        {"fast", no_argument, NULL, 'f'},
+        {"replay-from", required_argument, NULL, 's'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:b:t:l:P:nr:R:fs:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'p':
+                protocol_version = atoi(optarg);
+                if (protocol_version != PROTOCOL_V1 && protocol_version != PROTOCOL_V2) {
+                    fprintf(stderr, "Unsupported protocol version %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'b':
+                link_baud_rate = atoi(optarg);
+                if (link_baud_rate < UART_MIN_BAUD_RATE || link_baud_rate > UART_MAX_BAUD_RATE) {
+                    fprintf(stderr, "Link baud rate %s out of range (%d-%d)\n",
+                            optarg, UART_MIN_BAUD_RATE, UART_MAX_BAUD_RATE);
+                    return 1;
+                }
+                break;
+            case 't':
+                link_test_seconds = atoi(optarg);
+                if (link_test_seconds <= 0) {
+                    fprintf(stderr, "Invalid link test duration %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'l':
+                max_frame_latency_us = atoi(optarg);
+                if (max_frame_latency_us < 0 || max_frame_latency_us > TRANSMIT_MAX_FRAME_LATENCY_US) {
+                    fprintf(stderr, "Frame latency %s out of range (0-%d us)\n",
+                            optarg, TRANSMIT_MAX_FRAME_LATENCY_US);
+                    return 1;
+                }
+                break;
+            case 'P':
+                pace_us = atoi(optarg);
+                if (pace_us < 0 || pace_us > PACER_MAX_SLOT_US) {
+                    fprintf(stderr, "Pace interval %s out of range (0-%d us)\n",
+                            optarg, PACER_MAX_SLOT_US);
+                    return 1;
+                }
+                break;
+            case 'n':
+                nkro = 1;
+                break;
+            case 'r':
+                record_path = optarg;
+                break;
+            case 'R':
+                replay_path = optarg;
+                break;
+            case 'f':
+                replay_fast = 1;
+                break;
+            case 's':
+                replay_from_seconds = atof(optarg);
+                if (replay_from_seconds < 0) {
+                    fprintf(stderr, "Invalid replay start %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
 
-    if (argc > 1) {
-        uart_port = argv[1];
+    if (optind < argc) {
+        transport_spec = argv[optind];
     }
-    if (argc > 2) {
-        baud_rate = atoi(argv[2]);
-        if (baud_rate != 115200 && baud_rate != 230400 &&
-            baud_rate != 460800 && baud_rate != 921600) {
-            fprintf(stderr, "Warning: Unsupported baud rate %d, using 230400\n", baud_rate);
-            baud_rate = 230400;
-        }
+    if (optind + 1 < argc) {
+        baud_rate = atoi(argv[optind + 1]);
     }
+    if (protocol_version == PROTOCOL_V1 && (link_baud_rate || link_test_seconds)) {
+        fprintf(stderr, "--link-baud and --link-test need protocol v2\n");
+        return 1;
+    }
+    // v1 dongles only know the fixed 9-byte messages and would drop every KEYBOARD_KEYS
+    if (protocol_version == PROTOCOL_V1 && nkro) {
+        fprintf(stderr, "--nkro needs protocol v2\n");
+        return 1;
+    }
+    if (replay_path && (record_path || link_test_seconds)) {
+        fprintf(stderr, "--replay cannot be combined with --record or --link-test\n");
+        return 1;
+    }
+    set_nkro_keyboard(nkro);
 
     printf("OneKM Server v2.0.0 (UART Mode)\n");
-    printf("Using UART device: %s at %d baud\n", uart_port, baud_rate);
+    printf("Using transport: %s at %d baud, protocol v%d\n", transport_spec, baud_rate, protocol_version);
+
+    if (link_test_seconds > 0) {
+        // Link diagnostics only: no input devices are grabbed
+        if (init_transport(transport_spec, baud_rate) != 0) {
+            return 1;
+        }
+        if (!transport_is_serial(&transport)) {
+            fprintf(stderr, "--link-test needs a serial port\n");
+            transport_close(&transport);
+            return 1;
+        }
+        int link_rate = link_baud_rate ? link_baud_rate : baud_rate;
+        int result = link_switch_baud_rate(transport.fd, baud_rate, link_rate);
+        if (result == 0) {
+            result = link_run_test(transport.fd, link_rate, link_test_seconds);
+        }
+        transport_close(&transport);
+        return result == 0 ? 0 : 1;
+    }
+
+    if (replay_path) {
+        // No input devices are opened: the trace is the only input
+        if (init_transport(transport_spec, baud_rate) != 0) {
+            return 1;
+        }
+        if (link_baud_rate && transport_is_serial(&transport) &&
+            link_switch_baud_rate(transport.fd, baud_rate, link_baud_rate) != 0) {
+            fprintf(stderr, "Failed to switch link to %d baud\n", link_baud_rate);
+            transport_close(&transport);
+            return 1;
+        }
+        int result = run_replay(replay_path, (uint64_t)(replay_from_seconds * 1e9),
+                                replay_fast, protocol_version);
+        print_pipeline_stats();
+        latency_print();
+        transport_close(&transport);
+        return result == 0 ? 0 : 1;
+    }
 
-    signal(SIGTERM, signal_handler);
     atexit(emergency_cleanup);
 
     if (init_input_capture() != 0) {
@@ -151,44 +786,82 @@ int main(int argc, char *argv[]) {
     }
 
     init_state_machine();
+    set_combined_mouse_reports(protocol_version == PROTOCOL_V2);
     keyboard_state_init();
 
+    if (record_path) {
+        const char *names[TRACE_MAX_DEVICES];
+        int device_count = get_device_names(names, TRACE_MAX_DEVICES);
+        if (trace_writer_open(&trace_writer, record_path, names, device_count) != 0) {
+            cleanup_input_capture();
+            return 1;
+        }
+        recording = 1;
+        printf("Recording input to %s\n", record_path);
+    }
+
     if (key_sync_init() != 0) {
         fprintf(stderr, "Warning: Failed to initialize key sync module\n");
         fprintf(stderr, "Key synchronization will be disabled\n");
     }
 
-    if (init_uart(uart_port, baud_rate) != 0) {
-        fprintf(stderr, "Failed to initialize UART\n");
+    if (init_transport(transport_spec, baud_rate) != 0) {
+        fprintf(stderr, "Failed to initialize transport\n");
         key_sync_cleanup();
         cleanup_input_capture();
         return 1;
     }
 
-    printf("Ready. Press PAUSE to toggle LOCAL/REMOTE mode\n");
-    printf("Press PAUSE 3 times within 2 seconds to shutdown\n");
-
-    set_raw_terminal_mode();
-    printf("Terminal set to raw mode\n");
+    // Other transports have no baud rate; --link-baud is simply not applicable
+    if (link_baud_rate && transport_is_serial(&transport) &&
+        link_switch_baud_rate(transport.fd, baud_rate, link_baud_rate) != 0) {
+        fprintf(stderr, "Failed to switch link to %d baud\n", link_baud_rate);
+        key_sync_cleanup();
+        cleanup_input_capture();
+        return 1;
+    }
 
-#define MAX_DEVICES 10
+    if (init_event_loop() != 0) {
+        fprintf(stderr, "Failed to initialize event loop\n");
+        cleanup_event_loop();
+        key_sync_cleanup();
+        cleanup_input_capture();
+        return 1;
+    }
 
-    HIDKeyboardReport keyboard_report;
+    // After init_event_loop(): the writer thread must inherit the blocked signal mask
+    if (transmit_start(&transport, protocol_version, (unsigned int)max_frame_latency_us) != 0) {
+        fprintf(stderr, "Failed to start transmit writer\n");
+        cleanup_event_loop();
+        key_sync_cleanup();
+        cleanup_input_capture();
+        return 1;
+    }
 
-    time_t last_heartbeat = 0;
-    const time_t heartbeat_interval = 30;
-    int heartbeat_mouse_moved = 0;
+    // The link budget is the rate the serial port actually runs at; other
+    // transports have none, so only the transmit queue is watched
+    int pace_baud_rate = 0;
+    if (transport_is_serial(&transport)) {
+        pace_baud_rate = link_baud_rate ? link_baud_rate : baud_rate;
+    }
+    if (pacer_init((unsigned int)pace_us, pace_baud_rate) != 0 ||
+        (pacer_get_timer_fd() >= 0 && epoll_add(pacer_get_timer_fd()) != 0)) {
+        fprintf(stderr, "Failed to start mouse pacer\n");
+        transmit_stop();
+        cleanup_event_loop();
+        key_sync_cleanup();
+        cleanup_input_capture();
+        return 1;
+    }
 
-    struct timespec last_mouse_flush = {0, 0};
+    printf("Ready. Press PAUSE to toggle LOCAL/REMOTE mode\n");
+    printf("Press PAUSE 3 times within 2 seconds to shutdown\n");
+    printf("Send SIGUSR1 (kill -USR1 %d) to print latency histograms\n", (int)getpid());
 
-    int device_fds[MAX_DEVICES];
-    int num_fds = get_device_fds(device_fds, MAX_DEVICES);
+    set_raw_terminal_mode();
+    printf("Terminal set to raw mode\n");
 
-    struct pollfd pollfds[MAX_DEVICES];
-    for (int i = 0; i < num_fds; i++) {
-        pollfds[i].fd = device_fds[i];
-        pollfds[i].events = POLLIN;
-    }
+    struct epoll_event events[MAX_EPOLL_EVENTS];
 
     while (running) {
         if (should_exit()) {
@@ -196,104 +869,54 @@ int main(int argc, char *argv[]) {
             break;
         }
 
-        int events_processed = 0;
-        ControlState current_state = get_current_state();
-
-        if (current_state == STATE_LOCAL) {
-            time_t current_time = time(NULL);
-
-            if (heartbeat_mouse_moved > 0) {
-                int xy_move = (heartbeat_mouse_moved % 2 == 0) ? 1 : -1;
-                heartbeat_mouse_moved--;
-                msg_mouse_move(&msg, xy_move, xy_move);
-                send_message(&msg);
-                events_processed++;
-
-                if (heartbeat_mouse_moved == 0) {
-                    printf("[HEARTBEAT] Mouse movement heartbeat sent\n");
-                }
-            } else if (last_heartbeat == 0) {
-                last_heartbeat = current_time;
-            } else if (current_time - last_heartbeat >= heartbeat_interval) {
-                printf("[HEARTBEAT] Starting mouse movement heartbeat\n");
-                heartbeat_mouse_moved = 5;
-                last_heartbeat = current_time;
-                events_processed++;
+        int n = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, transport_epoll_timeout(-1));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
             }
+            perror("epoll_wait failed");
+            break;
         }
-
-        if (current_state == STATE_REMOTE) {
-            struct timespec current_ts;
-            clock_gettime(CLOCK_MONOTONIC, &current_ts);
-
-            for (int i = 0; i < 20; i++) {
-                InputEvent event;
-                int captured = capture_input(&event);
-                if (captured == 0) {
-                    if (event.type == EV_KEY && event.code == KEY_PAUSE && event.value == 1 &&
-                        get_current_state() == STATE_LOCAL && heartbeat_mouse_moved > 0) {
-                        printf("[HEARTBEAT] Canceling pending mouse movements before mode switch\n");
-                        heartbeat_mouse_moved = 0;
-                    }
-
-                    if (process_event(&event, &msg)) {
-                        send_message(&msg);
-                        events_processed++;
-                    } else if (get_current_state() == STATE_REMOTE && event.type == EV_KEY) {
-                        if (keyboard_state_process_key(event.code, event.value, &keyboard_report)) {
-                            msg_keyboard_report(&msg, &keyboard_report);
-                            send_message(&msg);
-                            events_processed++;
-                        }
-                    }
-                } else {
-                    break;
-                }
-            }
-
-            if (events_processed == 0) {
-                long time_since_flush = (current_ts.tv_sec - last_mouse_flush.tv_sec) * 1000000 +
-                                       (current_ts.tv_nsec - last_mouse_flush.tv_nsec) / 1000;
-                if (time_since_flush > 5000) {
-                    if (flush_pending_mouse_movement(&msg)) {
-                        send_message(&msg);
-                        events_processed++;
-                    }
-                    last_mouse_flush = current_ts;
-                }
+        transport_check_peer();
+
+        // Control descriptors first; input devices are collected and drained below
+        struct epoll_event ready_devices[MAX_EPOLL_EVENTS];
+        int num_ready = 0;
+        for (int i = 0; i < n && running && !should_exit(); i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == signal_fd) {
+                handle_signal();
+            } else if (fd == heartbeat_timer_fd) {
+                handle_heartbeat();
+            } else if (fd == transport.fd) {
+                handle_transport_input(events[i].events);
+            } else if (fd == get_hotplug_fd()) {
+                handle_input_hotplug();
+            } else if (fd == pacer_get_timer_fd()) {
+                pacer_on_timer();
             } else {
-                last_mouse_flush = current_ts;
+                ready_devices[num_ready++] = events[i];
             }
-        } else {
-            if (poll(pollfds, num_fds, 1) > 0) {
-                InputEvent event;
-                if (capture_input(&event) == 0) {
-                    if (event.type == EV_KEY && event.code == KEY_PAUSE && event.value == 1) {
-                        process_event(&event, &msg);
-                    }
-                }
-            }
-        }
-
-        int sleep_time;
-        if (current_state == STATE_LOCAL) {
-            sleep_time = heartbeat_mouse_moved > 0 ? 5 : 50;
-        } else {
-            sleep_time = events_processed > 0 ? 0 : 1;
-        }
-
-        if (events_processed == 0 && sleep_time > 0) {
-            usleep(sleep_time * 1000);
         }
+        drain_ready_devices(ready_devices, num_ready);
     }
 
+    cleanup_event_loop();
     cleanup_state_machine();
     key_sync_cleanup();
     cleanup_input_capture();
 
-    if (uart_fd >= 0) {
-        close(uart_fd);
+    pacer_flush();
+    pacer_cleanup();
+    transmit_stop();
+    if (recording) {
+        trace_writer_close(&trace_writer);
+        recording = 0;
     }
+    print_pipeline_stats();
+    latency_print();
+    transport_close(&transport);
 
     printf("Server shutdown complete\n");
     return 0;
@@ -0,0 +1,351 @@
+#include "pacer.h"
+#include "transmit.h"
+#include "latency.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/timerfd.h>
+
+#define PACER_UPDATE_BYTES 12                   // MOUSE_REPORT alone in a v2 frame
+#define PACER_ADAPT_INTERVAL_NS 100000000ull    // how often utilisation is checked
+#define PACER_OUT_CAPACITY 64
+
+// Motion merged since the last update
+static struct {
+    int pending;
+    int combined;           // arrived as MOUSE_REPORT (v2), else MOUSE_MOVE/MOUSE_WHEEL
+    int dx;
+    int dy;
+    int wheel_vertical;
+    int wheel_horizontal;
+    int scroll_vertical;    // MOUSE_SCROLL, 1/WHEEL_HI_RES_UNITS detent
+    int scroll_horizontal;
+    uint8_t buttons;        // button mask of the latest MOUSE_REPORT
+    int buttons_changed;
+    uint64_t input_ns;      // oldest input behind the pending motion
+    uint64_t since_ns;      // when the pending motion started waiting
+} motion;
+
+// Messages on their way to transmit_submit()
+static Message out_msgs[PACER_OUT_CAPACITY];
+static uint64_t out_input_ns[PACER_OUT_CAPACITY];
+static int out_count = 0;
+
+static int enabled = 0;
+static int timer_fd = -1;
+static int timer_armed = 0;
+static int link_baud = 0;
+static uint64_t slot_ns;
+static uint64_t min_slot_ns;
+static uint64_t max_slot_ns;
+static uint64_t next_slot_ns;
+static uint64_t adapt_start_ns;
+static uint64_t adapt_start_bytes;
+static PacerStats stats;
+
+static void out_flush(void) {
+    if (out_count > 0) {
+        transmit_submit(out_msgs, out_input_ns, out_count);
+        out_count = 0;
+    }
+}
+
+static Message *out_append(uint64_t input_ns) {
+    if (out_count == PACER_OUT_CAPACITY) {
+        out_flush();
+    }
+    out_input_ns[out_count] = input_ns;
+    return &out_msgs[out_count++];
+}
+
+static int16_t clamp_int16(int value) {
+    return (int16_t)(value > 32767 ? 32767 : (value < -32768 ? -32768 : value));
+}
+
+static int8_t clamp_int8(int value) {
+    return (int8_t)(value > 127 ? 127 : (value < -128 ? -128 : value));
+}
+
+// Queue the pending motion as one update (more messages only if the merged
+// deltas exceed what a message carries)
+static void send_motion(uint64_t now) {
+    if (!motion.pending) {
+        return;
+    }
+    if (!motion.buttons_changed && motion.dx == 0 && motion.dy == 0 &&
+        motion.wheel_vertical == 0 && motion.wheel_horizontal == 0 &&
+        motion.scroll_vertical == 0 && motion.scroll_horizontal == 0) {
+        // Merged motion cancelled out
+        motion.pending = 0;
+        motion.input_ns = 0;
+        return;
+    }
+
+    if (motion.combined) {
+        int report = motion.buttons_changed;
+        while (report || motion.dx != 0 || motion.dy != 0 ||
+               motion.wheel_vertical != 0 || motion.wheel_horizontal != 0) {
+            int16_t dx = clamp_int16(motion.dx);
+            int16_t dy = clamp_int16(motion.dy);
+            int8_t vertical = clamp_int8(motion.wheel_vertical);
+            int8_t horizontal = clamp_int8(motion.wheel_horizontal);
+            msg_mouse_report(out_append(motion.input_ns), motion.buttons, dx, dy, vertical, horizontal);
+            motion.dx -= dx;
+            motion.dy -= dy;
+            motion.wheel_vertical -= vertical;
+            motion.wheel_horizontal -= horizontal;
+            report = 0;
+        }
+    } else {
+        while (motion.dx != 0 || motion.dy != 0) {
+            int16_t dx = clamp_int16(motion.dx);
+            int16_t dy = clamp_int16(motion.dy);
+            msg_mouse_move(out_append(motion.input_ns), dx, dy);
+            motion.dx -= dx;
+            motion.dy -= dy;
+        }
+        while (motion.wheel_vertical != 0 || motion.wheel_horizontal != 0) {
+            int16_t vertical = clamp_int16(motion.wheel_vertical);
+            int16_t horizontal = clamp_int16(motion.wheel_horizontal);
+            msg_mouse_wheel(out_append(motion.input_ns), vertical, horizontal);
+            motion.wheel_vertical -= vertical;
+            motion.wheel_horizontal -= horizontal;
+        }
+    }
+    while (motion.scroll_vertical != 0 || motion.scroll_horizontal != 0) {
+        int16_t vertical = clamp_int16(motion.scroll_vertical);
+        int16_t horizontal = clamp_int16(motion.scroll_horizontal);
+        msg_mouse_scroll(out_append(motion.input_ns), vertical, horizontal);
+        motion.scroll_vertical -= vertical;
+        motion.scroll_horizontal -= horizontal;
+    }
+
+    latency_record(LATENCY_PACE, now - motion.since_ns);
+    motion.pending = 0;
+    motion.buttons_changed = 0;
+    motion.input_ns = 0;
+    stats.updates++;
+    next_slot_ns = now + slot_ns;
+}
+
+static void arm_slot_timer(void) {
+    if (timer_armed) {
+        return;
+    }
+    struct itimerspec its = {0};
+    its.it_value.tv_sec = (time_t)(next_slot_ns / 1000000000ull);
+    its.it_value.tv_nsec = (long)(next_slot_ns % 1000000000ull);
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == 0) {
+        timer_armed = 1;
+    }
+}
+
+// Widen the slot while the link or the transmit queue is saturated, narrow it
+// again once both have settled
+static void adapt_slot(uint64_t now) {
+    if (now - adapt_start_ns < PACER_ADAPT_INTERVAL_NS) {
+        return;
+    }
+
+    TransmitStats tx;
+    transmit_get_stats(&tx);
+    int busy = tx.queue_depth >= PACER_QUEUE_HIGH;
+    int idle = tx.queue_depth <= PACER_QUEUE_LOW;
+    if (link_baud > 0) {
+        // 10 bits per byte on the wire (8N1)
+        double capacity_bits = (double)link_baud * (double)(now - adapt_start_ns) / 1e9;
+        double percent = (double)(tx.bytes_written - adapt_start_bytes) * 10.0 * 100.0 / capacity_bits;
+        busy |= percent >= PACER_BUSY_PERCENT;
+        idle &= percent < PACER_IDLE_PERCENT;
+    }
+
+    if (busy && slot_ns < max_slot_ns) {
+        slot_ns = slot_ns * 2 < max_slot_ns ? slot_ns * 2 : max_slot_ns;
+        stats.slot_raises++;
+    } else if (idle && slot_ns > min_slot_ns) {
+        slot_ns = slot_ns / 2 > min_slot_ns ? slot_ns / 2 : min_slot_ns;
+    }
+    if (slot_ns / 1000 > stats.slot_us_max) {
+        stats.slot_us_max = (uint32_t)(slot_ns / 1000);
+    }
+
+    adapt_start_ns = now;
+    adapt_start_bytes = tx.bytes_written;
+}
+
+static int is_motion(const Message *msg) {
+    switch (msg->type) {
+        case MSG_MOUSE_MOVE:
+        case MSG_MOUSE_WHEEL:
+        case MSG_MOUSE_REPORT:
+        case MSG_MOUSE_SCROLL:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static void merge_motion(const Message *msg, uint64_t input_ns, uint64_t now) {
+    if (!motion.pending) {
+        motion.pending = 1;
+        motion.since_ns = now;
+    }
+    if (input_ns != 0 && (motion.input_ns == 0 || input_ns < motion.input_ns)) {
+        motion.input_ns = input_ns;
+    }
+
+    switch (msg->type) {
+        case MSG_MOUSE_MOVE:
+            motion.dx += msg->data.mouse_move.dx;
+            motion.dy += msg->data.mouse_move.dy;
+            motion.combined = 0;
+            break;
+        case MSG_MOUSE_WHEEL:
+            motion.wheel_vertical += msg->data.mouse_wheel.vertical;
+            motion.wheel_horizontal += msg->data.mouse_wheel.horizontal;
+            motion.combined = 0;
+            break;
+        case MSG_MOUSE_REPORT:
+            motion.dx += msg->data.mouse_report.dx;
+            motion.dy += msg->data.mouse_report.dy;
+            motion.wheel_vertical += msg->data.mouse_report.vertical;
+            motion.wheel_horizontal += msg->data.mouse_report.horizontal;
+            motion.combined = 1;
+            if (msg->data.mouse_report.buttons != motion.buttons) {
+                motion.buttons = msg->data.mouse_report.buttons;
+                motion.buttons_changed = 1;
+            }
+            break;
+        case MSG_MOUSE_SCROLL:
+            // Fractions of a detent add up like motion
+            motion.scroll_vertical += msg->data.mouse_scroll.vertical;
+            motion.scroll_horizontal += msg->data.mouse_scroll.horizontal;
+            break;
+    }
+}
+
+int pacer_init(unsigned int slot_us, int link_baud_rate) {
+    memset(&motion, 0, sizeof(motion));
+    memset(&stats, 0, sizeof(stats));
+    out_count = 0;
+    enabled = slot_us > 0;
+    if (!enabled) {
+        return 0;
+    }
+
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) {
+        perror("Failed to create pacer timer");
+        enabled = 0;
+        return -1;
+    }
+    timer_armed = 0;
+
+    link_baud = link_baud_rate;
+    min_slot_ns = (uint64_t)slot_us * 1000u;
+    if (link_baud > 0) {
+        uint64_t update_ns = (uint64_t)PACER_UPDATE_BYTES * 10u * 1000000000ull / (uint64_t)link_baud;
+        if (2 * update_ns > min_slot_ns) {
+            min_slot_ns = 2 * update_ns;
+        }
+    }
+    max_slot_ns = (uint64_t)PACER_MAX_SLOT_US * 1000u;
+    if (max_slot_ns < min_slot_ns) {
+        max_slot_ns = min_slot_ns;
+    }
+    slot_ns = min_slot_ns;
+    stats.slot_us_min = (uint32_t)(min_slot_ns / 1000);
+    stats.slot_us_max = stats.slot_us_min;
+
+    TransmitStats tx;
+    transmit_get_stats(&tx);
+    next_slot_ns = 0;
+    adapt_start_ns = latency_now_ns();
+    adapt_start_bytes = tx.bytes_written;
+    return 0;
+}
+
+void pacer_submit(const Message *msgs, const uint64_t *input_ns, int count) {
+    if (!enabled) {
+        stats.passthrough += (uint64_t)count;
+        transmit_submit(msgs, input_ns, count);
+        return;
+    }
+
+    uint64_t now = latency_now_ns();
+    adapt_slot(now);
+
+    for (int i = 0; i < count; i++) {
+        uint64_t ns = input_ns ? input_ns[i] : 0;
+
+        if (!is_motion(&msgs[i])) {
+            // Pending motion first, so a click lands where the pointer was
+            send_motion(now);
+            *out_append(ns) = msgs[i];
+            stats.passthrough++;
+            continue;
+        }
+
+        stats.motion_in++;
+        merge_motion(&msgs[i], ns, now);
+        // A button change goes out at once; motion waits for its slot
+        if (motion.buttons_changed || now >= next_slot_ns) {
+            send_motion(now);
+        }
+    }
+
+    if (motion.pending) {
+        arm_slot_timer();
+    }
+    out_flush();
+}
+
+int pacer_get_timer_fd(void) {
+    return enabled ? timer_fd : -1;
+}
+
+void pacer_on_timer(void) {
+    uint64_t expirations;
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        perror("pacer timer read failed");
+    }
+    timer_armed = 0;
+
+    uint64_t now = latency_now_ns();
+    adapt_slot(now);
+    if (!motion.pending) {
+        return;
+    }
+    if (now < next_slot_ns) {
+        // The slot moved (a click sent the motion early, then more arrived)
+        arm_slot_timer();
+        return;
+    }
+    send_motion(now);
+    out_flush();
+}
+
+void pacer_flush(void) {
+    if (!enabled) {
+        return;
+    }
+    send_motion(latency_now_ns());
+    out_flush();
+}
+
+void pacer_get_stats(PacerStats *out) {
+    if (!out) {
+        return;
+    }
+    *out = stats;
+    out->slot_us = enabled ? (uint32_t)(slot_ns / 1000) : 0;
+}
+
+void pacer_cleanup(void) {
+    if (timer_fd >= 0) {
+        close(timer_fd);
+        timer_fd = -1;
+    }
+    enabled = 0;
+}
@@ -0,0 +1,63 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+#include "common/protocol.h"
+
+// Motion pacing between translation and the transmit stage (event loop thread only).
+//
+// The dongle turns at most one report per USB poll into HID output, and the link
+// only carries so many bytes, so mouse motion faster than either just queues up.
+// The pacer divides time into slots and sends at most one motion update per slot,
+// merging everything that arrives in between (deltas add up; nothing is lost).
+// Keyboard reports, button changes and control messages go out at once, preceded
+// by any motion still pending so their order is kept.
+//
+// The slot starts at the larger of the USB poll interval and twice the time one
+// update takes on the link (motion never takes more than half the link). While the
+// link runs above PACER_BUSY_PERCENT of its capacity or the transmit queue backs
+// up, the slot doubles, up to PACER_MAX_SLOT_US; it halves back once both settle.
+// Queueing delay for motion is therefore bounded by one slot whatever the mouse's
+// polling rate.
+
+typedef struct {
+    uint64_t motion_in;         // motion messages received
+    uint64_t updates;           // motion updates sent (each merging one or more)
+    uint64_t passthrough;       // messages passed straight through
+    uint64_t slot_raises;       // times the slot was widened
+    uint32_t slot_us;           // current slot
+    uint32_t slot_us_min;       // slot the pacer returns to when the link is idle
+    uint32_t slot_us_max;       // widest slot used so far
+} PacerStats;
+
+#define PACER_DEFAULT_SLOT_US 1000      // full-speed USB HID, bInterval 1
+#define PACER_MAX_SLOT_US 16000
+#define PACER_BUSY_PERCENT 80
+#define PACER_IDLE_PERCENT 50
+#define PACER_QUEUE_HIGH 32             // transmit queue depth that widens the slot
+#define PACER_QUEUE_LOW 4
+
+// slot_us is the target report interval (0 disables pacing: every message is
+// passed through). link_baud_rate is the serial rate the link runs at, 0 when the
+// transport has none; only the transmit queue depth is watched then.
+// Returns 0 on success, -1 on failure
+int pacer_init(unsigned int slot_us, int link_baud_rate);
+
+// Pass messages on to transmit_submit(), merging motion as described above.
+// input_ns as for transmit_submit()
+void pacer_submit(const Message *msgs, const uint64_t *input_ns, int count);
+
+// timerfd that becomes readable when pending motion is due (-1 when disabled)
+int pacer_get_timer_fd(void);
+
+// Call when the timer fd is readable: sends the pending motion update
+void pacer_on_timer(void);
+
+// Send any pending motion now (before shutdown)
+void pacer_flush(void);
+
+void pacer_get_stats(PacerStats *stats);
+
+void pacer_cleanup(void);
+
+#endif // PACER_H
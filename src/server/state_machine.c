@@ -2,8 +2,10 @@
 #include "input_capture.h"
 #include "keyboard_state.h"
 #include "key_sync.h"
+#include "latency.h"
 #include "common/protocol.h"
 #include <stdio.h>
+#include <string.h>
 #include <linux/input.h>
 #include <time.h>
 #include <unistd.h>
@@ -11,16 +13,25 @@
 static ControlState current_state = STATE_LOCAL;
 static int exit_requested = 0;
 static int pause_press_count = 0;
-static time_t last_pause_press_time = 0;
+static uint64_t last_pause_press_ns = 0;
+
+#define PAUSE_EXIT_WINDOW_NS 2000000000ull
 
 // Note: KEY_PAUSE is used for mode switching - defined in linux/input.h as 119
 
 // Linux input event codes for mouse wheel
 #define REL_WHEEL       0x08
 #define REL_HWHEEL      0x06
+#ifndef REL_WHEEL_HI_RES
+#define REL_WHEEL_HI_RES  0x0b
+#define REL_HWHEEL_HI_RES 0x0c
+#endif
 
 void init_state_machine(void) {
     current_state = STATE_LOCAL;
+    exit_requested = 0;
+    pause_press_count = 0;
+    last_pause_press_ns = 0;
     printf("State machine initialized in LOCAL mode\n");
     printf("Press PAUSE/Break to toggle between LOCAL and REMOTE control\n");
     printf("Press PAUSE/Break 3 times within 2 seconds to exit\n");
@@ -45,52 +56,222 @@ void reset_keyboard_on_switch(void) {
     keyboard_state_reset(NULL);
 }
 
-static int pending_dx = 0;
-static int pending_dy = 0;
-static int last_event_type = -1;
+// Mouse input is coalesced per evdev frame: everything between two SYN_REPORTs
+// is accumulated here and turned into messages once the frame is complete.
+// Wheels with hi-res support report REL_WHEEL_HI_RES (1/120 detent) in every frame
+// that scrolls and REL_WHEEL only once a whole detent has built up, so a frame's
+// scroll is taken from the hi-res axis whenever that axis appeared in the frame.
+typedef struct {
+    int dx;
+    int dy;
+    int wheel_vertical;         // detents (REL_WHEEL)
+    int wheel_horizontal;
+    int hi_res_vertical;        // 1/WHEEL_HI_RES_UNITS detent (REL_WHEEL_HI_RES)
+    int hi_res_horizontal;
+    int has_hi_res_vertical;
+    int has_hi_res_horizontal;
+    int scroll_vertical;        // hi-res scroll still to be sent (MOUSE_SCROLL)
+    int scroll_horizontal;
+    uint8_t buttons;       // button mask as of this frame (bit0=left, bit1=right, bit2=middle)
+    uint8_t buttons_sent;  // button mask the remote has been told about
+} MouseFrame;
 
-static int send_pending_movement(Message *msg) {
-    if (pending_dx != 0 || pending_dy != 0) {
-        // Clamp values to int16_t range to prevent overflow
-        int16_t dx = (int16_t)(pending_dx > 32767 ? 32767 : (pending_dx < -32768 ? -32768 : pending_dx));
-        int16_t dy = (int16_t)(pending_dy > 32767 ? 32767 : (pending_dy < -32768 ? -32768 : pending_dy));
+static MouseFrame mouse_frame = {0};
+static int combined_mouse_reports = 0;
 
-        msg_mouse_move(msg, dx, dy);
+void set_combined_mouse_reports(int enabled) {
+    combined_mouse_reports = enabled;
+}
+
+static int16_t clamp_int16(int value) {
+    return (int16_t)(value > 32767 ? 32767 : (value < -32768 ? -32768 : value));
+}
+
+static int8_t clamp_int8(int value) {
+    return (int8_t)(value > 127 ? 127 : (value < -128 ? -128 : value));
+}
+
+static void reset_mouse_frame(void) {
+    uint8_t buttons_sent = mouse_frame.buttons_sent;
+    memset(&mouse_frame, 0, sizeof(mouse_frame));
+    mouse_frame.buttons = buttons_sent;
+    mouse_frame.buttons_sent = buttons_sent;
+}
+
+static uint8_t mouse_button_bit(uint16_t code) {
+    switch (code) {
+        case BTN_LEFT:   return 1 << (MOUSE_BTN_LEFT - 1);
+        case BTN_RIGHT:  return 1 << (MOUSE_BTN_RIGHT - 1);
+        case BTN_MIDDLE: return 1 << (MOUSE_BTN_MIDDLE - 1);
+        default:         return 0;
+    }
+}
+
+// Move the frame's hi-res wheel input into the scroll still to be sent; the
+// detents it duplicates are dropped. Axes without hi-res input keep their detents
+static void resolve_scroll(void) {
+    if (mouse_frame.has_hi_res_vertical) {
+        mouse_frame.scroll_vertical += mouse_frame.hi_res_vertical;
+        mouse_frame.wheel_vertical = 0;
+    }
+    if (mouse_frame.has_hi_res_horizontal) {
+        mouse_frame.scroll_horizontal += mouse_frame.hi_res_horizontal;
+        mouse_frame.wheel_horizontal = 0;
+    }
+    mouse_frame.hi_res_vertical = 0;
+    mouse_frame.hi_res_horizontal = 0;
+    mouse_frame.has_hi_res_vertical = 0;
+    mouse_frame.has_hi_res_horizontal = 0;
+}
 
-        // Subtract the values we sent (for remaining that didn't fit)
-        pending_dx -= dx;
-        pending_dy -= dy;
+// Append a completed frame as MOUSE_REPORT messages carrying the whole button mask,
+// so button and motion changes can never be applied out of order. Whole-detent
+// wheels ride along in the report; hi-res wheel input follows as MOUSE_SCROLL in
+// 1/120 detents. Normally one message each; deltas beyond a message's range are
+// split across several.
+static int emit_mouse_report(MessageBatch *out) {
+    int appended = 0;
+    Message *msg;
 
-        if (pending_dx == 0 && pending_dy == 0) {
-            last_event_type = -1;
+    resolve_scroll();
+
+    while ((mouse_frame.dx != 0 || mouse_frame.dy != 0 ||
+            mouse_frame.wheel_vertical != 0 || mouse_frame.wheel_horizontal != 0 ||
+            mouse_frame.buttons != mouse_frame.buttons_sent) &&
+           (msg = msg_batch_append(out))) {
+        int16_t dx = clamp_int16(mouse_frame.dx);
+        int16_t dy = clamp_int16(mouse_frame.dy);
+        int8_t vertical = clamp_int8(mouse_frame.wheel_vertical);
+        int8_t horizontal = clamp_int8(mouse_frame.wheel_horizontal);
+        msg_mouse_report(msg, mouse_frame.buttons, dx, dy, vertical, horizontal);
+        mouse_frame.dx -= dx;
+        mouse_frame.dy -= dy;
+        mouse_frame.wheel_vertical -= vertical;
+        mouse_frame.wheel_horizontal -= horizontal;
+        mouse_frame.buttons_sent = mouse_frame.buttons;
+        appended++;
+    }
+
+    while ((mouse_frame.scroll_vertical != 0 || mouse_frame.scroll_horizontal != 0) &&
+           (msg = msg_batch_append(out))) {
+        int16_t vertical = clamp_int16(mouse_frame.scroll_vertical);
+        int16_t horizontal = clamp_int16(mouse_frame.scroll_horizontal);
+        msg_mouse_scroll(msg, vertical, horizontal);
+        mouse_frame.scroll_vertical -= vertical;
+        mouse_frame.scroll_horizontal -= horizontal;
+        appended++;
+    }
+
+    return appended;
+}
+
+// Append the messages of a completed frame: motion first (so buttons act at the new
+// position), then each changed button, then the wheel. Whatever does not fit in the
+// batch stays in the frame and goes out with the next one.
+static int emit_mouse_frame(MessageBatch *out) {
+    int appended = 0;
+    Message *msg;
+
+    if (combined_mouse_reports) {
+        return emit_mouse_report(out);
+    }
+
+    while ((mouse_frame.dx != 0 || mouse_frame.dy != 0) && (msg = msg_batch_append(out))) {
+        // Motion beyond the int16 range is carried over to another message
+        int16_t dx = clamp_int16(mouse_frame.dx);
+        int16_t dy = clamp_int16(mouse_frame.dy);
+        msg_mouse_move(msg, dx, dy);
+        mouse_frame.dx -= dx;
+        mouse_frame.dy -= dy;
+        appended++;
+    }
+
+    for (uint8_t button = MOUSE_BTN_LEFT; button <= MOUSE_BTN_MIDDLE; button++) {
+        uint8_t bit = 1 << (button - 1);
+        if (((mouse_frame.buttons ^ mouse_frame.buttons_sent) & bit) && (msg = msg_batch_append(out))) {
+            uint8_t state = (mouse_frame.buttons & bit) ? BUTTON_PRESSED : BUTTON_RELEASED;
+            msg_mouse_button(msg, button, state);
+            mouse_frame.buttons_sent ^= bit;
+            appended++;
         }
-        return 1;
     }
-    return 0;
+
+    // Older dongles only know whole detents
+    if ((mouse_frame.wheel_vertical != 0 || mouse_frame.wheel_horizontal != 0) &&
+        (msg = msg_batch_append(out))) {
+        msg_mouse_wheel(msg, clamp_int16(mouse_frame.wheel_vertical),
+                        clamp_int16(mouse_frame.wheel_horizontal));
+        mouse_frame.wheel_vertical = 0;
+        mouse_frame.wheel_horizontal = 0;
+        appended++;
+    }
+    mouse_frame.hi_res_vertical = 0;
+    mouse_frame.hi_res_horizontal = 0;
+    mouse_frame.has_hi_res_vertical = 0;
+    mouse_frame.has_hi_res_horizontal = 0;
+
+    return appended;
+}
+
+static int nkro_keyboard = 0;
+
+void set_nkro_keyboard(int enabled) {
+    nkro_keyboard = enabled;
+}
+
+static int emit_keyboard_report(uint16_t code, int32_t value, MessageBatch *out) {
+    HIDKeyboardReport report;
+    uint8_t usage = 0;
+    uint64_t start = latency_now_ns();
+    int changed = nkro_keyboard
+        ? keyboard_state_process_key_bitmap(code, (uint8_t)value, &usage)
+        : keyboard_state_process_key(code, (uint8_t)value, &report);
+
+    latency_record_since(LATENCY_KEYBOARD, start);
+    if (!changed) {
+        return 0;
+    }
+
+    Message *msg = msg_batch_append(out);
+    if (!msg) {
+        return 0;
+    }
+    if (nkro_keyboard) {
+        msg_keyboard_keys(msg, usage, value ? 1 : 0);
+    } else {
+        msg_keyboard_report(msg, &report);
+    }
+    return 1;
 }
 
-int flush_pending_mouse_movement(Message *msg) {
-    return send_pending_movement(msg);
+static int emit_switch(uint8_t state, MessageBatch *out) {
+    Message *msg = msg_batch_append(out);
+    if (!msg) {
+        return 0;
+    }
+    msg_switch(msg, state);
+    return 1;
 }
 
-int process_event(const InputEvent *event, Message *msg) {
-    if (!event || !msg) {
+int process_event(const InputEvent *event, MessageBatch *out) {
+    if (!event || !out) {
         return 0;
     }
 
     // Handle PAUSE/Break key: toggle mode or exit if pressed 3 times
     if (event->type == EV_KEY && event->code == KEY_PAUSE) {
         if (event->value == 1) {
-            time_t current_time = time(NULL);
+            // Timed by the event timestamp, so a replayed trace behaves the same
+            uint64_t current_ns = event->time_ns;
             
             // Check if this press is within 2 seconds of the last press
-            if (current_time - last_pause_press_time <= 2) {
+            if (pause_press_count > 0 && current_ns - last_pause_press_ns <= PAUSE_EXIT_WINDOW_NS) {
                 pause_press_count++;
             } else {
                 // Reset counter if too much time has passed
                 pause_press_count = 1;
             }
-            last_pause_press_time = current_time;
+            last_pause_press_ns = current_ns;
             
             // Check for exit sequence (3 presses within 2 seconds)
             if (pause_press_count >= 3) {
@@ -105,6 +286,7 @@ int process_event(const InputEvent *event, Message *msg) {
             if (current_state == STATE_LOCAL) {
                 // Switch to remote control
                 current_state = STATE_REMOTE;
+                reset_mouse_frame();
                 set_device_grab(1); // Grab devices so input doesn't affect local system
                 
                 // IMPORTANT: After grab, immediately check for stuck keys
@@ -114,12 +296,12 @@ int process_event(const InputEvent *event, Message *msg) {
                 printf("[SYNC] Post-grab: checking for stuck keys on LOCAL...\n");
                 key_sync_on_mode_switch();
                 
-                msg_switch(msg, 1); // 1 = switch to remote
                 printf("Switching to REMOTE control, sending SWITCH message\n");
-                return 1; // Always return 1 to indicate message was prepared
+                return emit_switch(CONTROL_REMOTE, out);
             } else {
                 // Switch to local control
                 current_state = STATE_LOCAL;
+                reset_mouse_frame();
                 set_device_grab(0); // Ungrab devices so input affects local system again
                 
                 // Wait a bit for ungrab to fully take effect
@@ -129,12 +311,11 @@ int process_event(const InputEvent *event, Message *msg) {
                 // pressed in REMOTE mode but released before switching back
                 reset_keyboard_on_switch();
                 
-                msg_switch(msg, 0); // 0 = switch to local
                 printf("Switching to LOCAL control, sending SWITCH message\n");
-                return 1; // Always return 1 to indicate message was prepared
+                return emit_switch(CONTROL_LOCAL, out);
             }
         }
-        return 1;
+        return 0;
     }
 
     // Process events based on current state
@@ -145,72 +326,37 @@ int process_event(const InputEvent *event, Message *msg) {
 
         case STATE_REMOTE:
             // Send events to remote client
-            if (event->type == EV_REL) {
-                if (event->code == REL_X || event->code == REL_Y) {
-                    // Accumulate mouse movement
-                    if (event->code == REL_X) {
-                        pending_dx += event->value;
-                    } else if (event->code == REL_Y) {
-                        pending_dy += event->value;
-                    }
-
-                    // Send immediately if we have movement in both axes
-                    // or if the same axis event occurs twice in a row (rapid movement)
-                    if ((pending_dx != 0 && pending_dy != 0) ||
-                        (last_event_type == event->code && (pending_dx != 0 || pending_dy != 0))) {
-                        int result = send_pending_movement(msg);
-                        return result;
-                    }
-
-                    last_event_type = event->code;
-                } else if (event->code == REL_WHEEL || event->code == REL_HWHEEL) {
-                    // Mouse wheel events - send immediately
-                    int16_t vertical = 0;
-                    int16_t horizontal = 0;
-
-                    if (event->code == REL_WHEEL) {
-                        vertical = event->value; // Use the same direction as Linux input
-                        // printf("[WHEEL] Vertical scroll detected: raw=%d, converted=%d\n", event->value, vertical);
-                    } else {
-                        horizontal = event->value;
-                        // printf("[WHEEL] Horizontal scroll detected: value=%d\n", horizontal);
-                    }
-
-                    // Send any pending mouse movement first
-                    if (pending_dx != 0 || pending_dy != 0) {
-                        // printf("[WHEEL] Has pending mouse movement (dx=%d, dy=%d), will send separately\n", pending_dx, pending_dy);
-                        // Note: We can't send both in one call, so just send wheel event
-                        // The pending movement will be sent on next flush
-                    }
-                    
-                    // Send wheel event
-                    msg_mouse_wheel(msg, vertical, horizontal);
-                    // printf("[WHEEL] Sent wheel event: vertical=%d, horizontal=%d\n", vertical, horizontal);
-                    return 1;
+            if (event->type == EV_SYN && event->code == SYN_REPORT) {
+                // End of the evdev frame: release everything accumulated in it
+                return emit_mouse_frame(out);
+            } else if (event->type == EV_REL) {
+                if (event->code == REL_X) {
+                    mouse_frame.dx += event->value;
+                } else if (event->code == REL_Y) {
+                    mouse_frame.dy += event->value;
+                } else if (event->code == REL_WHEEL) {
+                    mouse_frame.wheel_vertical += event->value; // Same direction as Linux input
+                } else if (event->code == REL_HWHEEL) {
+                    mouse_frame.wheel_horizontal += event->value;
+                } else if (event->code == REL_WHEEL_HI_RES) {
+                    mouse_frame.hi_res_vertical += event->value;
+                    mouse_frame.has_hi_res_vertical = 1;
+                } else if (event->code == REL_HWHEEL_HI_RES) {
+                    mouse_frame.hi_res_horizontal += event->value;
+                    mouse_frame.has_hi_res_horizontal = 1;
                 }
+                return 0;
             } else if (event->type == EV_KEY) {
-                // For non-movement events, send any pending mouse movement first
-                if (pending_dx != 0 || pending_dy != 0) {
-                    send_pending_movement(msg);
-                }
-                // Map Linux key codes to our protocol
-                // Left mouse button
-                if (event->code == BTN_LEFT) {
-                    msg_mouse_button(msg, 1, event->value);
-                    return 1;
-                }
-                // Right mouse button
-                else if (event->code == BTN_RIGHT) {
-                    msg_mouse_button(msg, 2, event->value);
-                    return 1;
-                }
-                // Middle mouse button
-                else if (event->code == BTN_MIDDLE) {
-                    msg_mouse_button(msg, 3, event->value);
-                    return 1;
+                uint8_t bit = mouse_button_bit(event->code);
+                if (bit) {
+                    if (event->value) {
+                        mouse_frame.buttons |= bit;
+                    } else {
+                        mouse_frame.buttons &= ~bit;
+                    }
+                    return 0;
                 }
-                // Return 0, keyboard events are handled via keyboard_state_process_key in main.c
-                return 0;
+                return emit_keyboard_report(event->code, event->value, out);
             }
             break;
     }
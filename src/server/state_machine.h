@@ -11,8 +11,22 @@ typedef enum {
 
 void init_state_machine(void);
 void reset_keyboard_on_switch(void);
-int process_event(const InputEvent *event, Message *msg);
-int flush_pending_mouse_movement(Message *msg);
+// Send each mouse frame as a single MOUSE_REPORT (button mask, motion and wheel)
+// instead of separate MOVE/BUTTON/WHEEL messages, with hi-res wheel input
+// (REL_WHEEL_HI_RES, 1/120 detent) as MOUSE_SCROLL. Older dongles only know
+// the separate messages and whole detents
+void set_combined_mouse_reports(int enabled);
+// Send each key change as KEYBOARD_KEYS (one bit of the dongle's key bitmap)
+// instead of a whole 6KRO KEYBOARD_REPORT, so any number of keys can be held.
+// Needs a dongle that knows KEYBOARD_KEYS
+void set_nkro_keyboard(int enabled);
+// Most messages a single event appends (a frame: motion, three buttons, wheel),
+// barring motion beyond the int16 range which carries over to the next frame
+#define MAX_MESSAGES_PER_EVENT 5
+
+// Translate one input event, appending any resulting messages to out
+// Returns the number of messages appended
+int process_event(const InputEvent *event, MessageBatch *out);
 void cleanup_state_machine(void);
 ControlState get_current_state(void);
 int should_exit(void);
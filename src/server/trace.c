@@ -0,0 +1,245 @@
+#include "trace.h"
+#include "latency.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TRACE_MAGIC "OKMTRACE"
+#define TRACE_FOOTER_MAGIC "OKMINDEX"
+#define TRACE_WRITE_BUFFER (256 * 1024)
+
+int trace_writer_open(TraceWriter *writer, const char *path,
+                      const char *const *device_names, int device_count) {
+    TraceHeader header;
+    struct timespec realtime;
+
+    memset(writer, 0, sizeof(*writer));
+    if (device_count > TRACE_MAX_DEVICES) {
+        device_count = TRACE_MAX_DEVICES;
+    }
+
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        fprintf(stderr, "Failed to create trace %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    setvbuf(writer->file, NULL, _IOFBF, TRACE_WRITE_BUFFER);
+
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    writer->start_ns = latency_now_ns();
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.header_size = (uint16_t)(sizeof(TraceHeader) + (size_t)device_count * sizeof(TraceDevice));
+    header.record_size = sizeof(TraceRecord);
+    header.device_count = (uint16_t)device_count;
+    header.start_ns = writer->start_ns;
+    header.start_realtime_ns = (uint64_t)realtime.tv_sec * 1000000000ull + (uint64_t)realtime.tv_nsec;
+
+    if (fwrite(&header, sizeof(header), 1, writer->file) != 1) {
+        goto fail;
+    }
+    for (int i = 0; i < device_count; i++) {
+        TraceDevice device;
+        memset(&device, 0, sizeof(device));
+        strncpy(device.name, device_names[i] ? device_names[i] : "", sizeof(device.name) - 1);
+        if (fwrite(&device, sizeof(device), 1, writer->file) != 1) {
+            goto fail;
+        }
+    }
+    return 0;
+
+fail:
+    fprintf(stderr, "Failed to write trace header: %s\n", strerror(errno));
+    fclose(writer->file);
+    writer->file = NULL;
+    return -1;
+}
+
+static int add_index_entry(TraceWriter *writer, uint64_t time_ns) {
+    if (writer->index_count == writer->index_capacity) {
+        size_t capacity = writer->index_capacity ? writer->index_capacity * 2 : 256;
+        TraceIndexEntry *index = realloc(writer->index, capacity * sizeof(TraceIndexEntry));
+        if (!index) {
+            return -1;
+        }
+        writer->index = index;
+        writer->index_capacity = capacity;
+    }
+    writer->index[writer->index_count].time_ns = time_ns;
+    writer->index[writer->index_count].record = writer->record_count;
+    writer->index_count++;
+    return 0;
+}
+
+int trace_write_batch(TraceWriter *writer, int device, const InputEvent *events, int count) {
+    if (!writer->file) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        TraceRecord record;
+        uint64_t time_ns = events[i].time_ns > writer->start_ns ? events[i].time_ns - writer->start_ns : 0;
+
+        record.time_ns = time_ns;
+        record.device = device >= 0 && device < TRACE_DEVICE_UNKNOWN ? (uint16_t)device : TRACE_DEVICE_UNKNOWN;
+        record.flags = i == 0 ? TRACE_READ_START : 0;
+        record.type = (uint8_t)events[i].type;
+        record.code = events[i].code;
+        record.value = events[i].value;
+
+        if (writer->record_count % TRACE_INDEX_INTERVAL == 0 && add_index_entry(writer, time_ns) != 0) {
+            return -1;
+        }
+        if (fwrite(&record, sizeof(record), 1, writer->file) != 1) {
+            fprintf(stderr, "Trace write failed: %s\n", strerror(errno));
+            return -1;
+        }
+        writer->record_count++;
+    }
+    return 0;
+}
+
+int trace_writer_close(TraceWriter *writer) {
+    TraceFooter footer;
+    int result = 0;
+
+    if (!writer->file) {
+        return -1;
+    }
+
+    long offset = ftell(writer->file);
+    memset(&footer, 0, sizeof(footer));
+    footer.index_offset = offset < 0 ? 0 : (uint64_t)offset;
+    footer.index_count = writer->index_count;
+    footer.record_count = writer->record_count;
+    memcpy(footer.magic, TRACE_FOOTER_MAGIC, sizeof(footer.magic));
+
+    if ((writer->index_count > 0 &&
+         fwrite(writer->index, sizeof(TraceIndexEntry), writer->index_count, writer->file) != writer->index_count) ||
+        fwrite(&footer, sizeof(footer), 1, writer->file) != 1) {
+        fprintf(stderr, "Failed to write trace index: %s\n", strerror(errno));
+        result = -1;
+    }
+    if (fclose(writer->file) != 0) {
+        result = -1;
+    }
+
+    free(writer->index);
+    writer->file = NULL;
+    writer->index = NULL;
+    return result;
+}
+
+int trace_reader_open(TraceReader *reader, const char *path) {
+    struct stat st;
+
+    memset(reader, 0, sizeof(*reader));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Failed to open trace %s: %s\n", path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(TraceHeader)) {
+        fprintf(stderr, "%s is not a trace (too short)\n", path);
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Failed to map trace");
+        return -1;
+    }
+    reader->map = map;
+    reader->map_size = (size_t)st.st_size;
+    reader->header = map;
+
+    const TraceHeader *header = reader->header;
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != TRACE_VERSION || header->record_size != sizeof(TraceRecord) ||
+        header->header_size > reader->map_size ||
+        header->header_size < sizeof(TraceHeader) + (size_t)header->device_count * sizeof(TraceDevice)) {
+        fprintf(stderr, "%s is not a version %d trace\n", path, TRACE_VERSION);
+        trace_reader_close(reader);
+        return -1;
+    }
+
+    reader->devices = (const TraceDevice *)(reader->map + sizeof(TraceHeader));
+    reader->records = (const TraceRecord *)(reader->map + header->header_size);
+
+    const TraceFooter *footer = NULL;
+    if (reader->map_size >= header->header_size + sizeof(TraceFooter)) {
+        footer = (const TraceFooter *)(reader->map + reader->map_size - sizeof(TraceFooter));
+        if (memcmp(footer->magic, TRACE_FOOTER_MAGIC, sizeof(footer->magic)) != 0 ||
+            footer->index_offset < header->header_size ||
+            footer->index_offset + footer->index_count * sizeof(TraceIndexEntry) >
+                reader->map_size - sizeof(TraceFooter) ||
+            header->header_size + footer->record_count * sizeof(TraceRecord) > footer->index_offset) {
+            footer = NULL;
+        }
+    }
+
+    if (footer) {
+        reader->record_count = footer->record_count;
+        reader->index = (const TraceIndexEntry *)(reader->map + footer->index_offset);
+        reader->index_count = footer->index_count;
+    } else {
+        // Recording did not finish: every complete record is still usable
+        reader->record_count = (reader->map_size - header->header_size) / sizeof(TraceRecord);
+        fprintf(stderr, "Warning: %s has no index (recording interrupted?), %llu records\n",
+                path, (unsigned long long)reader->record_count);
+    }
+    return 0;
+}
+
+uint64_t trace_reader_find_time(const TraceReader *reader, uint64_t time_ns) {
+    uint64_t low = 0;
+    uint64_t high = reader->record_count;
+
+    // Narrow down with the index, then search the records in between
+    if (reader->index && reader->index_count > 0) {
+        uint64_t lo = 0, hi = reader->index_count;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (reader->index[mid].time_ns < time_ns) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo > 0) {
+            low = reader->index[lo - 1].record;
+        }
+        if (lo < reader->index_count) {
+            high = reader->index[lo].record;
+        }
+    }
+
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (reader->records[mid].time_ns < time_ns) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void trace_reader_close(TraceReader *reader) {
+    if (reader->map) {
+        munmap((void *)reader->map, reader->map_size);
+    }
+    memset(reader, 0, sizeof(*reader));
+}
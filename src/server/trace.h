@@ -0,0 +1,121 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include "input_capture.h"
+
+// Input session traces (--record / --replay)
+//
+// Append-only binary file, little endian, readable in place with mmap:
+//
+//   TraceHeader                     magic "OKMTRACE", sizes, start time
+//   TraceDevice[device_count]       device names, indexed by device id
+//   TraceRecord[record_count]       one per captured event, in drain order
+//   TraceIndexEntry[index_count]    every TRACE_INDEX_INTERVAL records
+//   TraceFooter                     where the index is, magic "OKMINDEX"
+//
+// Records are fixed size, so record n is at header_size + n * record_size. The
+// index and footer are written on close; a trace cut short (crash, power loss)
+// has none and is read by scanning, losing nothing but the index.
+//
+// Records are written as the event loop drains the devices (keyboards first on
+// each wakeup), so time_ns is only sorted per device; across devices it can step
+// back by up to one wakeup's worth of events.
+
+#define TRACE_VERSION 2
+#define TRACE_MAX_DEVICES 32
+#define TRACE_DEVICE_NAME_SIZE 64
+#define TRACE_INDEX_INTERVAL 1024
+
+// Set in TraceRecord.flags on the first event of each read() batch, so replay
+// hands the pipeline the same batches the live server saw
+#define TRACE_READ_START 0x01
+
+// TraceRecord.device of events from a device whose id is not known
+#define TRACE_DEVICE_UNKNOWN 0xFFFF
+
+#pragma pack(push, 1)
+
+typedef struct {
+    char magic[8];          // "OKMTRACE"
+    uint16_t version;
+    uint16_t header_size;   // offset of the first record
+    uint16_t record_size;
+    uint16_t device_count;
+    uint64_t start_ns;      // CLOCK_MONOTONIC when recording started
+    uint64_t start_realtime_ns;
+    uint8_t reserved[32];
+} TraceHeader;
+
+typedef struct {
+    char name[TRACE_DEVICE_NAME_SIZE];
+} TraceDevice;
+
+typedef struct {
+    uint64_t time_ns;       // kernel timestamp relative to start_ns
+    uint16_t device;        // get_device_index() (devices plugged in while
+                            // recording have ids >= device_count)
+    uint8_t flags;          // TRACE_READ_START
+    uint8_t type;
+    uint16_t code;
+    int32_t value;
+} TraceRecord;
+
+typedef struct {
+    uint64_t time_ns;
+    uint64_t record;
+} TraceIndexEntry;
+
+typedef struct {
+    uint64_t index_offset;
+    uint64_t index_count;
+    uint64_t record_count;
+    char magic[8];          // "OKMINDEX"
+} TraceFooter;
+
+#pragma pack(pop)
+
+typedef struct {
+    FILE *file;
+    uint64_t start_ns;
+    uint64_t record_count;
+    TraceIndexEntry *index;
+    size_t index_count;
+    size_t index_capacity;
+} TraceWriter;
+
+typedef struct {
+    const uint8_t *map;
+    size_t map_size;
+    const TraceHeader *header;
+    const TraceDevice *devices;
+    const TraceRecord *records;
+    uint64_t record_count;
+    const TraceIndexEntry *index;   // NULL for a trace without footer
+    uint64_t index_count;
+} TraceReader;
+
+// Create path and write the header. device_names[id] names device id (NULL for
+// an unused id). Returns 0 on success, -1 on failure
+int trace_writer_open(TraceWriter *writer, const char *path,
+                      const char *const *device_names, int device_count);
+
+// Append the events of one read() from device. Returns 0 on success, -1 on failure
+int trace_write_batch(TraceWriter *writer, int device, const InputEvent *events, int count);
+
+// Write the index and footer and close the file
+int trace_writer_close(TraceWriter *writer);
+
+// Map a trace for reading. Returns 0 on success, -1 on failure
+int trace_reader_open(TraceReader *reader, const char *path);
+
+// First record at or after time_ns (relative to the trace start). Approximate:
+// records are not strictly time ordered (see above), so the result can be off
+// by the events of one event loop wakeup
+uint64_t trace_reader_find_time(const TraceReader *reader, uint64_t time_ns);
+
+void trace_reader_close(TraceReader *reader);
+
+#endif // TRACE_H
@@ -0,0 +1,344 @@
+#include "transmit.h"
+#include "common/spsc_ring.h"
+#include "latency.h"
+#include "ack.h"
+#include "transport.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/eventfd.h>
+
+#define TX_RING_CAPACITY 1024   // power of two
+#define TX_DRAIN_CHUNK 64
+#define TX_WRITE_BUFFER 4096    // bytes handed to a single write()
+
+// Ring element: the message plus the kernel timestamp of the input that caused it
+typedef struct {
+    Message msg;
+    uint64_t input_ns;      // 0 when not caused by input (heartbeat)
+} TxEntry;
+
+static TxEntry ring_storage[TX_RING_CAPACITY];
+static SpscRing tx_ring;
+
+static Transport *transport = NULL;
+static int protocol_version = PROTOCOL_V2;
+static unsigned int max_latency_us = 0;
+static uint8_t tx_seq = 0;
+static int wakeup_fd = -1;
+static pthread_t writer_thread;
+static int writer_started = 0;
+static int synchronous = 0;     // transmit_start_sync(): no thread, submit writes
+static atomic_int writer_running;
+static atomic_int writer_sleeping;
+
+static atomic_uint_fast64_t messages_queued;
+static atomic_uint_fast64_t messages_written;
+static atomic_uint_fast64_t frames_written;
+static atomic_uint_fast64_t bytes_written;
+static atomic_uint_fast64_t write_calls;
+static atomic_uint_fast64_t write_errors;
+static atomic_uint_fast64_t producer_stalls;
+
+static void wake_writer(void) {
+    uint64_t one = 1;
+    if (write(wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        perror("eventfd write failed");
+    }
+}
+
+static int write_all(const uint8_t *data, size_t remaining) {
+    while (remaining > 0) {
+        ssize_t sent = transport_write(transport, data, remaining);
+        atomic_fetch_add_explicit(&write_calls, 1, memory_order_relaxed);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "%s write error: %s\n", transport->ops->name, strerror(errno));
+            atomic_fetch_add_explicit(&write_errors, 1, memory_order_relaxed);
+            return -1;
+        }
+        data += sent;
+        remaining -= (size_t)sent;
+        atomic_fetch_add_explicit(&bytes_written, (uint64_t)sent, memory_order_relaxed);
+    }
+    return 0;
+}
+
+// Output staged by the writer between write() calls. v2 messages are packed into
+// frames of up to FRAME_MAX_PAYLOAD bytes; v1 messages are simply concatenated.
+static struct {
+    uint8_t out[TX_WRITE_BUFFER];
+    size_t out_len;
+    uint32_t out_messages;          // messages fully contained in out
+    uint64_t out_input_ns[TX_WRITE_BUFFER / 2];  // per message in out (2 bytes is the smallest)
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    size_t payload_len;
+    uint32_t payload_messages;      // messages in the frame being built
+    uint64_t payload_input_ns[FRAME_MAX_PAYLOAD / 2];
+    uint32_t payload_types;         // ACK_TYPE_BIT mask of the frame being built
+    uint64_t payload_oldest_ns;     // oldest input behind the frame being built
+    struct {
+        uint8_t seq;
+        uint32_t types;
+        uint64_t input_ns;
+    } out_frames[TX_WRITE_BUFFER / (FRAME_OVERHEAD + 2)];  // frames in out, for ack tracking
+    uint32_t out_frame_count;
+} staging;
+
+static void close_frame(void) {
+    if (staging.payload_len == 0) {
+        return;
+    }
+    staging.out_frames[staging.out_frame_count].seq = tx_seq;
+    staging.out_frames[staging.out_frame_count].types = staging.payload_types;
+    staging.out_frames[staging.out_frame_count].input_ns = staging.payload_oldest_ns;
+    staging.out_frame_count++;
+    staging.out_len += frame_encode(tx_seq++, staging.payload, staging.payload_len,
+                                    staging.out + staging.out_len,
+                                    sizeof(staging.out) - staging.out_len);
+    memcpy(staging.out_input_ns + staging.out_messages, staging.payload_input_ns,
+           staging.payload_messages * sizeof(uint64_t));
+    staging.out_messages += staging.payload_messages;
+    staging.payload_len = 0;
+    staging.payload_messages = 0;
+    staging.payload_types = 0;
+    staging.payload_oldest_ns = 0;
+    atomic_fetch_add_explicit(&frames_written, 1, memory_order_relaxed);
+}
+
+// Everything staged goes out in a single write() (barring short writes)
+static void flush_staging(void) {
+    if (protocol_version != PROTOCOL_V1) {
+        close_frame();
+    }
+    // Track frames before writing: the ack can arrive before write() returns
+    for (uint32_t i = 0; i < staging.out_frame_count; i++) {
+        ack_frame_sent(staging.out_frames[i].seq, staging.out_frames[i].types,
+                       staging.out_frames[i].input_ns);
+    }
+    if (staging.out_len > 0 && write_all(staging.out, staging.out_len) == 0) {
+        atomic_fetch_add_explicit(&messages_written, staging.out_messages, memory_order_relaxed);
+        for (uint32_t i = 0; i < staging.out_messages; i++) {
+            latency_record_since(LATENCY_WRITE, staging.out_input_ns[i]);
+        }
+    }
+    staging.out_len = 0;
+    staging.out_messages = 0;
+    staging.out_frame_count = 0;
+}
+
+static void stage_message(const TxEntry *entry) {
+    uint8_t encoded[MSG_MAX_ENCODED_SIZE];
+    uint64_t start = latency_now_ns();
+    const Message *msg = &entry->msg;
+    size_t len = msg_encode(msg, protocol_version, encoded, sizeof(encoded));
+
+    if (len == 0) {
+        fprintf(stderr, "Cannot encode message type %d\n", msg->type);
+        atomic_fetch_add_explicit(&write_errors, 1, memory_order_relaxed);
+        return;
+    }
+
+    if (protocol_version == PROTOCOL_V1) {
+        if (staging.out_len + len > sizeof(staging.out)) {
+            flush_staging();
+        }
+        memcpy(staging.out + staging.out_len, encoded, len);
+        staging.out_len += len;
+        staging.out_input_ns[staging.out_messages++] = entry->input_ns;
+        latency_record_since(LATENCY_ENCODE, start);
+        return;
+    }
+
+    if (staging.payload_len + len > sizeof(staging.payload)) {
+        close_frame();
+    }
+    if (staging.payload_len == 0 && staging.out_len + FRAME_MAX_ENCODED_SIZE > sizeof(staging.out)) {
+        flush_staging();
+    }
+    memcpy(staging.payload + staging.payload_len, encoded, len);
+    staging.payload_len += len;
+    staging.payload_input_ns[staging.payload_messages++] = entry->input_ns;
+    staging.payload_types |= ACK_TYPE_BIT(msg->type);
+    if (entry->input_ns != 0 &&
+        (staging.payload_oldest_ns == 0 || entry->input_ns < staging.payload_oldest_ns)) {
+        staging.payload_oldest_ns = entry->input_ns;
+    }
+    latency_record_since(LATENCY_ENCODE, start);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Sleep until the writer has to flush what it holds, so messages that arrive
+// meanwhile share the write. Never delays the oldest staged message past the limit
+static void wait_for_batch(uint64_t first_staged_ns) {
+    uint64_t deadline = first_staged_ns + (uint64_t)max_latency_us * 1000u;
+    struct timespec ts = {(time_t)(deadline / 1000000000ull), (long)(deadline % 1000000000ull)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+static void *writer_main(void *arg) {
+    TxEntry chunk[TX_DRAIN_CHUNK];
+    (void)arg;
+
+    for (;;) {
+        size_t count = spsc_ring_pop(&tx_ring, chunk, TX_DRAIN_CHUNK);
+
+        if (count == 0) {
+            if (!atomic_load(&writer_running)) {
+                break;
+            }
+            // Announce the sleep before the final check so a concurrent submit
+            // either sees the flag or its message is seen here
+            atomic_store(&writer_sleeping, 1);
+            atomic_thread_fence(memory_order_seq_cst);
+            if (spsc_ring_count(&tx_ring) == 0 && atomic_load(&writer_running)) {
+                uint64_t value;
+                if (read(wakeup_fd, &value, sizeof(value)) < 0 && errno != EINTR) {
+                    perror("eventfd read failed");
+                }
+            }
+            atomic_store(&writer_sleeping, 0);
+            continue;
+        }
+
+        uint64_t first_staged_ns = now_ns();
+        for (;;) {
+            for (size_t i = 0; i < count; i++) {
+                stage_message(&chunk[i]);
+            }
+            // Keep draining whatever is already queued into the same write
+            count = spsc_ring_pop(&tx_ring, chunk, TX_DRAIN_CHUNK);
+            if (count > 0) {
+                continue;
+            }
+            if (max_latency_us == 0 || !atomic_load(&writer_running) ||
+                now_ns() >= first_staged_ns + (uint64_t)max_latency_us * 1000u) {
+                break;
+            }
+            wait_for_batch(first_staged_ns);
+            count = spsc_ring_pop(&tx_ring, chunk, TX_DRAIN_CHUNK);
+            if (count == 0) {
+                break;
+            }
+        }
+        flush_staging();
+    }
+
+    return NULL;
+}
+
+int transmit_start(Transport *t, int version, unsigned int max_frame_latency_us) {
+    transport = t;
+    protocol_version = version;
+    max_latency_us = max_frame_latency_us;
+    memset(&staging, 0, sizeof(staging));
+    spsc_ring_init(&tx_ring, ring_storage, sizeof(TxEntry), TX_RING_CAPACITY);
+
+    wakeup_fd = eventfd(0, EFD_CLOEXEC);
+    if (wakeup_fd < 0) {
+        perror("Failed to create writer eventfd");
+        return -1;
+    }
+
+    atomic_store(&writer_running, 1);
+    atomic_store(&writer_sleeping, 0);
+    if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0) {
+        fprintf(stderr, "Failed to start transmit writer thread\n");
+        close(wakeup_fd);
+        wakeup_fd = -1;
+        return -1;
+    }
+    writer_started = 1;
+    return 0;
+}
+
+int transmit_start_sync(Transport *t, int version) {
+    transport = t;
+    protocol_version = version;
+    max_latency_us = 0;
+    memset(&staging, 0, sizeof(staging));
+    spsc_ring_init(&tx_ring, ring_storage, sizeof(TxEntry), TX_RING_CAPACITY);
+    synchronous = 1;
+    return 0;
+}
+
+void transmit_submit(const Message *msgs, const uint64_t *input_ns, int count) {
+    if (synchronous) {
+        for (int i = 0; i < count; i++) {
+            TxEntry entry = {msgs[i], input_ns ? input_ns[i] : 0};
+            stage_message(&entry);
+        }
+        atomic_fetch_add_explicit(&messages_queued, (uint64_t)count, memory_order_relaxed);
+        flush_staging();
+        return;
+    }
+    if (!writer_started) {
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        TxEntry entry = {msgs[i], input_ns ? input_ns[i] : 0};
+        while (spsc_ring_push(&tx_ring, &entry) != 0) {
+            // Ring full: the link is the bottleneck. Let the writer catch up.
+            atomic_fetch_add_explicit(&producer_stalls, 1, memory_order_relaxed);
+            wake_writer();
+            struct timespec pause = {0, 100000};
+            nanosleep(&pause, NULL);
+        }
+    }
+    atomic_fetch_add_explicit(&messages_queued, (uint64_t)count, memory_order_relaxed);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (count > 0 && atomic_load(&writer_sleeping)) {
+        wake_writer();
+    }
+}
+
+void transmit_stop(void) {
+    if (synchronous) {
+        synchronous = 0;
+        transport = NULL;
+        return;
+    }
+    if (!writer_started) {
+        return;
+    }
+
+    atomic_store(&writer_running, 0);
+    wake_writer();
+    pthread_join(writer_thread, NULL);
+    writer_started = 0;
+
+    close(wakeup_fd);
+    wakeup_fd = -1;
+    transport = NULL;
+}
+
+void transmit_get_stats(TransmitStats *stats) {
+    if (!stats) {
+        return;
+    }
+
+    stats->messages_queued = atomic_load_explicit(&messages_queued, memory_order_relaxed);
+    stats->messages_written = atomic_load_explicit(&messages_written, memory_order_relaxed);
+    stats->frames_written = atomic_load_explicit(&frames_written, memory_order_relaxed);
+    stats->bytes_written = atomic_load_explicit(&bytes_written, memory_order_relaxed);
+    stats->write_calls = atomic_load_explicit(&write_calls, memory_order_relaxed);
+    stats->write_errors = atomic_load_explicit(&write_errors, memory_order_relaxed);
+    stats->producer_stalls = atomic_load_explicit(&producer_stalls, memory_order_relaxed);
+    stats->queue_depth = (uint32_t)spsc_ring_count(&tx_ring);
+    stats->queue_high_water = (uint32_t)atomic_load_explicit(&tx_ring.high_water, memory_order_relaxed);
+    stats->queue_capacity = TX_RING_CAPACITY;
+}
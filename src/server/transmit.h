@@ -0,0 +1,51 @@
+#ifndef TRANSMIT_H
+#define TRANSMIT_H
+
+#include <stdint.h>
+#include "common/protocol.h"
+#include "transport.h"
+
+// Transmit stage: a writer thread that owns the transport and drains messages
+// queued by the event loop through a lock-free SPSC ring, so a slow serial
+// adapter never blocks input capture.
+
+typedef struct {
+    uint64_t messages_queued;    // accepted into the ring
+    uint64_t messages_written;   // fully written to the transport
+    uint64_t frames_written;     // v2 frames (each may hold many messages)
+    uint64_t bytes_written;
+    uint64_t write_calls;
+    uint64_t write_errors;
+    uint64_t producer_stalls;    // times the event loop had to wait for ring space
+    uint32_t queue_depth;        // messages currently queued
+    uint32_t queue_high_water;   // deepest the queue has been
+    uint32_t queue_capacity;
+} TransmitStats;
+
+// Everything the writer finds queued goes out in one write(); in v2 the messages
+// are packed into as few frames as possible.
+#define TRANSMIT_MAX_FRAME_LATENCY_US 10000
+
+// Start the writer thread on t, encoding messages in the given ProtocolVersion.
+// With max_frame_latency_us > 0 the writer waits up to that long after picking up
+// a message for more to share its write; 0 sends whatever is ready immediately.
+// Returns 0 on success, -1 on failure
+int transmit_start(Transport *t, int version, unsigned int max_frame_latency_us);
+
+// Without a writer thread: every transmit_submit() call is encoded and written
+// before it returns, one write per call. Used by --replay, where the output
+// must not depend on thread scheduling. Returns 0 on success, -1 on failure
+int transmit_start_sync(Transport *t, int version);
+
+// Queue messages for the writer thread (event loop thread only). Waits for
+// ring space rather than dropping, so keyboard state is never lost.
+// input_ns (may be NULL) holds per message the kernel timestamp of the input
+// that produced it, for the write latency histogram
+void transmit_submit(const Message *msgs, const uint64_t *input_ns, int count);
+
+// Write out everything still queued, then stop the writer thread
+void transmit_stop(void);
+
+void transmit_get_stats(TransmitStats *stats);
+
+#endif // TRANSMIT_H
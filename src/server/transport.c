@@ -0,0 +1,387 @@
+#include "transport.h"
+#include "uart.h"
+#include "latency.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+const char *const TRANSPORT_USAGE =
+    "  uart:PATH        serial port (default for terminal devices)\n"
+    "  pty              new pseudo-terminal; the peer opens the path printed at startup\n"
+    "  unix:PATH        Unix-domain stream socket\n"
+    "  tcp:HOST:PORT    TCP connection\n"
+    "  udp:HOST:PORT    UDP, one datagram per write\n"
+    "  file:PATH        append to a file, created if missing (default for existing\n"
+    "                   non-terminals, e.g. /dev/null)\n";
+
+static ssize_t fd_write(Transport *t, const void *data, size_t len) {
+    return write(t->fd, data, len);
+}
+
+static ssize_t fd_read(Transport *t, void *buf, size_t len) {
+    return read(t->fd, buf, len);
+}
+
+static void fd_close(Transport *t) {
+    close(t->fd);
+}
+
+// ---- uart ----
+
+static int uart_transport_open(Transport *t, const char *target, int baud_rate) {
+    t->fd = uart_open(target, baud_rate);
+    if (t->fd < 0) {
+        return -1;
+    }
+    snprintf(t->description, sizeof(t->description), "uart %s at %d baud", target, baud_rate);
+    return 0;
+}
+
+static const TransportOps uart_ops = {"uart", uart_transport_open, fd_write, fd_read, fd_close};
+
+// ---- pty ----
+
+static int pty_open(Transport *t, const char *target, int baud_rate) {
+    struct termios tio;
+    (void)target;
+    (void)baud_rate;
+
+    t->fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (t->fd < 0 || grantpt(t->fd) != 0 || unlockpt(t->fd) != 0) {
+        perror("Failed to create pty");
+        if (t->fd >= 0) {
+            close(t->fd);
+        }
+        return -1;
+    }
+    // Raw line discipline, so the peer reads exactly the bytes we write
+    if (tcgetattr(t->fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(t->fd, TCSANOW, &tio);
+    }
+    fcntl(t->fd, F_SETFL, fcntl(t->fd, F_GETFL) | O_NONBLOCK);
+    snprintf(t->description, sizeof(t->description), "pty %s", ptsname(t->fd));
+    printf("pty transport: connect the dongle side to %s\n", ptsname(t->fd));
+    fflush(stdout);
+    return 0;
+}
+
+// Like a serial line with nothing attached: with no peer (EIO) the bytes are lost.
+// A peer that reads slowly gets backpressure: wait for room like a blocking fd,
+// and only drop (and count) the bytes if it takes no data for PTY_WRITE_TIMEOUT_MS
+#define PTY_WRITE_TIMEOUT_MS 1000
+
+static ssize_t pty_write(Transport *t, const void *data, size_t len) {
+    for (;;) {
+        ssize_t sent = write(t->fd, data, len);
+        if (sent >= 0 || (errno != EAGAIN && errno != EIO)) {
+            return sent;
+        }
+        if (errno == EAGAIN) {
+            // The peer hanging up with the buffer still full also ends the wait
+            struct pollfd pfd = {t->fd, POLLOUT, 0};
+            int ready = poll(&pfd, 1, PTY_WRITE_TIMEOUT_MS);
+            if (ready < 0 && errno != EINTR) {
+                return -1;
+            }
+            if (ready != 0 && !(pfd.revents & POLLHUP)) {
+                continue;
+            }
+        }
+        atomic_fetch_add_explicit(&t->bytes_dropped, len, memory_order_relaxed);
+        return (ssize_t)len;
+    }
+}
+
+// Nothing has the other end open yet (or any more): report no data instead of EIO
+static ssize_t pty_read(Transport *t, void *buf, size_t len) {
+    ssize_t n = read(t->fd, buf, len);
+    if (n < 0 && errno == EIO) {
+        return 0;
+    }
+    return n;
+}
+
+static const TransportOps pty_ops = {"pty", pty_open, pty_write, pty_read, fd_close};
+
+// ---- sockets ----
+
+static ssize_t socket_write(Transport *t, const void *data, size_t len) {
+    // MSG_NOSIGNAL: a closed peer is a write error, not SIGPIPE
+    return send(t->fd, data, len, MSG_NOSIGNAL);
+}
+
+static int unix_open(Transport *t, const char *target, int baud_rate) {
+    struct sockaddr_un addr;
+    (void)baud_rate;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(target) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", target);
+        return -1;
+    }
+    strcpy(addr.sun_path, target);
+
+    t->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (t->fd < 0 || connect(t->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Failed to connect to %s: %s\n", target, strerror(errno));
+        if (t->fd >= 0) {
+            close(t->fd);
+        }
+        return -1;
+    }
+    snprintf(t->description, sizeof(t->description), "unix %s", target);
+    return 0;
+}
+
+static const TransportOps unix_ops = {"unix", unix_open, socket_write, fd_read, fd_close};
+
+// HOST:PORT, HOST may be a name, an IPv4 address or a [bracketed] IPv6 address
+static int inet_connect(Transport *t, const char *target, int socktype) {
+    char host[128];
+    const char *port = strrchr(target, ':');
+    struct addrinfo hints, *res, *ai;
+
+    if (!port || port == target || (size_t)(port - target) >= sizeof(host)) {
+        fprintf(stderr, "Expected HOST:PORT, got %s\n", target);
+        return -1;
+    }
+    memcpy(host, target, (size_t)(port - target));
+    host[port - target] = '\0';
+    port++;
+    if (host[0] == '[' && host[strlen(host) - 1] == ']') {
+        memmove(host, host + 1, strlen(host) - 2);
+        host[strlen(host) - 2] = '\0';
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = socktype;
+    int rc = getaddrinfo(host, port, &hints, &res);
+    if (rc != 0) {
+        fprintf(stderr, "Cannot resolve %s: %s\n", target, gai_strerror(rc));
+        return -1;
+    }
+
+    t->fd = -1;
+    for (ai = res; ai; ai = ai->ai_next) {
+        t->fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (t->fd < 0) {
+            continue;
+        }
+        if (connect(t->fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(t->fd);
+        t->fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (t->fd < 0) {
+        fprintf(stderr, "Failed to connect to %s: %s\n", target, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int tcp_open(Transport *t, const char *target, int baud_rate) {
+    int one = 1;
+    (void)baud_rate;
+
+    if (inet_connect(t, target, SOCK_STREAM) != 0) {
+        return -1;
+    }
+    // Every write is a latency-critical batch: send it now, not when Nagle allows
+    setsockopt(t->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    snprintf(t->description, sizeof(t->description), "tcp %s", target);
+    return 0;
+}
+
+static const TransportOps tcp_ops = {"tcp", tcp_open, socket_write, fd_read, fd_close};
+
+static int udp_open(Transport *t, const char *target, int baud_rate) {
+    (void)baud_rate;
+
+    if (inet_connect(t, target, SOCK_DGRAM) != 0) {
+        return -1;
+    }
+    snprintf(t->description, sizeof(t->description), "udp %s", target);
+    return 0;
+}
+
+// A missing listener is reported as ECONNREFUSED on the send after the lost
+// datagram; the error belongs to that earlier one, so send this one again
+static ssize_t udp_write(Transport *t, const void *data, size_t len) {
+    ssize_t sent = send(t->fd, data, len, MSG_NOSIGNAL);
+    if (sent < 0 && errno == ECONNREFUSED) {
+        sent = send(t->fd, data, len, MSG_NOSIGNAL);
+    }
+    return sent;
+}
+
+static ssize_t udp_read(Transport *t, void *buf, size_t len) {
+    ssize_t n = recv(t->fd, buf, len, MSG_DONTWAIT);
+    if (n < 0 && errno == ECONNREFUSED) {
+        return 0;
+    }
+    return n;
+}
+
+static const TransportOps udp_ops = {"udp", udp_open, udp_write, udp_read, fd_close};
+
+// ---- file ----
+
+static int file_open(Transport *t, const char *target, int baud_rate) {
+    (void)baud_rate;
+
+    t->fd = open(target, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (t->fd < 0) {
+        fprintf(stderr, "Failed to open %s: %s\n", target, strerror(errno));
+        return -1;
+    }
+    snprintf(t->description, sizeof(t->description), "file %s", target);
+    return 0;
+}
+
+static const TransportOps file_ops = {"file", file_open, fd_write, NULL, fd_close};
+
+// ----
+
+static const TransportOps *const transports[] = {
+    &uart_ops, &pty_ops, &unix_ops, &tcp_ops, &udp_ops, &file_ops,
+};
+
+// A bare path: a terminal is the dongle's serial port, any other existing file a
+// byte sink. A missing path is a serial port that is not plugged in: uart_open
+// reports the error instead of a new file being created (that needs "file:")
+static const TransportOps *guess_transport(const char *path) {
+    struct stat st;
+
+    if (stat(path, &st) != 0) {
+        return &uart_ops;
+    }
+    if (!S_ISCHR(st.st_mode)) {
+        return &file_ops;
+    }
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return &uart_ops;   // let uart_open report the error
+    }
+    int tty = isatty(fd);
+    close(fd);
+    return tty ? &uart_ops : &file_ops;
+}
+
+int transport_open(Transport *t, const char *spec, int baud_rate) {
+    const TransportOps *ops = NULL;
+    const char *target = spec;
+
+    memset(t, 0, sizeof(*t));
+    t->fd = -1;
+
+    for (size_t i = 0; i < sizeof(transports) / sizeof(transports[0]); i++) {
+        size_t name_len = strlen(transports[i]->name);
+        if (strncmp(spec, transports[i]->name, name_len) != 0) {
+            continue;
+        }
+        if (spec[name_len] == ':') {
+            ops = transports[i];
+            target = spec + name_len + 1;
+            break;
+        }
+        if (spec[name_len] == '\0' && transports[i] == &pty_ops) {
+            ops = transports[i];
+            target = NULL;
+            break;
+        }
+    }
+    if (!ops) {
+        ops = guess_transport(spec);
+    }
+    if (ops != &pty_ops && (!target || target[0] == '\0')) {
+        fprintf(stderr, "Missing path or address in transport %s\n", spec);
+        return -1;
+    }
+
+    t->ops = ops;
+    if (ops->open(t, target, baud_rate) != 0) {
+        t->ops = NULL;
+        t->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+ssize_t transport_write(Transport *t, const void *data, size_t len) {
+    uint64_t start = latency_now_ns();
+    ssize_t sent = t->ops->write(t, data, len);
+    uint64_t elapsed = latency_now_ns() - start;
+
+    latency_record(LATENCY_WRITE_CALL, elapsed);
+    atomic_fetch_add_explicit(&t->write_calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&t->write_ns, elapsed, memory_order_relaxed);
+    if (elapsed > atomic_load_explicit(&t->write_ns_max, memory_order_relaxed)) {
+        atomic_store_explicit(&t->write_ns_max, elapsed, memory_order_relaxed);   // single writer
+    }
+    if (sent < 0) {
+        atomic_fetch_add_explicit(&t->write_errors, 1, memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(&t->bytes_written, (uint64_t)sent, memory_order_relaxed);
+    }
+    return sent;
+}
+
+ssize_t transport_read(Transport *t, void *buf, size_t len) {
+    if (!t->ops->read) {
+        return 0;
+    }
+    ssize_t n = t->ops->read(t, buf, len);
+    atomic_fetch_add_explicit(&t->read_calls, 1, memory_order_relaxed);
+    if (n > 0) {
+        atomic_fetch_add_explicit(&t->bytes_read, (uint64_t)n, memory_order_relaxed);
+    }
+    return n;
+}
+
+int transport_is_readable(const Transport *t) {
+    return t->ops && t->ops->read != NULL;
+}
+
+int transport_hangup_is_transient(const Transport *t) {
+    return t->ops == &pty_ops;
+}
+
+int transport_is_serial(const Transport *t) {
+    return t->ops == &uart_ops;
+}
+
+void transport_get_stats(Transport *t, TransportStats *stats) {
+    stats->write_calls = atomic_load_explicit(&t->write_calls, memory_order_relaxed);
+    stats->bytes_written = atomic_load_explicit(&t->bytes_written, memory_order_relaxed);
+    stats->write_errors = atomic_load_explicit(&t->write_errors, memory_order_relaxed);
+    stats->write_ns = atomic_load_explicit(&t->write_ns, memory_order_relaxed);
+    stats->write_ns_max = atomic_load_explicit(&t->write_ns_max, memory_order_relaxed);
+    stats->read_calls = atomic_load_explicit(&t->read_calls, memory_order_relaxed);
+    stats->bytes_read = atomic_load_explicit(&t->bytes_read, memory_order_relaxed);
+    stats->bytes_dropped = atomic_load_explicit(&t->bytes_dropped, memory_order_relaxed);
+}
+
+void transport_close(Transport *t) {
+    if (t->ops && t->fd >= 0) {
+        t->ops->close(t);
+    }
+    t->fd = -1;
+    t->ops = NULL;
+}
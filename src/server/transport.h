@@ -0,0 +1,86 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+// Where the encoded byte stream goes. The dongle normally sits on a serial port,
+// but any byte sink works for testing and benchmarking without hardware:
+//
+//   uart:PATH        serial port (termios2, any baud rate)
+//   pty              new pseudo-terminal pair; the peer opens the printed path
+//   unix:PATH        connect to a Unix-domain stream socket
+//   tcp:HOST:PORT    connect over TCP (TCP_NODELAY)
+//   udp:HOST:PORT    one datagram per write
+//   file:PATH        append to a file (created if missing)
+//   PATH             uart: for a terminal device or a missing path,
+//                    file: for any other existing file
+
+typedef struct {
+    uint64_t write_calls;       // write()/send() system calls
+    uint64_t bytes_written;
+    uint64_t write_errors;
+    uint64_t write_ns;          // total time spent in write()/send()
+    uint64_t write_ns_max;      // slowest single call
+    uint64_t read_calls;
+    uint64_t bytes_read;
+    uint64_t bytes_dropped;     // pty: written with no peer, or to a peer that stopped reading
+} TransportStats;
+
+typedef struct Transport Transport;
+
+typedef struct {
+    const char *name;
+    // target is the part after "name:" (NULL for pty). Sets t->fd. 0 on success, -1 on failure
+    int (*open)(Transport *t, const char *target, int baud_rate);
+    ssize_t (*write)(Transport *t, const void *data, size_t len);
+    ssize_t (*read)(Transport *t, void *buf, size_t len);   // NULL: write-only sink
+    void (*close)(Transport *t);
+} TransportOps;
+
+struct Transport {
+    const TransportOps *ops;
+    int fd;
+    char description[160];      // for log output, e.g. "tcp 127.0.0.1:7777"
+    // Updated by the thread that writes, read by anyone
+    atomic_uint_fast64_t write_calls;
+    atomic_uint_fast64_t bytes_written;
+    atomic_uint_fast64_t write_errors;
+    atomic_uint_fast64_t write_ns;
+    atomic_uint_fast64_t write_ns_max;
+    atomic_uint_fast64_t read_calls;
+    atomic_uint_fast64_t bytes_read;
+    atomic_uint_fast64_t bytes_dropped;
+};
+
+// Help text listing the accepted specs, one per line
+extern const char *const TRANSPORT_USAGE;
+
+// Open the transport named by spec (see above). baud_rate only applies to
+// serial ports. Returns 0 on success, -1 on failure
+int transport_open(Transport *t, const char *spec, int baud_rate);
+
+// One write()/send() of up to len bytes; returns what the call returned.
+// Timed into TransportStats and the LATENCY_WRITE_CALL histogram
+ssize_t transport_write(Transport *t, const void *data, size_t len);
+
+// One read() of whatever is pending. Returns bytes read, 0, or -1 (errno set)
+ssize_t transport_read(Transport *t, void *buf, size_t len);
+
+// Whether data comes back (acks) through t->fd, so it is worth polling
+int transport_is_readable(const Transport *t);
+
+// Whether a hangup on t->fd only means there is no peer right now: a pty reports
+// EPOLLHUP while its slave side is closed and clears it when a peer reopens it
+int transport_hangup_is_transient(const Transport *t);
+
+// Whether t->fd is a serial port that takes baud rate changes (--link-baud, --link-test)
+int transport_is_serial(const Transport *t);
+
+void transport_get_stats(Transport *t, TransportStats *stats);
+
+void transport_close(Transport *t);
+
+#endif // TRANSPORT_H
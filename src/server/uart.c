@@ -0,0 +1,110 @@
+#include "uart.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+
+int uart_set_baud_rate(int fd, int baud_rate) {
+    struct termios2 tty;
+
+    if (ioctl(fd, TCGETS2, &tty) != 0) {
+        perror("TCGETS2 failed");
+        return -1;
+    }
+
+    // BOTHER takes the rate from c_ispeed/c_ospeed instead of a Bxxx constant
+    tty.c_cflag &= ~CBAUD;
+    tty.c_cflag |= BOTHER;
+    tty.c_cflag &= ~(CBAUD << IBSHIFT);
+    tty.c_cflag |= BOTHER << IBSHIFT;
+    tty.c_ispeed = (speed_t)baud_rate;
+    tty.c_ospeed = (speed_t)baud_rate;
+
+    if (ioctl(fd, TCSETS2, &tty) != 0) {
+        fprintf(stderr, "TCSETS2 failed for %d baud: %s\n", baud_rate, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int uart_get_baud_rate(int fd) {
+    struct termios2 tty;
+
+    if (ioctl(fd, TCGETS2, &tty) != 0) {
+        return -1;
+    }
+    return (int)tty.c_ospeed;
+}
+
+int uart_drain(int fd) {
+    // TCSBRK with a non-zero argument is tcdrain()
+    return ioctl(fd, TCSBRK, 1);
+}
+
+int uart_flush_input(int fd) {
+    return ioctl(fd, TCFLSH, TCIFLUSH);
+}
+
+int uart_open(const char *port, int baud_rate) {
+    struct termios2 tty;
+    int fd;
+
+    if (baud_rate < UART_MIN_BAUD_RATE || baud_rate > UART_MAX_BAUD_RATE) {
+        fprintf(stderr, "Baud rate %d out of range (%d-%d)\n",
+                baud_rate, UART_MIN_BAUD_RATE, UART_MAX_BAUD_RATE);
+        return -1;
+    }
+
+    fd = open(port, O_RDWR | O_NOCTTY | O_SYNC);
+    if (fd < 0) {
+        perror("Failed to open UART device");
+        return -1;
+    }
+
+    if (ioctl(fd, TCGETS2, &tty) != 0) {
+        perror("TCGETS2 failed");
+        close(fd);
+        return -1;
+    }
+
+    tty.c_cflag &= ~PARENB;
+    tty.c_cflag &= ~CSTOPB;
+    tty.c_cflag &= ~CSIZE;
+    tty.c_cflag |= CS8;
+    tty.c_cflag &= ~CRTSCTS;
+    tty.c_cflag |= CREAD | CLOCAL;
+
+    tty.c_lflag &= ~ICANON;
+    tty.c_lflag &= ~ECHO;
+    tty.c_lflag &= ~ECHOE;
+    tty.c_lflag &= ~ECHONL;
+    tty.c_lflag &= ~ISIG;
+
+    tty.c_iflag &= ~(IXON | IXOFF | IXANY);
+    tty.c_iflag &= ~(INLCR | ICRNL | IGNCR | ISTRIP);
+
+    tty.c_oflag &= ~OPOST;
+
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 10;
+
+    if (ioctl(fd, TCSETS2, &tty) != 0) {
+        perror("TCSETS2 failed");
+        close(fd);
+        return -1;
+    }
+
+    if (uart_set_baud_rate(fd, baud_rate) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    int actual = uart_get_baud_rate(fd);
+    if (actual != baud_rate) {
+        fprintf(stderr, "Warning: %s runs at %d baud (requested %d)\n", port, actual, baud_rate);
+    }
+    return fd;
+}
@@ -0,0 +1,26 @@
+#ifndef UART_H
+#define UART_H
+
+// Serial port setup through termios2, so any baud rate the adapter supports
+// (e.g. 1500000, 2000000, 3000000) can be used, not just the Bxxx constants.
+// Kept in its own translation unit: <asm/termbits.h> clashes with <termios.h>.
+
+#define UART_MIN_BAUD_RATE 9600
+#define UART_MAX_BAUD_RATE 4000000
+
+// Open port in raw 8N1 mode at baud_rate. Returns the fd, or -1 on failure
+int uart_open(const char *port, int baud_rate);
+
+// Change the rate of an open port. Returns 0 on success, -1 on failure
+int uart_set_baud_rate(int fd, int baud_rate);
+
+// Rate the driver actually applied (may be rounded by the adapter), -1 on failure
+int uart_get_baud_rate(int fd);
+
+// Block until everything written to fd has left the transmitter
+int uart_drain(int fd);
+
+// Discard received but unread input
+int uart_flush_input(int fd);
+
+#endif // UART_H
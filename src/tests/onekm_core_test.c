@@ -0,0 +1,473 @@
+/*
+ * onekm_core.c 的确定性测试（onekm-core-test，由 ctest 运行）
+ *
+ * 不开线程：测试直接扮演接收任务（onekm_core_receive）、HID 任务（onekm_core_hid_send）
+ * 和 USB 主机（take_report），按指定的先后顺序交错，检查交接队列、键盘 FIFO、
+ * 完成回调和帧确认在每种顺序下的结果。接收任务在交接队列满时调用 onekm_port_yield()，
+ * 这里的实现让 USB 主机和 HID 任务各运行一轮，相当于接收任务等待期间它们被调度。
+ *
+ * 用法：onekm-core-test [用例名]，不带参数时运行全部用例
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common/protocol.h"
+#include "onekm_core.h"
+
+#define HANDOFF_SLOTS 128           // 与 onekm_core.c 的 HANDOFF_CAPACITY 相同
+#define MAX_ACKS 1024
+#define MAX_REPORTS 1024
+
+int onekm_host_verbose = 0;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+typedef struct {
+    onekm_hid_itf_t itf;
+    onekm_key_bitmap_t keys;
+    int16_t dx;
+    int16_t dy;
+} report_t;
+
+// 模拟的端点与记录
+static bool endpoint_busy[ONEKM_HID_COUNT];
+static report_t reports[MAX_REPORTS];
+static size_t report_count;
+static size_t reports_taken;
+static uint16_t acks[MAX_ACKS];     // seq | flags << 8，按排队顺序
+static size_t ack_count;
+static unsigned int yields;
+static bool host_runs_on_yield;     // 接收任务等待时 USB 主机和 HID 任务是否运行
+
+/************* 平台接口 ***************/
+
+void onekm_port_notify_hid(void)
+{
+}
+
+static void take_report(onekm_hid_itf_t itf);
+
+void onekm_port_yield(void)
+{
+    yields++;
+    if (host_runs_on_yield) {
+        take_report(ONEKM_HID_KEYBOARD);
+        take_report(ONEKM_HID_MOUSE);
+        onekm_core_hid_send();
+    }
+}
+
+bool onekm_port_set_baud_rate(uint32_t baud_rate)
+{
+    (void)baud_rate;
+    return true;
+}
+
+void onekm_port_queue_ack(uint8_t seq, uint8_t flags)
+{
+    if (ack_count < MAX_ACKS) {
+        acks[ack_count] = (uint16_t)(seq | (flags << 8));
+    }
+    ack_count++;
+}
+
+void onekm_port_set_led(bool on)
+{
+    (void)on;
+}
+
+static bool submit(const report_t *report)
+{
+    if (endpoint_busy[report->itf]) {
+        return false;
+    }
+    endpoint_busy[report->itf] = true;
+    if (report_count < MAX_REPORTS) {
+        reports[report_count] = *report;
+    }
+    report_count++;
+    return true;
+}
+
+bool onekm_port_keyboard_report(const onekm_key_bitmap_t *keys)
+{
+    report_t report = {.itf = ONEKM_HID_KEYBOARD, .keys = *keys};
+    return submit(&report);
+}
+
+void onekm_port_mouse_format(onekm_mouse_format_t *format)
+{
+    format->motion_limit = 32767;
+    format->wheel_limit = 32767;
+    format->vertical_units = WHEEL_HI_RES_UNITS;
+    format->horizontal_units = WHEEL_HI_RES_UNITS;
+}
+
+bool onekm_port_mouse_report(uint8_t buttons, int16_t x, int16_t y, int16_t vertical, int16_t horizontal)
+{
+    (void)buttons;
+    (void)vertical;
+    (void)horizontal;
+    report_t report = {.itf = ONEKM_HID_MOUSE, .dx = x, .dy = y};
+    return submit(&report);
+}
+
+/************* 测试工具 ***************/
+
+// USB 主机取走端点中的报告
+static void take_report(onekm_hid_itf_t itf)
+{
+    if (endpoint_busy[itf]) {
+        endpoint_busy[itf] = false;
+        reports_taken++;
+        onekm_core_report_complete(itf);
+    }
+}
+
+static void reset(void)
+{
+    memset(endpoint_busy, 0, sizeof(endpoint_busy));
+    report_count = 0;
+    reports_taken = 0;
+    ack_count = 0;
+    yields = 0;
+    host_runs_on_yield = false;
+    onekm_core_init(115200);
+    onekm_core_set_remote(true);
+}
+
+static void receive_frame(uint8_t seq, const Message *msgs, size_t count)
+{
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    uint8_t frame[FRAME_MAX_ENCODED_SIZE];
+    size_t len = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        len += msg_encode(&msgs[i], PROTOCOL_V2, payload + len, sizeof(payload) - len);
+    }
+    onekm_core_receive(frame, frame_encode(seq, payload, len, frame, sizeof(frame)));
+}
+
+// 一帧 count 条鼠标移动，每条 dx=1、dy=-1
+static void receive_moves(uint8_t seq, size_t count)
+{
+    Message msgs[FRAME_MAX_PAYLOAD / 3];
+
+    for (size_t i = 0; i < count; i++) {
+        msg_mouse_move(&msgs[i], 1, -1);
+    }
+    receive_frame(seq, msgs, count);
+}
+
+// 运行 HID 任务并让主机取走所有报告，直到没有新的报告
+static void run_until_idle(void)
+{
+    size_t before;
+    do {
+        before = report_count;
+        onekm_core_hid_send();
+        take_report(ONEKM_HID_KEYBOARD);
+        take_report(ONEKM_HID_MOUSE);
+        onekm_core_hid_send();
+    } while (report_count != before);
+}
+
+static int32_t mouse_dx_total(void)
+{
+    int32_t total = 0;
+    for (size_t i = 0; i < report_count && i < MAX_REPORTS; i++) {
+        if (reports[i].itf == ONEKM_HID_MOUSE) {
+            total += reports[i].dx;
+        }
+    }
+    return total;
+}
+
+static bool ack_is(size_t index, uint8_t seq, uint8_t flags)
+{
+    return index < ack_count && acks[index] == (uint16_t)(seq | (flags << 8));
+}
+
+static bool key_pressed(const onekm_key_bitmap_t *keys, uint8_t usage)
+{
+    return (keys->bytes[usage / 8] >> (usage % 8)) & 1;
+}
+
+/************* 用例 ***************/
+
+// 交接队列满：接收任务等待 HID 任务取出，消息一条不丢，最后一帧在报告被取走后确认
+static void test_handoff_full(void)
+{
+    const int frames = 12;
+    const size_t moves = 36;    // 每帧 37 项，不到 4 帧就填满 128 项的队列
+
+    reset();
+    host_runs_on_yield = true;
+    for (int f = 0; f < frames; f++) {
+        receive_moves((uint8_t)f, moves);
+    }
+    onekm_core_stats_t stats;
+    onekm_core_get_stats(&stats);
+    CHECK(stats.handoff_waits > 0);
+    CHECK(yields == stats.handoff_waits);
+    CHECK(stats.handoff_high_water == HANDOFF_SLOTS);
+
+    run_until_idle();
+    CHECK(mouse_dx_total() == frames * (int32_t)moves);
+    CHECK(ack_count > 0);
+    CHECK(ack_is(ack_count - 1, (uint8_t)(frames - 1), ACK_FLAG_HID_DELIVERED));
+    for (size_t i = 1; i < ack_count; i++) {
+        CHECK((uint8_t)acks[i] > (uint8_t)acks[i - 1]);
+    }
+}
+
+// 帧的消息和帧结束标记跨过队列回绕点：每帧都要在它的报告被取走后、且只在那之后确认
+static void test_frame_end_wrap(void)
+{
+    // 每帧 1-3 条移动（2-4 项），三轮多覆盖回绕处的各种位置
+    const int frames = 200;
+    size_t pushed = 0;
+    bool end_after_wrap = false;    // 帧的消息在回绕点之前、结束标记在回绕点之后
+    bool end_at_last = false;       // 结束标记恰好在最后一格
+
+    reset();
+    for (int f = 0; f < frames; f++) {
+        size_t moves = 1 + (size_t)f % 3;
+        size_t first = pushed % HANDOFF_SLOTS;
+        size_t end = (pushed + moves) % HANDOFF_SLOTS;
+        end_after_wrap |= end < first;
+        end_at_last |= end == HANDOFF_SLOTS - 1;
+        pushed += moves + 1;
+
+        size_t acked = ack_count;
+        size_t reported = report_count;
+        receive_moves((uint8_t)f, moves);
+        onekm_core_hid_send();
+        CHECK(report_count == reported + 1);
+        CHECK(reports[reported].dx == (int16_t)moves);
+        CHECK(ack_count == acked);              // 报告还在端点里
+        take_report(ONEKM_HID_MOUSE);
+        onekm_core_hid_send();
+        CHECK(ack_is(acked, (uint8_t)f, ACK_FLAG_HID_DELIVERED));
+        CHECK(ack_count == acked + 1);
+    }
+    CHECK(end_after_wrap);
+    CHECK(end_at_last);
+}
+
+// 完成回调先于下一帧到达：HID 任务一次唤醒里先确认上一帧，再提交下一帧的报告
+static void test_complete_before_push(void)
+{
+    Message move;
+
+    reset();
+    msg_mouse_move(&move, 5, 0);
+    receive_frame(0, &move, 1);
+    onekm_core_hid_send();
+    CHECK(report_count == 1);
+
+    take_report(ONEKM_HID_MOUSE);       // 完成回调，HID 任务尚未运行
+    msg_mouse_move(&move, 7, 0);
+    receive_frame(1, &move, 1);
+    onekm_core_hid_send();
+    CHECK(ack_count == 1 && ack_is(0, 0, ACK_FLAG_HID_DELIVERED));
+    CHECK(report_count == 2 && reports[1].dx == 7);
+
+    take_report(ONEKM_HID_MOUSE);
+    onekm_core_hid_send();
+    CHECK(ack_count == 2 && ack_is(1, 1, ACK_FLAG_HID_DELIVERED));
+}
+
+// 完成回调晚于下一帧到达：下一帧的移动留在状态里，上一份报告被取走后确认上一帧并提交
+static void test_complete_after_push(void)
+{
+    Message move;
+
+    reset();
+    msg_mouse_move(&move, 5, 0);
+    receive_frame(0, &move, 1);
+    onekm_core_hid_send();
+    msg_mouse_move(&move, 7, 0);
+    receive_frame(1, &move, 1);
+    onekm_core_hid_send();              // 端点忙：帧 1 只记下
+    CHECK(report_count == 1);
+    CHECK(ack_count == 0);
+
+    take_report(ONEKM_HID_MOUSE);
+    onekm_core_hid_send();
+    CHECK(ack_count == 1 && ack_is(0, 0, ACK_FLAG_HID_DELIVERED));
+    CHECK(report_count == 2 && reports[1].dx == 7);
+
+    take_report(ONEKM_HID_MOUSE);
+    onekm_core_hid_send();
+    CHECK(ack_count == 2 && ack_is(1, 1, ACK_FLAG_HID_DELIVERED));
+}
+
+// 键盘端点不取走报告：FIFO 满后暂停取出，报告既不覆盖也不合并，之后按顺序一份份送出
+static void test_keyboard_backpressure(void)
+{
+    const int keys = 40;                // 80 份报告，远超键盘 FIFO 的 32 份
+    const int keys_per_frame = 4;
+    int frames = keys / keys_per_frame;
+
+    reset();
+    for (int f = 0; f < frames; f++) {
+        Message msgs[2 * 4];
+        for (int k = 0; k < keys_per_frame; k++) {
+            uint8_t usage = (uint8_t)(0x04 + f * keys_per_frame + k);
+            msg_keyboard_keys(&msgs[2 * k], usage, 1);
+            msg_keyboard_keys(&msgs[2 * k + 1], usage, 0);
+        }
+        receive_frame((uint8_t)f, msgs, 2 * (size_t)keys_per_frame);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        onekm_core_hid_send();
+    }
+    onekm_core_stats_t stats;
+    onekm_core_get_stats(&stats);
+    CHECK(report_count == 1);
+    CHECK(stats.keyboard_fifo_full > 0);
+    CHECK(stats.keyboard_collapsed == 0);
+    CHECK(ack_count == 0);
+
+    // 帧 f 的 2 * keys_per_frame 份报告都被取走后才能确认它
+    while (endpoint_busy[ONEKM_HID_KEYBOARD]) {
+        size_t acked = ack_count;
+        take_report(ONEKM_HID_KEYBOARD);
+        onekm_core_hid_send();
+        for (size_t i = acked; i < ack_count; i++) {
+            CHECK(acks[i] >> 8 == ACK_FLAG_HID_DELIVERED);
+            CHECK(reports_taken >= 2 * (size_t)keys_per_frame * ((acks[i] & 0xFF) + 1));
+        }
+    }
+    CHECK(report_count == 2 * (size_t)keys);
+    for (size_t i = 0; i < report_count && i < MAX_REPORTS; i++) {
+        uint8_t usage = (uint8_t)(0x04 + i / 2);
+        bool pressed = (i % 2) == 0;
+        onekm_key_bitmap_t expected = {0};
+        if (pressed) {
+            expected.bytes[usage / 8] = (uint8_t)(1u << (usage % 8));
+        }
+        CHECK(reports[i].itf == ONEKM_HID_KEYBOARD);
+        CHECK(key_pressed(&reports[i].keys, usage) == pressed);
+        CHECK(memcmp(&reports[i].keys, &expected, sizeof(expected)) == 0);
+    }
+    CHECK(ack_count > 0);
+    CHECK(ack_is(ack_count - 1, (uint8_t)(frames - 1), ACK_FLAG_HID_DELIVERED));
+}
+
+// 键盘报告只交给键盘接口、鼠标报告只交给鼠标接口，同一帧的两份报告在同一轮里都提交；
+// 一个接口忙不挡另一个，某个接口的完成回调也不会放行另一个接口
+static void test_hid_routing(void)
+{
+    Message msgs[2];
+
+    reset();
+    msg_keyboard_keys(&msgs[0], 0x04, 1);
+    msg_mouse_move(&msgs[1], 3, 0);
+    receive_frame(0, msgs, 2);
+    onekm_core_hid_send();
+    CHECK(report_count == 2);
+    CHECK(reports[0].itf == ONEKM_HID_KEYBOARD && key_pressed(&reports[0].keys, 0x04));
+    CHECK(reports[1].itf == ONEKM_HID_MOUSE && reports[1].dx == 3);
+
+    // 只取走鼠标报告：键盘报告还在端点里，帧 0 不确认
+    take_report(ONEKM_HID_MOUSE);
+    onekm_core_hid_send();
+    CHECK(ack_count == 0);
+
+    // 键盘端点仍忙：下一帧的鼠标移动照常提交，松开留在键盘 FIFO 里
+    msg_keyboard_keys(&msgs[0], 0x04, 0);
+    msg_mouse_move(&msgs[1], 4, 0);
+    receive_frame(1, msgs, 2);
+    onekm_core_hid_send();
+    CHECK(report_count == 3);
+    CHECK(reports[2].itf == ONEKM_HID_MOUSE && reports[2].dx == 4);
+
+    // 鼠标的完成回调不会让键盘接口提交
+    take_report(ONEKM_HID_MOUSE);
+    onekm_core_hid_send();
+    CHECK(report_count == 3);
+    CHECK(ack_count == 0);
+
+    take_report(ONEKM_HID_KEYBOARD);
+    onekm_core_hid_send();
+    CHECK(ack_count == 1 && ack_is(0, 0, ACK_FLAG_HID_DELIVERED));
+    CHECK(report_count == 4);
+    CHECK(reports[3].itf == ONEKM_HID_KEYBOARD && !key_pressed(&reports[3].keys, 0x04));
+    take_report(ONEKM_HID_KEYBOARD);
+    onekm_core_hid_send();
+    CHECK(ack_count == 2 && ack_is(1, 1, ACK_FLAG_HID_DELIVERED));
+}
+
+// USB 复位：端点里的报告不会被取走，跟踪中的帧不带 HID 标志确认，之后的报告照常提交
+static void test_usb_reset(void)
+{
+    Message move;
+
+    reset();
+    msg_mouse_move(&move, 5, 0);
+    receive_frame(0, &move, 1);
+    onekm_core_hid_send();
+    CHECK(report_count == 1);
+
+    endpoint_busy[ONEKM_HID_MOUSE] = false;    // 总线复位，没有完成回调
+    onekm_core_usb_reset();
+    onekm_core_hid_send();
+    CHECK(ack_count == 1 && ack_is(0, 0, 0));
+
+    msg_mouse_move(&move, 7, 0);
+    receive_frame(1, &move, 1);
+    onekm_core_hid_send();
+    CHECK(report_count == 2 && reports[1].dx == 7);
+    take_report(ONEKM_HID_MOUSE);
+    onekm_core_hid_send();
+    CHECK(ack_count == 2 && ack_is(1, 1, ACK_FLAG_HID_DELIVERED));
+
+    onekm_core_stats_t stats;
+    onekm_core_get_stats(&stats);
+    CHECK(stats.usb_resets == 1);
+}
+
+static const struct {
+    const char *name;
+    void (*run)(void);
+} tests[] = {
+    {"handoff-full", test_handoff_full},
+    {"frame-end-wrap", test_frame_end_wrap},
+    {"complete-before-push", test_complete_before_push},
+    {"complete-after-push", test_complete_after_push},
+    {"keyboard-backpressure", test_keyboard_backpressure},
+    {"hid-routing", test_hid_routing},
+    {"usb-reset", test_usb_reset},
+};
+
+int main(int argc, char *argv[])
+{
+    bool found = false;
+
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        if (argc > 1 && strcmp(argv[1], tests[i].name) != 0) {
+            continue;
+        }
+        found = true;
+        int before = failures;
+        tests[i].run();
+        printf("%-24s %s\n", tests[i].name, failures == before ? "ok" : "FAILED");
+    }
+    if (!found) {
+        fprintf(stderr, "Unknown test %s\n", argv[1]);
+        return 1;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * Unit tests for src/common/spsc_ring.c (spsc-ring-test, run by ctest)
+ *
+ * Single-threaded cases pin down the full/empty boundaries, wrap-around and the
+ * statistics; the last case runs a producer and a consumer thread and checks that
+ * every element arrives exactly once and in order.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include "common/spsc_ring.h"
+
+#define CAPACITY 8
+#define STRESS_ELEMENTS 200000u
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static void test_init(void)
+{
+    SpscRing ring;
+    uint32_t storage[CAPACITY];
+
+    CHECK(spsc_ring_init(&ring, storage, sizeof(uint32_t), 0) == -1);
+    CHECK(spsc_ring_init(&ring, storage, sizeof(uint32_t), 6) == -1);
+    CHECK(spsc_ring_init(&ring, storage, 0, CAPACITY) == -1);
+    CHECK(spsc_ring_init(&ring, NULL, sizeof(uint32_t), CAPACITY) == -1);
+    CHECK(spsc_ring_init(&ring, storage, sizeof(uint32_t), CAPACITY) == 0);
+    CHECK(spsc_ring_capacity(&ring) == CAPACITY);
+    CHECK(spsc_ring_count(&ring) == 0);
+}
+
+// Exactly capacity elements fit; the next push fails and is counted
+static void test_full_and_empty(void)
+{
+    SpscRing ring;
+    uint32_t storage[CAPACITY];
+    uint32_t out[CAPACITY + 1];
+
+    spsc_ring_init(&ring, storage, sizeof(uint32_t), CAPACITY);
+    CHECK(spsc_ring_pop(&ring, out, 1) == 0);
+
+    for (uint32_t i = 0; i < CAPACITY; i++) {
+        CHECK(spsc_ring_push(&ring, &i) == 0);
+    }
+    uint32_t extra = 99;
+    CHECK(spsc_ring_push(&ring, &extra) == -1);
+    CHECK(spsc_ring_push(&ring, &extra) == -1);
+    CHECK(atomic_load(&ring.full_count) == 2);
+    CHECK(spsc_ring_count(&ring) == CAPACITY);
+    CHECK(atomic_load(&ring.high_water) == CAPACITY);
+
+    // Asking for more than is queued returns what is there, in order
+    CHECK(spsc_ring_pop(&ring, out, CAPACITY + 1) == CAPACITY);
+    for (uint32_t i = 0; i < CAPACITY; i++) {
+        CHECK(out[i] == i);
+    }
+    CHECK(spsc_ring_count(&ring) == 0);
+    CHECK(spsc_ring_pop(&ring, out, CAPACITY) == 0);
+}
+
+// Pushes and pops of varying sizes walk the indices across many wraps
+static void test_wrap(void)
+{
+    SpscRing ring;
+    uint32_t storage[CAPACITY];
+    uint32_t out[CAPACITY];
+    uint32_t next_in = 0;
+    uint32_t next_out = 0;
+
+    spsc_ring_init(&ring, storage, sizeof(uint32_t), CAPACITY);
+    for (int round = 0; round < 1000; round++) {
+        size_t push = 1 + (size_t)round % CAPACITY;
+        for (size_t i = 0; i < push; i++) {
+            if (spsc_ring_push(&ring, &next_in) == 0) {
+                next_in++;
+            }
+        }
+        CHECK(spsc_ring_count(&ring) == next_in - next_out);
+
+        size_t n = spsc_ring_pop(&ring, out, 1 + (size_t)round % 5);
+        for (size_t i = 0; i < n; i++) {
+            CHECK(out[i] == next_out);
+            next_out++;
+        }
+    }
+    CHECK(spsc_ring_pop(&ring, out, CAPACITY) == next_in - next_out);
+    CHECK(atomic_load(&ring.high_water) == CAPACITY);
+}
+
+// Elements larger than a word are copied whole, including across the wrap
+static void test_element_size(void)
+{
+    typedef struct {
+        uint8_t kind;
+        uint8_t seq;
+        uint8_t data[13];
+    } Item;
+    SpscRing ring;
+    Item storage[4];
+    Item in;
+    Item out;
+
+    spsc_ring_init(&ring, storage, sizeof(Item), 4);
+    for (int i = 0; i < 11; i++) {
+        memset(&in, i, sizeof(in));
+        CHECK(spsc_ring_push(&ring, &in) == 0);
+        CHECK(spsc_ring_pop(&ring, &out, 1) == 1);
+        CHECK(memcmp(&in, &out, sizeof(in)) == 0);
+    }
+}
+
+typedef struct {
+    SpscRing ring;
+    uint32_t storage[CAPACITY];
+    unsigned int errors;
+} StressContext;
+
+static void *stress_consumer(void *arg)
+{
+    StressContext *ctx = arg;
+    uint32_t out[3];
+    uint32_t expected = 0;
+
+    while (expected < STRESS_ELEMENTS) {
+        size_t n = spsc_ring_pop(&ctx->ring, out, 3);
+        if (n == 0) {
+            sched_yield();      // let the producer run on a single core
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (out[i] != expected) {
+                ctx->errors++;
+            }
+            expected++;
+        }
+    }
+    return NULL;
+}
+
+// One producer and one consumer thread: nothing lost, duplicated or reordered
+static void test_threads(void)
+{
+    static StressContext ctx;
+    pthread_t consumer;
+
+    spsc_ring_init(&ctx.ring, ctx.storage, sizeof(uint32_t), CAPACITY);
+    ctx.errors = 0;
+    pthread_create(&consumer, NULL, stress_consumer, &ctx);
+    for (uint32_t i = 0; i < STRESS_ELEMENTS; i++) {
+        while (spsc_ring_push(&ctx.ring, &i) != 0) {
+            sched_yield();
+        }
+    }
+    pthread_join(consumer, NULL);
+    CHECK(ctx.errors == 0);
+    CHECK(spsc_ring_count(&ctx.ring) == 0);
+}
+
+static const struct {
+    const char *name;
+    void (*run)(void);
+} tests[] = {
+    {"init", test_init},
+    {"full-and-empty", test_full_and_empty},
+    {"wrap", test_wrap},
+    {"element-size", test_element_size},
+    {"threads", test_threads},
+};
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        int before = failures;
+        tests[i].run();
+        printf("%-16s %s\n", tests[i].name, failures == before ? "ok" : "FAILED");
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * onekm_usb_descriptors.h 的布局测试（usb-descriptors，由 ctest 运行）
+ *
+ * 用 TinyUSB 的头文件在主机上编译固件的描述符表，按字节检查：
+ * - 两个 HID 接口，编号与 onekm_hid_itf_t 一致（HID 实例号即接口号，
+ *   onekm_core 按它把键盘报告交给键盘接口、鼠标报告交给鼠标接口）
+ * - 键盘接口 EP 0x81、鼠标接口 EP 0x82，中断端点，bInterval 1，包长装得下各自的输入报告
+ * - 报告描述符声明的是各自的设备（Generic Desktop Keyboard/Mouse），都不带报告 ID
+ *
+ * CMake 以默认配置（NKRO 键盘、16 位鼠标）和 TinyUSB 原生描述符各编译一次
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "onekm_usb_descriptors.h"
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+#define HID_ITEM_REPORT_ID 0x84     // 短条目前缀去掉长度位：Global, tag 8
+#define HID_ITEM_LONG 0xFE
+
+typedef struct {
+    const uint8_t *descriptor;
+    size_t length;
+    uint8_t protocol;           // HID_ITF_PROTOCOL_*
+    uint8_t usage;              // Generic Desktop 下的用途
+    uint8_t endpoint;
+    size_t input_report_size;
+} expected_itf_t;
+
+// 逐个条目检查报告描述符不含报告 ID，且条目恰好铺满整个描述符
+static void check_report_descriptor(const expected_itf_t *expected)
+{
+    const uint8_t *d = expected->descriptor;
+    size_t pos = 0;
+
+    // 开头是 Usage Page (Generic Desktop), Usage (Keyboard/Mouse)
+    CHECK(expected->length >= 4);
+    CHECK(d[0] == 0x05 && d[1] == HID_USAGE_PAGE_DESKTOP);
+    CHECK(d[2] == 0x09 && d[3] == expected->usage);
+
+    while (pos < expected->length) {
+        uint8_t prefix = d[pos];
+        size_t size;
+        if (prefix == HID_ITEM_LONG) {
+            CHECK(pos + 1 < expected->length);
+            size = 2u + d[pos + 1];
+        } else {
+            size = (prefix & 3) == 3 ? 4 : (prefix & 3);
+            CHECK((prefix & 0xFC) != HID_ITEM_REPORT_ID);
+        }
+        pos += 1 + size;
+    }
+    CHECK(pos == expected->length);
+}
+
+static void check_configuration(const expected_itf_t *expected)
+{
+    const uint8_t *d = hid_configuration_descriptor;
+    const tusb_desc_configuration_t *config = (const tusb_desc_configuration_t *)d;
+    int itf = -1;
+    int endpoints[ONEKM_HID_COUNT] = {0};
+
+    CHECK(config->bDescriptorType == TUSB_DESC_CONFIGURATION);
+    CHECK(tu_le16toh(config->wTotalLength) == sizeof(hid_configuration_descriptor));
+    CHECK(config->bNumInterfaces == ONEKM_HID_COUNT);
+
+    for (size_t pos = config->bLength; pos < sizeof(hid_configuration_descriptor); pos += d[pos]) {
+        CHECK(d[pos] >= 2 && pos + d[pos] <= sizeof(hid_configuration_descriptor));
+        if (d[pos] < 2) {
+            break;
+        }
+        switch (d[pos + 1]) {
+            case TUSB_DESC_INTERFACE: {
+                const tusb_desc_interface_t *desc = (const tusb_desc_interface_t *)(d + pos);
+                // HID 实例号按接口出现的顺序编号，必须与 onekm_hid_itf_t 相同
+                itf++;
+                CHECK(itf < ONEKM_HID_COUNT);
+                if (itf >= ONEKM_HID_COUNT) {
+                    return;
+                }
+                CHECK(desc->bInterfaceNumber == itf);
+                CHECK(desc->bInterfaceClass == TUSB_CLASS_HID);
+                CHECK(desc->bInterfaceSubClass == HID_SUBCLASS_BOOT);
+                CHECK(desc->bInterfaceProtocol == expected[itf].protocol);
+                CHECK(desc->bNumEndpoints == 1);
+                break;
+            }
+            case HID_DESC_TYPE_HID: {
+                const tusb_hid_descriptor_hid_t *desc = (const tusb_hid_descriptor_hid_t *)(d + pos);
+                CHECK(itf >= 0);
+                if (itf >= 0) {
+                    CHECK(tu_le16toh(desc->wReportLength) == expected[itf].length);
+                }
+                break;
+            }
+            case TUSB_DESC_ENDPOINT: {
+                const tusb_desc_endpoint_t *desc = (const tusb_desc_endpoint_t *)(d + pos);
+                CHECK(itf >= 0);
+                if (itf < 0) {
+                    break;
+                }
+                endpoints[itf]++;
+                CHECK(desc->bEndpointAddress == expected[itf].endpoint);
+                CHECK(desc->bmAttributes.xfer == TUSB_XFER_INTERRUPT);
+                CHECK(desc->bInterval == 1);
+                CHECK(tu_edpt_packet_size(desc) >= expected[itf].input_report_size);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    CHECK(itf == ONEKM_HID_COUNT - 1);
+    for (int i = 0; i < ONEKM_HID_COUNT; i++) {
+        CHECK(endpoints[i] == 1);
+    }
+}
+
+int main(void)
+{
+    expected_itf_t expected[ONEKM_HID_COUNT];
+
+    CHECK(ITF_NUM_KEYBOARD == ONEKM_HID_KEYBOARD);
+    CHECK(ITF_NUM_MOUSE == ONEKM_HID_MOUSE);
+    CHECK(ITF_NUM_TOTAL == ONEKM_HID_COUNT);
+
+    expected[ONEKM_HID_KEYBOARD] = (expected_itf_t){
+        .descriptor = keyboard_report_descriptor,
+        .length = sizeof(keyboard_report_descriptor),
+        .protocol = HID_ITF_PROTOCOL_KEYBOARD,
+        .usage = HID_USAGE_DESKTOP_KEYBOARD,
+        .endpoint = 0x81,
+        .input_report_size = ONEKM_KEYBOARD_NKRO ? sizeof(keyboard_nkro_report_t) : sizeof(hid_keyboard_report_t),
+    };
+    expected[ONEKM_HID_MOUSE] = (expected_itf_t){
+        .descriptor = mouse_report_descriptor,
+        .length = sizeof(mouse_report_descriptor),
+        .protocol = HID_ITF_PROTOCOL_MOUSE,
+        .usage = HID_USAGE_DESKTOP_MOUSE,
+        .endpoint = 0x82,
+        .input_report_size = ONEKM_MOUSE_16BIT ? sizeof(mouse16_report_t) : sizeof(hid_mouse_report_t),
+    };
+
+    for (int i = 0; i < ONEKM_HID_COUNT; i++) {
+        check_report_descriptor(&expected[i]);
+    }
+    check_configuration(expected);
+
+    printf("usb descriptors (%s keyboard, %s mouse) %s\n",
+           ONEKM_KEYBOARD_NKRO ? "NKRO" : "boot", ONEKM_MOUSE_16BIT ? "16-bit" : "8-bit",
+           failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,366 @@
+// Stand-in for the ESP32 dongle, for exercising the server (framing, acks, link
+// test) without hardware. By default it creates a pseudo-terminal and prints the
+// path to pass to onekm-server; --listen serves the server's other transports.
+// It decodes the frames it receives and acknowledges them like the firmware
+// does: frames without HID output at once, HID frames at the next simulated USB
+// poll, merged into one ack when several land in the same interval.
+
+#include "common/protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#define DEFAULT_POLL_INTERVAL_US 1000   // full-speed HID with bInterval 1
+
+static volatile sig_atomic_t running = 1;
+static int link_fd = -1;           // where frames arrive and acks go
+static int listen_fd = -1;         // unix/tcp: waiting for the server to connect
+static int link_is_datagram = 0;   // udp: acks go to the last sender
+static struct sockaddr_storage peer_addr;
+static socklen_t peer_addr_len = 0;
+static uint8_t tx_seq = 0;
+
+static struct {
+    uint64_t messages;
+    uint64_t hid_frames;
+    uint64_t control_frames;
+    uint64_t acks_sent;
+} counters;
+
+static void handle_signal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static void send_ack(uint8_t seq, uint8_t flags) {
+    uint8_t payload[MSG_MAX_ENCODED_SIZE];
+    uint8_t frame[FRAME_MAX_ENCODED_SIZE];
+    Message msg;
+
+    msg_ack(&msg, seq, flags);
+    size_t len = msg_encode(&msg, PROTOCOL_V2, payload, sizeof(payload));
+    len = frame_encode(tx_seq++, payload, len, frame, sizeof(frame));
+    ssize_t sent;
+    if (link_is_datagram) {
+        sent = peer_addr_len ? sendto(link_fd, frame, len, 0, (struct sockaddr *)&peer_addr, peer_addr_len) : 0;
+    } else {
+        sent = send(link_fd, frame, len, MSG_NOSIGNAL);
+        if (sent < 0 && errno == ENOTSOCK) {
+            sent = write(link_fd, frame, len);
+        }
+    }
+    if (sent < 0 && errno != EAGAIN && errno != EIO && errno != EPIPE) {
+        perror("ack write failed");
+    }
+    counters.acks_sent++;
+}
+
+static int is_hid_message(uint8_t type) {
+    switch (type) {
+        case MSG_MOUSE_MOVE:
+        case MSG_MOUSE_BUTTON:
+        case MSG_MOUSE_WHEEL:
+        case MSG_MOUSE_REPORT:
+        case MSG_MOUSE_SCROLL:
+        case MSG_KEYBOARD_REPORT:
+        case MSG_KEYBOARD_KEYS:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int open_pty(void) {
+    struct termios tio;
+
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+        perror("Failed to create pty");
+        return -1;
+    }
+    // Raw on the master side too, so no byte is translated on the way back
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    printf("Fake dongle on %s", ptsname(fd));
+    return fd;
+}
+
+// Existing terminal, e.g. the pty printed by onekm-server's pty transport
+static int open_tty(const char *path) {
+    struct termios tio;
+
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    printf("Fake dongle on %s", path);
+    return fd;
+}
+
+static int open_socket(int family, int type, const struct sockaddr *addr, socklen_t len) {
+    int one = 1;
+    int fd = socket(family, type, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, addr, len) != 0 || (type == SOCK_STREAM && listen(fd, 1) != 0)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// unix:PATH, tcp:PORT or udp:PORT. Returns 0 on success, -1 on failure
+static int open_listener(const char *spec) {
+    if (strncmp(spec, "unix:", 5) == 0) {
+        struct sockaddr_un addr = {0};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, spec + 5, sizeof(addr.sun_path) - 1);
+        unlink(addr.sun_path);
+        listen_fd = open_socket(AF_UNIX, SOCK_STREAM, (struct sockaddr *)&addr, sizeof(addr));
+    } else if (strncmp(spec, "tcp:", 4) == 0 || strncmp(spec, "udp:", 4) == 0) {
+        struct sockaddr_in addr = {0};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons((uint16_t)atoi(spec + 4));
+        if (spec[0] == 'u') {
+            link_is_datagram = 1;
+            link_fd = open_socket(AF_INET, SOCK_DGRAM, (struct sockaddr *)&addr, sizeof(addr));
+            if (link_fd < 0) {
+                perror("Failed to bind");
+                return -1;
+            }
+            printf("Fake dongle on udp 127.0.0.1:%s", spec + 4);
+            return 0;
+        }
+        listen_fd = open_socket(AF_INET, SOCK_STREAM, (struct sockaddr *)&addr, sizeof(addr));
+    } else {
+        fprintf(stderr, "Unknown listen address %s\n", spec);
+        return -1;
+    }
+    if (listen_fd < 0) {
+        perror("Failed to listen");
+        return -1;
+    }
+    printf("Fake dongle listening on %s", spec);
+    return 0;
+}
+
+// Read whatever arrived on the link. Returns bytes read, 0 if nothing, -1 when
+// the connection closed
+static ssize_t read_link(uint8_t *buf, size_t len) {
+    ssize_t n;
+    if (link_is_datagram) {
+        peer_addr_len = sizeof(peer_addr);
+        n = recvfrom(link_fd, buf, len, 0, (struct sockaddr *)&peer_addr, &peer_addr_len);
+    } else {
+        n = read(link_fd, buf, len);
+    }
+    if (n < 0) {
+        // A pty whose other side is not open yet reports EIO
+        return (errno == EAGAIN || errno == EINTR || errno == EIO) ? 0 : -1;
+    }
+    return (n == 0 && listen_fd >= 0) ? -1 : n;
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options]\n", prog);
+    printf("  -i, --poll-interval USEC  Simulated USB poll interval (default %d)\n",
+           DEFAULT_POLL_INTERVAL_US);
+    printf("  -l, --listen ADDR         Serve the server's transport instead of creating a pty:\n");
+    printf("                            tty:PATH, unix:PATH, tcp:PORT or udp:PORT\n");
+    printf("  -v, --verbose             Print every received message\n");
+    printf("  -h, --help                Show this help\n");
+}
+
+int main(int argc, char *argv[]) {
+    int poll_interval_us = DEFAULT_POLL_INTERVAL_US;
+    int verbose = 0;
+    const char *listen_spec = NULL;
+
+    static const struct option long_options[] = {
+        {"poll-interval", required_argument, NULL, 'i'},
+        {"listen", required_argument, NULL, 'l'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "i:l:vh", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'i':
+                poll_interval_us = atoi(optarg);
+                if (poll_interval_us <= 0) {
+                    fprintf(stderr, "Invalid poll interval %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'l':
+                listen_spec = optarg;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (!listen_spec) {
+        link_fd = open_pty();
+        if (link_fd < 0) {
+            return 1;
+        }
+    } else if (strncmp(listen_spec, "tty:", 4) == 0) {
+        link_fd = open_tty(listen_spec + 4);
+        if (link_fd < 0) {
+            return 1;
+        }
+    } else if (open_listener(listen_spec) != 0) {
+        return 1;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    printf(" (USB poll every %d us)\n", poll_interval_us);
+    if (!listen_spec) {
+        printf("Run: onekm-server %s\n", ptsname(link_fd));
+    }
+    fflush(stdout);
+
+    FrameDecoder decoder;
+    frame_decoder_init(&decoder);
+
+    int hid_ack_pending = 0;
+    uint8_t hid_ack_seq = 0;
+    uint64_t next_poll = now_us() + (uint64_t)poll_interval_us;
+
+    while (running) {
+        int timeout_ms = -1;
+        if (hid_ack_pending) {
+            uint64_t now = now_us();
+            timeout_ms = next_poll > now ? (int)((next_poll - now + 999) / 1000) : 0;
+        }
+
+        struct pollfd pfd = {link_fd >= 0 ? link_fd : listen_fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, timeout_ms);
+        if (ready < 0 && errno != EINTR) {
+            perror("poll failed");
+            break;
+        }
+
+        if (ready > 0 && link_fd < 0) {
+            link_fd = accept(listen_fd, NULL, NULL);
+            if (link_fd >= 0) {
+                printf("Server connected\n");
+                frame_decoder_init(&decoder);
+            }
+            continue;
+        }
+
+        if (ready > 0 && (pfd.revents & (POLLIN | POLLHUP))) {
+            uint8_t buf[4096];
+            ssize_t len = read_link(buf, sizeof(buf));
+            if (len < 0) {
+                // Stream connection closed: wait for the next one
+                printf("Server disconnected\n");
+                close(link_fd);
+                link_fd = -1;
+                hid_ack_pending = 0;
+                continue;
+            }
+            for (ssize_t i = 0; i < len; i++) {
+                uint8_t seq;
+                const uint8_t *payload;
+                size_t payload_len;
+                if (!frame_decoder_feed(&decoder, buf[i], &seq, &payload, &payload_len)) {
+                    continue;
+                }
+
+                int hid = 0, link_config = 0;
+                size_t pos = 0;
+                Message msg;
+                while (pos < payload_len) {
+                    int n = msg_decode(payload + pos, payload_len - pos, &msg);
+                    if (n <= 0) {
+                        break;
+                    }
+                    pos += (size_t)n;
+                    counters.messages++;
+                    hid |= is_hid_message(msg.type);
+                    link_config |= msg.type == MSG_LINK_CONFIG;
+                    if (verbose) {
+                        printf("frame %3u: type %d\n", seq, msg.type);
+                    }
+                }
+
+                if (link_config) {
+                    continue;   // the real dongle changes its rate instead of answering
+                }
+                if (hid) {
+                    counters.hid_frames++;
+                    hid_ack_seq = seq;
+                    hid_ack_pending = 1;
+                } else {
+                    counters.control_frames++;
+                    send_ack(seq, 0);
+                }
+            }
+        }
+
+        // The host polls on a fixed schedule; whatever is pending goes in the next poll
+        uint64_t now = now_us();
+        if (now >= next_poll) {
+            if (hid_ack_pending) {
+                send_ack(hid_ack_seq, ACK_FLAG_HID_DELIVERED);
+                hid_ack_pending = 0;
+            }
+            next_poll += ((now - next_poll) / (uint64_t)poll_interval_us + 1) * (uint64_t)poll_interval_us;
+        }
+    }
+
+    printf("\n%llu messages in %llu HID and %llu control frames, %llu acks sent\n",
+           (unsigned long long)counters.messages, (unsigned long long)counters.hid_frames,
+           (unsigned long long)counters.control_frames, (unsigned long long)counters.acks_sent);
+    printf("Link errors: crc %u, format %u, lost frames %u\n",
+           decoder.stats.crc_errors, decoder.stats.format_errors, decoder.stats.seq_gaps);
+    if (link_fd >= 0) {
+        close(link_fd);
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+    }
+    return 0;
+}